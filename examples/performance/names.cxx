@@ -0,0 +1,142 @@
+// file      : examples/performance/names.cxx
+// license   : not copyrighted - public domain
+
+// Measure how the serialization performance scales with the number of
+// distinct element, attribute, and namespace names in the document, both
+// with names passed as strings and with pre-declared names (handles).
+//
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include <libstudxml/serializer.hxx>
+#include <libstudxml/output-sink.hxx>
+
+#include "time.hxx"
+
+using namespace std;
+using namespace xml;
+
+// Total number of elements serialized in each run, regardless of the number
+// of distinct names.
+//
+const unsigned long elements = 1000000;
+
+static string
+name (const char* p, size_t i)
+{
+  ostringstream os;
+  os << p << i;
+  return os.str ();
+}
+
+// Serialize a document with the specified number of distinct element and
+// attribute names (plus a tenth as many namespaces) returning the time
+// taken in microseconds and the document size.
+//
+static double
+run (size_t n, bool declared, size_t& size)
+{
+  size_t nn (n / 10 != 0 ? n / 10 : 1);
+
+  vector<string> ns, en, an;
+
+  for (size_t i (0); i != nn; ++i)
+    ns.push_back (name ("urn:example:names:", i));
+
+  for (size_t i (0); i != n; ++i)
+  {
+    en.push_back (name ("element", i));
+    an.push_back (name ("attribute", i));
+  }
+
+  string out;
+  string_output_sink os (out);
+
+  os::time start;
+
+  serializer s (os, "names", 0);
+
+  s.start_element ("root");
+
+  for (size_t i (0); i != nn; ++i)
+    s.namespace_decl (ns[i], name ("p", i));
+
+  if (declared)
+  {
+    vector<serializer::element_handle> eh;
+    vector<serializer::attribute_handle> ah;
+
+    for (size_t i (0); i != n; ++i)
+    {
+      eh.push_back (s.declare_element (ns[i % nn], en[i]));
+      ah.push_back (s.declare_attribute (an[i]));
+    }
+
+    const string v ("v");
+
+    for (unsigned long i (0); i != elements; ++i)
+    {
+      size_t j (i % n);
+
+      s.start_element (eh[j]);
+      s.attribute (ah[j], v);
+      s.end_element ();
+    }
+  }
+  else
+  {
+    for (unsigned long i (0); i != elements; ++i)
+    {
+      size_t j (i % n);
+
+      s.start_element (ns[j % nn], en[j]);
+      s.attribute (an[j], "v");
+      s.end_element ();
+    }
+  }
+
+  s.end_element ();
+
+  os::time end;
+  os::time time (end - start);
+
+  size = out.size ();
+
+  return static_cast<double> (
+    time.sec () * 1000000ULL + time.nsec () / 1000ULL);
+}
+
+int
+main ()
+{
+  try
+  {
+    size_t size;
+    run (10, false, size); // Warmup.
+
+    const size_t counts[] = {10, 100, 1000, 10000};
+
+    for (size_t d (0); d != 2; ++d)
+    {
+      cerr << (d == 0 ? "string names:" : "declared names:") << endl;
+
+      for (size_t i (0); i != sizeof (counts) / sizeof (counts[0]); ++i)
+      {
+        double us (run (counts[i], d != 0, size));
+
+        cerr << "  " << counts[i] << " names: "
+             << us * 1000 / elements << " ns/element, "
+             << ((size / us) * 1000000/(1024*1024)) << " MBytes/sec"
+             << endl;
+      }
+    }
+  }
+  catch (const xml::exception& e)
+  {
+    cerr << e.what () << endl;
+    return 1;
+  }
+}
@@ -0,0 +1,136 @@
+// file      : examples/performance/stream.cxx
+// license   : not copyrighted - public domain
+
+// Measure the effect of the input chunk size on parsing from a stream.
+//
+
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include <libstudxml/parser.hxx>
+
+#include "time.hxx"
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace xml;
+
+const unsigned long iterations = 200;
+
+// Parse the file iterations times with the specified chunk size (and
+// maximum chunk size, if adaptive) returning the time taken in
+// microseconds. Also return the final chunk size.
+//
+static double
+run (const char* file, size_t chunk, size_t max, size_t& final)
+{
+  os::time start;
+
+  for (unsigned long i (0); i < iterations; ++i)
+  {
+    ifstream ifs;
+    ifs.exceptions (ifstream::badbit | ifstream::failbit);
+    ifs.open (file, ifstream::in | ifstream::binary);
+
+    parser p (ifs,
+              file,
+              parser::receive_default | parser::receive_attributes_event);
+
+    p.chunk_size (chunk, max);
+
+    unsigned long start_count (0), end_count (0);
+
+    for (parser::event_type e (p.next ()); e != parser::eof; e = p.next ())
+    {
+      switch (e)
+      {
+      case parser::start_element:
+        start_count++;
+        break;
+      case parser::end_element:
+        end_count++;
+        break;
+      default:
+        break;
+      }
+    }
+
+    assert (start_count == end_count);
+    final = p.chunk_size ();
+  }
+
+  os::time end;
+  os::time time (end - start);
+
+  return static_cast<double> (
+    time.sec () * 1000000ULL + time.nsec () / 1000ULL);
+}
+
+int
+main (int argc, char* argv[])
+{
+  if (argc != 2)
+  {
+    cerr << "usage: " << argv[0] << " <xml-file>" << endl;
+    return 1;
+  }
+
+  try
+  {
+    ifstream ifs;
+    ifs.exceptions (ios_base::failbit);
+    ifs.open (argv[1], ios::in | ios::ate);
+
+    size_t size (static_cast<size_t> (ifs.tellg ()));
+    ifs.close ();
+
+    cerr << "  document size:  " << size << " bytes" << endl;
+
+    // Warmup.
+    //
+    size_t final;
+    run (argv[1], 4096, 0, final);
+
+    struct
+    {
+      size_t chunk;
+      size_t max;
+    } runs[] = {
+      {1024, 0},
+      {4096, 0},
+      {16384, 0},
+      {65536, 0},
+      {262144, 0},
+      {4096, 1048576}}; // Adaptive.
+
+    for (size_t i (0); i != sizeof (runs) / sizeof (runs[0]); ++i)
+    {
+      double us (run (argv[1], runs[i].chunk, runs[i].max, final));
+
+      // Calculate throughput in MBytes/sec.
+      //
+      double tpb (((size * iterations) / us) * 1000000/(1024*1024));
+
+      cerr << "  chunk " << runs[i].chunk;
+
+      if (runs[i].max != 0)
+        cerr << "-" << runs[i].max << " (adaptive, settled at " << final
+             << ")";
+
+      cerr << ": " << tpb << " MBytes/sec" << endl;
+    }
+  }
+  catch (const ios_base::failure&)
+  {
+    cerr << "io failure" << endl;
+    return 1;
+  }
+  catch (const xml::exception& e)
+  {
+    cerr << e.what () << endl;
+    return 1;
+  }
+}
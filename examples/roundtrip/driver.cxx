@@ -91,6 +91,12 @@ main (int argc, char* argv[])
           //
           break;
         }
+      case parser::need_more_input:
+        {
+          // Only returned in the push mode.
+          //
+          break;
+        }
       }
     }
   }
@@ -0,0 +1,147 @@
+// file      : libstudxml/allocator.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <new>     // operator new, std::bad_alloc
+#include <cstddef> // std::max_align_t
+#include <cstdint> // std::uintptr_t
+#include <cstring> // std::memcpy
+
+#include <libstudxml/allocator.hxx>
+#include <libstudxml/details/allocator.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  // allocator
+  //
+  allocator::
+  ~allocator ()
+  {
+  }
+
+  // monotonic_allocator
+  //
+  monotonic_allocator::
+  monotonic_allocator (size_t bs)
+      : block_size_ (bs), blocks_ (0), cur_ (0), left_ (0)
+  {
+  }
+
+  monotonic_allocator::
+  ~monotonic_allocator ()
+  {
+    release ();
+  }
+
+  void monotonic_allocator::
+  release ()
+  {
+    for (block* b (blocks_); b != 0; )
+    {
+      block* n (b->next);
+      operator delete (b);
+      b = n;
+    }
+
+    blocks_ = 0;
+    cur_ = 0;
+    left_ = 0;
+  }
+
+  void* monotonic_allocator::
+  allocate (size_t n, size_t a)
+  {
+    // Note that the alignment is a power of 2.
+    //
+    size_t pad (static_cast<size_t> (-reinterpret_cast<uintptr_t> (cur_)) &
+                (a - 1));
+
+    if (cur_ == 0 || pad + n > left_)
+    {
+      // Allocate a new block making sure it is big enough for this
+      // allocation. Note that the space after the block header is aligned
+      // to alignof (std::max_align_t).
+      //
+      const size_t h (sizeof (max_align_t));
+      size_t bs (n + a > block_size_ ? n + a : block_size_);
+
+      block* b (static_cast<block*> (operator new (h + bs)));
+      b->next = blocks_;
+      blocks_ = b;
+
+      cur_ = reinterpret_cast<char*> (b) + h;
+      left_ = bs;
+      pad = static_cast<size_t> (-reinterpret_cast<uintptr_t> (cur_)) &
+            (a - 1);
+    }
+
+    char* r (cur_ + pad);
+    cur_ = r + n;
+    left_ -= pad + n;
+    return r;
+  }
+
+  namespace details
+  {
+    union header
+    {
+      struct
+      {
+        allocator* a;
+        size_t size;
+      } h;
+
+      max_align_t align;
+    };
+
+    static const size_t header_size (sizeof (header));
+    static const size_t header_align (alignof (max_align_t));
+
+    void*
+    c_malloc (allocator& a, size_t n) noexcept
+    {
+      try
+      {
+        header* h (static_cast<header*> (
+                     a.allocate (header_size + n, header_align)));
+        h->h.a = &a;
+        h->h.size = n;
+        return h + 1;
+      }
+      catch (const bad_alloc&)
+      {
+        return 0;
+      }
+    }
+
+    void*
+    c_realloc (void* p, size_t n) noexcept
+    {
+      header* h (static_cast<header*> (p) - 1);
+
+      if (n <= h->h.size)
+        return p;
+
+      void* r (c_malloc (*h->h.a, n));
+
+      if (r != 0)
+      {
+        memcpy (r, p, h->h.size);
+        c_free (p);
+      }
+
+      return r;
+    }
+
+    void
+    c_free (void* p) noexcept
+    {
+      if (p != 0)
+      {
+        header* h (static_cast<header*> (p) - 1);
+        h->h.a->deallocate (h, header_size + h->h.size, header_align);
+      }
+    }
+  }
+}
@@ -0,0 +1,124 @@
+// file      : libstudxml/allocator.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_ALLOCATOR_HXX
+#define LIBSTUDXML_ALLOCATOR_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <cstddef> // std::size_t
+
+#include <libstudxml/details/config.hxx> // LIBSTUDXML_MEMORY_RESOURCE
+
+#ifdef LIBSTUDXML_MEMORY_RESOURCE
+#  include <memory_resource>
+#endif
+
+#include <libstudxml/forward.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Memory allocator that can be passed to the parser and serializer in
+  // order to allocate the memory used by the underlying Expat parser and
+  // Genx writer. The allocator should outlive the parser or serializer
+  // that uses it.
+  //
+  // The interface mirrors that of std::pmr::memory_resource. In particular,
+  // allocation failures should be reported by throwing std::bad_alloc.
+  //
+  class LIBSTUDXML_EXPORT allocator
+  {
+  public:
+    virtual
+    ~allocator ();
+
+    virtual void*
+    allocate (std::size_t size, std::size_t alignment) = 0;
+
+    virtual void
+    deallocate (void*, std::size_t size, std::size_t alignment) = 0;
+  };
+
+  // Monotonic (arena) allocator. Memory is allocated from blocks obtained
+  // with operator new and is only returned (all at once) by release() or
+  // when the allocator is destroyed; deallocate() is a no-op. Note that
+  // this allocator is not thread-safe.
+  //
+  // A typical usage is to allocate one per request or per thread and to
+  // release it once the parsers and serializers that use it have been
+  // destroyed.
+  //
+  class LIBSTUDXML_EXPORT monotonic_allocator: public allocator
+  {
+  public:
+    explicit
+    monotonic_allocator (std::size_t block_size = 64 * 1024);
+
+    virtual
+    ~monotonic_allocator ();
+
+    virtual void*
+    allocate (std::size_t size, std::size_t alignment);
+
+    virtual void
+    deallocate (void*, std::size_t, std::size_t) {}
+
+    // Free all the memory allocated so far.
+    //
+    void
+    release ();
+
+  private:
+    monotonic_allocator (const monotonic_allocator&);
+    monotonic_allocator& operator= (const monotonic_allocator&);
+
+  private:
+    struct block
+    {
+      block* next;
+    };
+
+    std::size_t block_size_;
+    block* blocks_;
+    char* cur_;        // Free space in the current block.
+    std::size_t left_;
+  };
+
+#ifdef LIBSTUDXML_MEMORY_RESOURCE
+  // Adapter for std::pmr::memory_resource. Note that this class is header-
+  // only so that the library ABI does not depend on the C++ version.
+  //
+  class memory_resource_allocator: public allocator
+  {
+  public:
+    explicit
+    memory_resource_allocator (
+      std::pmr::memory_resource* r = std::pmr::get_default_resource ())
+        : r_ (r) {}
+
+    virtual void*
+    allocate (std::size_t size, std::size_t alignment)
+    {
+      return r_->allocate (size, alignment);
+    }
+
+    virtual void
+    deallocate (void* p, std::size_t size, std::size_t alignment)
+    {
+      r_->deallocate (p, size, alignment);
+    }
+
+    std::pmr::memory_resource*
+    resource () const {return r_;}
+
+  private:
+    std::pmr::memory_resource* r_;
+  };
+#endif
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_ALLOCATOR_HXX
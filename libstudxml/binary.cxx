@@ -0,0 +1,391 @@
+// file      : libstudxml/binary.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <libstudxml/binary.hxx>
+
+// On x86 with GCC or Clang use SSSE3, if supported by the CPU (checked at
+// runtime), to decode and encode base64 16 characters at a time using the
+// algorithms from "Faster Base64 Encoding and Decoding Using AVX2
+// Instructions" by Wojciech Mula and Daniel Lemire (adapted to 128-bit
+// vectors).
+//
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define LIBSTUDXML_BASE64_SSSE3 1
+#  include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+namespace xml
+{
+  static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  static const char hex_chars[] = "0123456789ABCDEF";
+
+  // Character values: 0-63 for base64 digits (0-15 for hex digits), ws
+  // for whitespaces, eq for '=', and bad for the rest.
+  //
+  static const unsigned char ws = 0xFD, eq = 0xFE, bad = 0xFF;
+
+  struct binary_tables
+  {
+    unsigned char base64[256];
+    unsigned char hex[256];
+
+    binary_tables ()
+    {
+      for (unsigned int i (0); i != 256; ++i)
+        base64[i] = hex[i] = bad;
+
+      for (unsigned int i (0); i != 64; ++i)
+        base64[static_cast<unsigned char> (base64_chars[i])] =
+          static_cast<unsigned char> (i);
+
+      for (unsigned int i (0); i != 16; ++i)
+      {
+        hex[static_cast<unsigned char> (hex_chars[i])] =
+          static_cast<unsigned char> (i);
+
+        if (i > 9)
+          hex[static_cast<unsigned char> (hex_chars[i] - 'A' + 'a')] =
+            static_cast<unsigned char> (i);
+      }
+
+      const char s[] = {' ', '\t', '\n', '\r'};
+      for (unsigned int i (0); i != sizeof (s); ++i)
+        base64[static_cast<unsigned char> (s[i])] =
+          hex[static_cast<unsigned char> (s[i])] = ws;
+
+      base64[static_cast<unsigned char> ('=')] = eq;
+    }
+  };
+
+  static const binary_tables tables;
+
+#ifdef LIBSTUDXML_BASE64_SSSE3
+  // Decode 16 base64 digits into 12 bytes (the 16-byte buffer is
+  // written). Return the mask of characters that are not base64 digits
+  // (in which case nothing is written).
+  //
+  __attribute__((target("ssse3")))
+  static unsigned int
+  base64_decode_block (const char* s, unsigned char* d)
+  {
+    const __m128i v (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (s)));
+
+    const __m128i lo_lut (_mm_setr_epi8 (
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+
+    const __m128i hi_lut (_mm_setr_epi8 (
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+
+    const __m128i roll_lut (_mm_setr_epi8 (
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+
+    const __m128i nib (_mm_set1_epi8 (0x0F));
+
+    __m128i hi (_mm_and_si128 (_mm_srli_epi32 (v, 4), nib));
+    __m128i lo (_mm_and_si128 (v, nib));
+
+    __m128i e (_mm_and_si128 (_mm_shuffle_epi8 (lo_lut, lo),
+                              _mm_shuffle_epi8 (hi_lut, hi)));
+
+    unsigned int m (static_cast<unsigned int> (
+      _mm_movemask_epi8 (_mm_cmpgt_epi8 (e, _mm_setzero_si128 ()))));
+
+    if (m != 0)
+      return m;
+
+    // Translate to 6-bit values and pack.
+    //
+    __m128i sl (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('/')));
+    __m128i x (_mm_add_epi8 (
+                 v, _mm_shuffle_epi8 (roll_lut, _mm_add_epi8 (sl, hi))));
+
+    x = _mm_maddubs_epi16 (x, _mm_set1_epi32 (0x01400140));
+    x = _mm_madd_epi16 (x, _mm_set1_epi32 (0x00011000));
+    x = _mm_shuffle_epi8 (x, _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                            14, 13, 12, -1, -1, -1, -1));
+
+    _mm_storeu_si128 (reinterpret_cast<__m128i*> (d), x);
+    return 0;
+  }
+
+  // Encode 12 bytes (16 are read) into 16 base64 digits.
+  //
+  __attribute__((target("ssse3")))
+  static void
+  base64_encode_block (const unsigned char* s, char* d)
+  {
+    __m128i v (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (s)));
+
+    v = _mm_shuffle_epi8 (v, _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7,
+                                           4, 5, 3, 4, 1, 2, 0, 1));
+
+    __m128i t0 (_mm_mulhi_epu16 (_mm_and_si128 (v, _mm_set1_epi32 (0x0FC0FC00)),
+                                 _mm_set1_epi32 (0x04000040)));
+
+    __m128i t1 (_mm_mullo_epi16 (_mm_and_si128 (v, _mm_set1_epi32 (0x003F03F0)),
+                                 _mm_set1_epi32 (0x01000010)));
+
+    __m128i i (_mm_or_si128 (t0, t1)); // 6-bit values.
+
+    const __m128i shift_lut (_mm_setr_epi8 (
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0));
+
+    __m128i r (_mm_subs_epu8 (i, _mm_set1_epi8 (51)));
+    r = _mm_or_si128 (
+      r,
+      _mm_and_si128 (_mm_cmpgt_epi8 (_mm_set1_epi8 (26), i),
+                     _mm_set1_epi8 (13)));
+
+    r = _mm_add_epi8 (_mm_shuffle_epi8 (shift_lut, r), i);
+
+    _mm_storeu_si128 (reinterpret_cast<__m128i*> (d), r);
+  }
+
+  static bool
+  ssse3_supported ()
+  {
+    __builtin_cpu_init ();
+    return __builtin_cpu_supports ("ssse3") != 0;
+  }
+
+  static const bool ssse3 (ssse3_supported ());
+#endif
+
+  // base64_decoder
+  //
+  bool base64_decoder::
+  decode (const char* s, size_t n, void* data, size_t& size)
+  {
+    unsigned char* d (static_cast<unsigned char*> (data));
+    unsigned char* b (d);
+
+    const char* e (s + n);
+
+    unsigned int v (value_), c (count_);
+
+    while (s != e)
+    {
+#ifdef LIBSTUDXML_BASE64_SSSE3
+      // Decode complete blocks at the quantum boundary. If a block
+      // contains anything other than digits, decode it one character at a
+      // time up to (and including) the first such character.
+      //
+      const char* x (s);
+
+      if (c == 0 && pad_ == 0 && ssse3)
+      {
+        // Each block writes 16 bytes which stays within the buffer (see
+        // decode_size()) as long as there are at least 24 characters left.
+        //
+        for (; e - s >= 24; s += 16, d += 12)
+        {
+          if (unsigned int m = base64_decode_block (s, d))
+          {
+            x = s + __builtin_ctz (m) + 1;
+            break;
+          }
+        }
+      }
+#endif
+      // Decode one character at a time.
+      //
+      do
+      {
+        unsigned char t (tables.base64[static_cast<unsigned char> (*s++)]);
+
+        if (t == ws)
+          continue;
+
+        if (t == eq)
+        {
+          switch (pad_ != 0 ? 4 : c)
+          {
+          case 2:
+            {
+              *d++ = static_cast<unsigned char> (v >> 4);
+              pad_ = 1;
+              break;
+            }
+          case 3:
+            {
+              *d++ = static_cast<unsigned char> (v >> 10);
+              *d++ = static_cast<unsigned char> (v >> 2);
+              pad_ = 2;
+              break;
+            }
+          default:
+            {
+              if (pad_ != 1)
+                return false;
+
+              pad_ = 2;
+              break;
+            }
+          }
+
+          v = 0;
+          c = 0;
+          continue;
+        }
+
+        if (t == bad || pad_ != 0)
+          return false;
+
+        v = (v << 6) | t;
+
+        if (++c == 4)
+        {
+          *d++ = static_cast<unsigned char> (v >> 16);
+          *d++ = static_cast<unsigned char> (v >> 8);
+          *d++ = static_cast<unsigned char> (v);
+          v = 0;
+          c = 0;
+        }
+      }
+#ifdef LIBSTUDXML_BASE64_SSSE3
+      while (s != e && (s < x || c != 0));
+#else
+      while (s != e);
+#endif
+    }
+
+    value_ = v;
+    count_ = c;
+    size = static_cast<size_t> (d - b);
+    return true;
+  }
+
+  // hex_decoder
+  //
+  bool hex_decoder::
+  decode (const char* s, size_t n, void* data, size_t& size)
+  {
+    unsigned char* d (static_cast<unsigned char*> (data));
+    unsigned char* b (d);
+
+    for (const char* e (s + n); s != e; ++s)
+    {
+      unsigned char t (tables.hex[static_cast<unsigned char> (*s)]);
+
+      if (t == ws)
+        continue;
+
+      if (t == bad)
+        return false;
+
+      if (half_)
+        *d++ = static_cast<unsigned char> ((value_ << 4) | t);
+      else
+        value_ = t;
+
+      half_ = !half_;
+    }
+
+    size = static_cast<size_t> (d - b);
+    return true;
+  }
+
+  // base64_encoder
+  //
+  static inline char*
+  base64_encode (const unsigned char* s, char* d)
+  {
+    unsigned int v ((static_cast<unsigned int> (s[0]) << 16) |
+                    (static_cast<unsigned int> (s[1]) << 8) |
+                    s[2]);
+
+    *d++ = base64_chars[v >> 18];
+    *d++ = base64_chars[(v >> 12) & 0x3F];
+    *d++ = base64_chars[(v >> 6) & 0x3F];
+    *d++ = base64_chars[v & 0x3F];
+    return d;
+  }
+
+  size_t base64_encoder::
+  encode (const void* data, size_t n, char* text)
+  {
+    const unsigned char* s (static_cast<const unsigned char*> (data));
+    const unsigned char* e (s + n);
+    char* d (text);
+
+    // Complete the leftover from the previous call.
+    //
+    if (size_ != 0)
+    {
+      for (; size_ != 3 && s != e; ++s)
+      {
+        if (size_ == 2)
+        {
+          unsigned char t[3] = {rest_[0], rest_[1], *s};
+          d = base64_encode (t, d);
+          size_ = 3;
+        }
+        else
+          rest_[size_++] = *s;
+      }
+
+      if (size_ != 3)
+        return 0;
+
+      size_ = 0;
+    }
+
+#ifdef LIBSTUDXML_BASE64_SSSE3
+    if (ssse3)
+    {
+      for (; e - s >= 16; s += 12, d += 16)
+        base64_encode_block (s, d);
+    }
+#endif
+
+    for (; e - s >= 3; s += 3)
+      d = base64_encode (s, d);
+
+    for (; s != e; ++s)
+      rest_[size_++] = *s;
+
+    return static_cast<size_t> (d - text);
+  }
+
+  size_t base64_encoder::
+  finish (char* d)
+  {
+    if (size_ == 0)
+      return 0;
+
+    unsigned char t[3] = {
+      rest_[0], static_cast<unsigned char> (size_ == 2 ? rest_[1] : 0), 0};
+    base64_encode (t, d);
+
+    d[3] = '=';
+    if (size_ == 1)
+      d[2] = '=';
+
+    size_ = 0;
+    return 4;
+  }
+
+  // hex_encoder
+  //
+  size_t hex_encoder::
+  encode (const void* data, size_t n, char* text)
+  {
+    const unsigned char* s (static_cast<const unsigned char*> (data));
+
+    for (const unsigned char* e (s + n); s != e; ++s)
+    {
+      *text++ = hex_chars[*s >> 4];
+      *text++ = hex_chars[*s & 0x0F];
+    }
+
+    return n * 2;
+  }
+}
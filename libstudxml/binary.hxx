@@ -0,0 +1,121 @@
+// file      : libstudxml/binary.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_BINARY_HXX
+#define LIBSTUDXML_BINARY_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <cstddef> // std::size_t
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Incremental base64 and hex encoding and decoding of binary data in
+  // XML content (XML Schema base64Binary and hexBinary). The text can be
+  // fed in arbitrary portions, for example, as received with the
+  // receive_characters_chunked parser feature (see also the
+  // parser::element_base64() and serializer::characters_base64()
+  // helpers that are implemented in terms of these classes).
+  //
+
+  // Whitespaces in the encoded text are ignored. The decoding functions
+  // return false if the text is invalid.
+  //
+  class LIBSTUDXML_EXPORT base64_decoder
+  {
+  public:
+    base64_decoder (): value_ (0), count_ (0), pad_ (0) {}
+
+    // Decode the next portion of the text into the buffer which should be
+    // at least decode_size(n) bytes long and set size to the number of
+    // bytes written.
+    //
+    bool
+    decode (const char* text, std::size_t n, void* data, std::size_t& size);
+
+    // Return false if the text ended in the middle of a quantum.
+    //
+    bool
+    finish () const {return count_ == 0 && pad_ != 1;}
+
+    static std::size_t
+    decode_size (std::size_t n) {return n / 4 * 3 + 3;}
+
+  private:
+    unsigned int value_;
+    unsigned int count_; // Characters in the current quantum.
+    unsigned int pad_;   // 0 - none, 1 - one more '=' expected, 2 - done.
+  };
+
+  class LIBSTUDXML_EXPORT hex_decoder
+  {
+  public:
+    hex_decoder (): value_ (0), half_ (false) {}
+
+    // Decode the next portion of the text into the buffer which should be
+    // at least decode_size(n) bytes long and set size to the number of
+    // bytes written.
+    //
+    bool
+    decode (const char* text, std::size_t n, void* data, std::size_t& size);
+
+    // Return false if the text ended in the middle of a byte.
+    //
+    bool
+    finish () const {return !half_;}
+
+    static std::size_t
+    decode_size (std::size_t n) {return n / 2 + 1;}
+
+  private:
+    unsigned int value_;
+    bool half_;
+  };
+
+  // Encoded text is written without line breaks.
+  //
+  class LIBSTUDXML_EXPORT base64_encoder
+  {
+  public:
+    base64_encoder (): size_ (0) {}
+
+    // Encode the next portion of the data into the buffer which should be
+    // at least encode_size(n) bytes long. Return the number of characters
+    // written. Up to two trailing bytes are kept until the next call or
+    // finish().
+    //
+    std::size_t
+    encode (const void* data, std::size_t n, char* text);
+
+    // Encode the remaining bytes, if any, with padding. The buffer should
+    // be at least 4 bytes long.
+    //
+    std::size_t
+    finish (char* text);
+
+    static std::size_t
+    encode_size (std::size_t n) {return (n + 2) / 3 * 4;}
+
+  private:
+    unsigned char rest_[2];
+    std::size_t size_;
+  };
+
+  // Uppercase letters (canonical hexBinary representation) are used.
+  //
+  class LIBSTUDXML_EXPORT hex_encoder
+  {
+  public:
+    std::size_t
+    encode (const void* data, std::size_t n, char* text);
+
+    static std::size_t
+    encode_size (std::size_t n) {return n * 2;}
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_BINARY_HXX
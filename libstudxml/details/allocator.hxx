@@ -0,0 +1,31 @@
+// file      : libstudxml/details/allocator.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_DETAILS_ALLOCATOR_HXX
+#define LIBSTUDXML_DETAILS_ALLOCATOR_HXX
+
+#include <cstddef> // std::size_t
+
+#include <libstudxml/allocator.hxx>
+
+namespace xml
+{
+  namespace details
+  {
+    // The malloc()/realloc()/free() interface over xml::allocator for the
+    // C code (Expat, Genx). Since free() does not receive the size (nor
+    // the allocator), each block is prefixed with a header that records
+    // both. Allocation failures are reported by returning NULL.
+    //
+    void*
+    c_malloc (allocator&, std::size_t) noexcept;
+
+    void*
+    c_realloc (void*, std::size_t) noexcept; // Block should not be NULL.
+
+    void
+    c_free (void*) noexcept;
+  }
+}
+
+#endif // LIBSTUDXML_DETAILS_ALLOCATOR_HXX
@@ -13,6 +13,22 @@
 #  endif
 #endif
 
+// The std::string_view-based APIs are only available in the C++17 or later
+// mode. Note that the library ABI does not depend on this macro.
+//
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#  define LIBSTUDXML_STRING_VIEW 1
+#endif
+
+// The std::pmr::memory_resource allocator adapter is only available if the
+// standard library provides <memory_resource> (C++17 or later).
+//
+#if defined(LIBSTUDXML_STRING_VIEW) && defined(__has_include)
+#  if __has_include(<memory_resource>)
+#    define LIBSTUDXML_MEMORY_RESOURCE 1
+#  endif
+#endif
+
 #ifdef _MSC_VER
 #  include <libstudxml/details/config-vc.h>
 #else
@@ -11,9 +11,14 @@
 
 #define XML_NS            1
 #define XML_DTD           1
-#define XML_CONTEXT_BYTES 1024
 /* #define XML_FREESTANDING  1 */
 
+/* We don't use XML_GetInputContext() and without XML_CONTEXT_BYTES
+ * XML_Parse() parses directly from the caller's buffer instead of first
+ * copying it into the internal buffer.
+ */
+/* #define XML_CONTEXT_BYTES 1024 */
+
 #define UNUSED(x) (void)x;
 
 /* Specific for Windows.
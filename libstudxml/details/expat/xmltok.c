@@ -314,10 +314,28 @@ sb_charMatches(const ENCODING *enc, const char *p, int c)
 #define CHAR_MATCHES(enc, p, c) (*(p) == c)
 #endif
 
+#if defined(XML_SIMD_SCAN) && !defined(XML_MIN_SIZE)
+#include <libstudxml/details/expat/xmltok_scan.h>
+
+static enum XML_Convert_Result PTRCALL
+unknown_toUtf8(const ENCODING *enc,
+               const char **fromP, const char *fromLim,
+               char **toP, const char *toLim);
+
+/* Skip the plain ASCII run starting at ptr (see xmltok_scan.h). Unknown
+   encodings may remap ASCII bytes, so they are always scanned byte by
+   byte. */
+#define FAST_SCAN(enc, ptr, end, set) \
+  ((end) - (ptr) >= 16 && (enc)->utf8Convert != unknown_toUtf8 \
+   ? scanRun((ptr), (end), (set)) \
+   : (ptr))
+#endif
+
 #define PREFIX(ident) normal_ ## ident
 #define XML_TOK_IMPL_C
 #include <libstudxml/details/expat/xmltok_impl.c>
 #undef XML_TOK_IMPL_C
+#undef FAST_SCAN
 
 #undef MINBPC
 #undef BYTE_TYPE
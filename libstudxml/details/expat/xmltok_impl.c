@@ -53,11 +53,21 @@
   case BT_NAME: \
   case BT_MINUS: \
     ptr += MINBPC(enc); \
+    NAME_SCAN(enc, ptr, end); \
     break; \
   CHECK_NAME_CASE(2, enc, ptr, end, nextTokPtr) \
   CHECK_NAME_CASE(3, enc, ptr, end, nextTokPtr) \
   CHECK_NAME_CASE(4, enc, ptr, end, nextTokPtr)
 
+/* All the loops that use CHECK_NAME_CASES only advance over the ASCII
+   name characters so they can skip a run of them at once. */
+#ifdef FAST_SCAN
+#define NAME_SCAN(enc, ptr, end) \
+  ptr = FAST_SCAN(enc, ptr, end, XML_SCAN_NAME)
+#else
+#define NAME_SCAN(enc, ptr, end)
+#endif
+
 #define CHECK_NMSTRT_CASE(n, enc, ptr, end, nextTokPtr) \
    case BT_LEAD ## n: \
      if (end - ptr < n) \
@@ -626,6 +636,9 @@ PREFIX(scanAtts)(const ENCODING *enc, const char *ptr, const char *end,
             return XML_TOK_INVALID;
           default:
             ptr += MINBPC(enc);
+#ifdef FAST_SCAN
+            ptr = FAST_SCAN(enc, ptr, end, XML_SCAN_LITERAL);
+#endif
             break;
           }
         }
@@ -877,6 +890,9 @@ PREFIX(contentTok)(const ENCODING *enc, const char *ptr, const char *end,
       return XML_TOK_DATA_CHARS;
     default:
       ptr += MINBPC(enc);
+#ifdef FAST_SCAN
+      ptr = FAST_SCAN(enc, ptr, end, XML_SCAN_DATA);
+#endif
       break;
     }
   }
@@ -1260,6 +1276,9 @@ PREFIX(attributeValueTok)(const ENCODING *enc, const char *ptr,
       return XML_TOK_DATA_CHARS;
     default:
       ptr += MINBPC(enc);
+#ifdef FAST_SCAN
+      ptr = FAST_SCAN(enc, ptr, end, XML_SCAN_VALUE);
+#endif
       break;
     }
   }
@@ -1794,6 +1813,7 @@ PREFIX(updatePosition)(const ENCODING *enc,
 #undef MULTIBYTE_CASES
 #undef INVALID_CASES
 #undef CHECK_NAME_CASE
+#undef NAME_SCAN
 #undef CHECK_NAME_CASES
 #undef CHECK_NMSTRT_CASE
 #undef CHECK_NMSTRT_CASES
@@ -0,0 +1,212 @@
+/* file      : libstudxml/details/expat/xmltok_scan.h
+ * license   : MIT; see accompanying LICENSE file
+ */
+
+/* Vectorized scanning of plain ASCII runs for the single-byte encodings
+ * (see FAST_SCAN in xmltok.c and xmltok_impl.c).
+ *
+ * Each scan function returns the pointer to the first byte in [ptr, end)
+ * that is not "plain" for the corresponding tokenizer loop, that is, one
+ * that the loop may need to look at (a delimiter, a control or non-ASCII
+ * character). Stopping early is always safe since the loop then continues
+ * byte by byte. Only full 16 (32 with AVX2) byte blocks are scanned with
+ * the rest left to the loop.
+ *
+ * The plain bytes are:
+ *
+ * XML_SCAN_DATA    -- character data: 0x20-0x7F and TAB except '<', '&',
+ *                     and ']'.
+ * XML_SCAN_LITERAL -- attribute value literal in the start tag: 0x20-0x7F,
+ *                     TAB, LF, and CR except '<', '&', '"', and '\''.
+ * XML_SCAN_VALUE   -- attribute value normalization: 0x21-0x7F except
+ *                     '<' and '&'.
+ * XML_SCAN_NAME    -- name characters after the first: ASCII letters,
+ *                     digits, '-', '.', and '_' (the colon is handled by
+ *                     the loops separately in the namespace mode).
+ *
+ * Note that this relies on the ASCII part of the encoding's byte type
+ * table being standard which is not the case for unknown encodings.
+ *
+ * SSE2 is used on x86 (it is part of the x86-64 baseline) with AVX2
+ * selected at runtime if supported by the CPU (GCC and Clang only).
+ * Elsewhere the scan functions are no-ops and the tokenizer loops work
+ * one byte at a time.
+ */
+
+#ifndef XMLTOK_SCAN_H
+#define XMLTOK_SCAN_H
+
+#define XML_SCAN_DATA    0
+#define XML_SCAN_LITERAL 1
+#define XML_SCAN_VALUE   2
+#define XML_SCAN_NAME    3
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define XML_SCAN_SSE2 1
+#  include <emmintrin.h>
+#  if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define XML_SCAN_AVX2 1
+#    include <immintrin.h>
+#  endif
+#  ifdef _MSC_VER
+#    include <intrin.h> /* _BitScanForward */
+#  endif
+#endif
+
+#ifdef XML_SCAN_SSE2
+
+struct scan_set {
+  char lo;       /* Bytes below lo (signed, so including non-ASCII) stop. */
+  char ok[3];    /* Except these. */
+  char stop[4];  /* Plus these. */
+};
+
+static const struct scan_set scanSets[3] = {
+  { 0x20, { '\t', 0x20, 0x20 }, { '<', '&', ']', '<' } },
+  { 0x20, { '\t', '\n', '\r' }, { '<', '&', '"', '\'' } },
+  { 0x21, { 0x21, 0x21, 0x21 }, { '<', '&', '<', '<' } }
+};
+
+static int
+scanCtz(unsigned int m)
+{
+#ifdef _MSC_VER
+  unsigned long r;
+  _BitScanForward(&r, m);
+  return (int)r;
+#else
+  return __builtin_ctz(m);
+#endif
+}
+
+static const char *
+scanSSE2(const char *ptr, const char *end, int set)
+{
+  const struct scan_set *s = &scanSets[set];
+  const __m128i lo = _mm_set1_epi8(s->lo);
+  const __m128i o0 = _mm_set1_epi8(s->ok[0]);
+  const __m128i o1 = _mm_set1_epi8(s->ok[1]);
+  const __m128i o2 = _mm_set1_epi8(s->ok[2]);
+  const __m128i s0 = _mm_set1_epi8(s->stop[0]);
+  const __m128i s1 = _mm_set1_epi8(s->stop[1]);
+  const __m128i s2 = _mm_set1_epi8(s->stop[2]);
+  const __m128i s3 = _mm_set1_epi8(s->stop[3]);
+
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i ok = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, o0),
+                                           _mm_cmpeq_epi8(v, o1)),
+                              _mm_cmpeq_epi8(v, o2));
+    __m128i st = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, s0),
+                                           _mm_cmpeq_epi8(v, s1)),
+                              _mm_or_si128(_mm_cmpeq_epi8(v, s2),
+                                           _mm_cmpeq_epi8(v, s3)));
+    int m;
+    st = _mm_or_si128(st, _mm_andnot_si128(ok, _mm_cmplt_epi8(v, lo)));
+    m = _mm_movemask_epi8(st);
+    if (m != 0)
+      return ptr + scanCtz((unsigned int)m);
+    ptr += 16;
+  }
+  return ptr;
+}
+
+/* The name set is ranges rather than individual bytes so it is matched
+   separately. Note that the comparisons are signed so non-ASCII bytes are
+   below all the ranges. */
+static const char *
+scanNameSSE2(const char *ptr, const char *end)
+{
+  const __m128i lc = _mm_set1_epi8(0x20);
+  const __m128i a = _mm_set1_epi8('a' - 1);
+  const __m128i z = _mm_set1_epi8('z' + 1);
+  const __m128i minus = _mm_set1_epi8('-' - 1);
+  const __m128i nine = _mm_set1_epi8('9' + 1);
+  const __m128i sol = _mm_set1_epi8('/');
+  const __m128i lowbar = _mm_set1_epi8('_');
+
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i l = _mm_or_si128(v, lc); /* Fold the case. */
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(l, a), _mm_cmplt_epi8(l, z));
+    __m128i d = _mm_and_si128(_mm_cmpgt_epi8(v, minus),
+                              _mm_cmplt_epi8(v, nine)); /* '-' to '9' */
+    int m;
+    ok = _mm_or_si128(ok, _mm_andnot_si128(_mm_cmpeq_epi8(v, sol), d));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, lowbar));
+    m = _mm_movemask_epi8(ok) ^ 0xFFFF;
+    if (m != 0)
+      return ptr + scanCtz((unsigned int)m);
+    ptr += 16;
+  }
+  return ptr;
+}
+
+#ifdef XML_SCAN_AVX2
+
+__attribute__((target("avx2")))
+static const char *
+scanAVX2(const char *ptr, const char *end, int set)
+{
+  const struct scan_set *s = &scanSets[set];
+  const __m256i lo = _mm256_set1_epi8(s->lo);
+  const __m256i o0 = _mm256_set1_epi8(s->ok[0]);
+  const __m256i o1 = _mm256_set1_epi8(s->ok[1]);
+  const __m256i o2 = _mm256_set1_epi8(s->ok[2]);
+  const __m256i s0 = _mm256_set1_epi8(s->stop[0]);
+  const __m256i s1 = _mm256_set1_epi8(s->stop[1]);
+  const __m256i s2 = _mm256_set1_epi8(s->stop[2]);
+  const __m256i s3 = _mm256_set1_epi8(s->stop[3]);
+
+  while (end - ptr >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    __m256i ok = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, o0),
+                                                 _mm256_cmpeq_epi8(v, o1)),
+                                 _mm256_cmpeq_epi8(v, o2));
+    __m256i st = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, s0), _mm256_cmpeq_epi8(v, s1)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, s2), _mm256_cmpeq_epi8(v, s3)));
+    int m;
+    st = _mm256_or_si256(st,
+                         _mm256_andnot_si256(ok, _mm256_cmpgt_epi8(lo, v)));
+    m = _mm256_movemask_epi8(st);
+    if (m != 0)
+      return ptr + scanCtz((unsigned int)m);
+    ptr += 32;
+  }
+  /* Finish with SSE2 (at most one block). */
+  return scanSSE2(ptr, end, set);
+}
+
+#endif /* XML_SCAN_AVX2 */
+
+static const char *
+scanRun(const char *ptr, const char *end, int set)
+{
+  /* Names are short, so one block is normally all it takes. */
+  if (set == XML_SCAN_NAME)
+    return scanNameSSE2(ptr, end);
+
+  /* Most runs are short (a word or two between markup), so don't bother
+     with AVX2 unless there is enough data for it. */
+#ifdef XML_SCAN_AVX2
+  if (end - ptr >= 64 && __builtin_cpu_supports("avx2"))
+    return scanAVX2(ptr, end, set);
+#endif
+  return scanSSE2(ptr, end, set);
+}
+
+#else /* !XML_SCAN_SSE2 */
+
+static const char *
+scanRun(const char *ptr, const char *end, int set)
+{
+  UNUSED(end);
+  UNUSED(set);
+  return ptr;
+}
+
+#endif /* XML_SCAN_SSE2 */
+
+#endif /* XMLTOK_SCAN_H */
@@ -54,6 +54,25 @@ typedef struct
   void * *   pointers;
 } plist;
 
+/*******************************
+ * pointer hash table (open addressing with linear probing) used to index
+ *  the declared namespaces, elements, attributes, and prefixes. The table
+ *  does not own the pointers (they are in the corresponding plist).
+ */
+typedef struct
+{
+  size_t hash;
+  void * pointer;
+} hslot;
+
+typedef struct
+{
+  genxWriter writer;
+  size_t     count;
+  size_t     mask;  /* Table size (a power of 2) minus 1. */
+  hslot *    slots;
+} phash;
+
 /*******************************
  * text collector, for attribute values
  */
@@ -133,6 +152,10 @@ struct genxWriter_rec
   plist           	   attributes;
   plist                    prefixes;
   plist           	   stack;
+  phash                    namespaceIndex;
+  phash                    elementIndex;
+  phash                    attributeIndex;
+  phash                    prefixIndex;
   struct genxAttribute_rec arec;       /* Dummy attribute used for lookup. */
   char *                   etext[100];
   genxAlloc                alloc;
@@ -312,13 +335,12 @@ static genxStatus listAppend(plist * pl, void * pointer)
  */
 static genxStatus listInsert(plist * pl, void * pointer, size_t at)
 {
-  size_t i;
-
   if (!checkExpand(pl))
     return GENX_ALLOC_FAILED;
 
-  for (i = pl->count; i > at; i--)
-    pl->pointers[i] = pl->pointers[i - 1];
+  memmove(pl->pointers + at + 1,
+	  pl->pointers + at,
+	  (pl->count - at) * sizeof(void *));
   pl->count++;
 
   pl->pointers[at] = pointer;
@@ -326,41 +348,163 @@ static genxStatus listInsert(plist * pl, void * pointer, size_t at)
 }
 
 /*******************************
- * list lookups
+ * private hash table utilities
  */
+static genxStatus initHash(genxWriter w, phash * h)
+{
+  size_t i, n = 16;
 
-static genxNamespace findNamespace(plist * pl, constUtf8 uri)
+  h->writer = w;
+  h->count = 0;
+  h->mask = n - 1;
+  h->slots = (hslot *) allocate(w, n * sizeof(hslot));
+  if (h->slots == NULL)
+    return GENX_ALLOC_FAILED;
+
+  for (i = 0; i < n; i++)
+    h->slots[i].pointer = NULL;
+
+  return GENX_SUCCESS;
+}
+
+/*
+ * FNV-1a hash of a string combined with a seed (the namespace pointer for
+ *  elements and attributes).
+ */
+static size_t hashString(constUtf8 s, const void * seed)
 {
-  size_t i;
-  genxNamespace * nn = (genxNamespace *) pl->pointers;
+  size_t h = (size_t) 2166136261U ^ ((size_t) seed >> 3);
 
-  for (i = 0; i < pl->count; i++)
-    if (strcmp((char *) uri, (const char *) nn[i]->name) == 0)
-      return nn[i];
+  for (; *s != 0; s++)
+  {
+    h ^= *s;
+    h *= (size_t) 16777619U;
+  }
 
-  return NULL;
+  return h;
 }
 
-static genxElement findElement(plist * pl, constUtf8 xmlns, constUtf8 name)
+/*
+ * add a pointer that is known not to be in the table yet, growing it to
+ *  keep the load factor under 1/2
+ */
+static genxStatus hashInsert(phash * h, size_t hv, void * pointer)
 {
   size_t i;
-  genxElement * ee = (genxElement *) pl->pointers;
 
-  for (i = 0; i < pl->count; i++)
+  if ((h->count + 1) * 2 > h->mask + 1)
   {
-    if (xmlns == NULL)
-    {
-      if (ee[i]->ns == NULL && strcmp((const char *) name,
-				      (const char *) ee[i]->name) == 0)
-	return ee[i];
-    }
-    else
+    size_t n = (h->mask + 1) * 2;
+    hslot * slots = (hslot *) allocate(h->writer, n * sizeof(hslot));
+
+    if (slots == NULL)
+      return GENX_ALLOC_FAILED;
+
+    for (i = 0; i < n; i++)
+      slots[i].pointer = NULL;
+
+    for (i = 0; i <= h->mask; i++)
     {
-      if (ee[i]->ns != NULL &&
-	  strcmp((const char *) xmlns, (const char *) ee[i]->ns->name) == 0 &&
-	  strcmp((const char *) name, (const char *) ee[i]->name) == 0)
-	return ee[i];
+      if (h->slots[i].pointer != NULL)
+      {
+	size_t j = h->slots[i].hash & (n - 1);
+
+	while (slots[j].pointer != NULL)
+	  j = (j + 1) & (n - 1);
+
+	slots[j] = h->slots[i];
+      }
     }
+
+    deallocate(h->writer, h->slots);
+    h->slots = slots;
+    h->mask = n - 1;
+  }
+
+  for (i = hv & h->mask; h->slots[i].pointer != NULL; i = (i + 1) & h->mask)
+    ;
+
+  h->slots[i].hash = hv;
+  h->slots[i].pointer = pointer;
+  h->count++;
+  return GENX_SUCCESS;
+}
+
+/*******************************
+ * lookups
+ */
+
+static genxNamespace findNamespace(genxWriter w, constUtf8 uri, size_t hv)
+{
+  phash * h = &w->namespaceIndex;
+  size_t i;
+
+  for (i = hv & h->mask; h->slots[i].pointer != NULL; i = (i + 1) & h->mask)
+  {
+    genxNamespace ns = (genxNamespace) h->slots[i].pointer;
+
+    if (h->slots[i].hash == hv &&
+	strcmp((const char *) uri, (const char *) ns->name) == 0)
+      return ns;
+  }
+
+  return NULL;
+}
+
+/*
+ * Note that namespaces are unique per URI so elements and attributes can
+ *  be looked up by the namespace pointer.
+ */
+static genxElement findElement(genxWriter w, genxNamespace ns,
+			       constUtf8 name, size_t hv)
+{
+  phash * h = &w->elementIndex;
+  size_t i;
+
+  for (i = hv & h->mask; h->slots[i].pointer != NULL; i = (i + 1) & h->mask)
+  {
+    genxElement e = (genxElement) h->slots[i].pointer;
+
+    if (h->slots[i].hash == hv &&
+	e->ns == ns &&
+	strcmp((const char *) name, (const char *) e->name) == 0)
+      return e;
+  }
+
+  return NULL;
+}
+
+static genxAttribute findAttribute(genxWriter w, genxNamespace ns,
+				   constUtf8 name, size_t hv)
+{
+  phash * h = &w->attributeIndex;
+  size_t i;
+
+  for (i = hv & h->mask; h->slots[i].pointer != NULL; i = (i + 1) & h->mask)
+  {
+    genxAttribute a = (genxAttribute) h->slots[i].pointer;
+
+    if (h->slots[i].hash == hv &&
+	a->ns == ns &&
+	strcmp((const char *) name, (const char *) a->name) == 0)
+      return a;
+  }
+
+  return NULL;
+}
+
+static utf8 findPrefix(genxWriter w, constUtf8 prefix, size_t hv)
+{
+  phash * h = &w->prefixIndex;
+  size_t i;
+
+  for (i = hv & h->mask; h->slots[i].pointer != NULL; i = (i + 1) & h->mask)
+  {
+    utf8 p = (utf8) h->slots[i].pointer;
+
+    if (h->slots[i].hash == hv &&
+	strcmp((const char *) prefix, (const char *) p) == 0)
+      return p;
   }
 
   return NULL;
@@ -373,8 +517,8 @@ static genxElement findElement(plist * pl, constUtf8 xmlns, constUtf8 name)
  */
 static utf8 storePrefix(genxWriter w, constUtf8 prefix, Boolean force)
 {
-  int high, low;
-  utf8 * pp = (utf8 *) w->prefixes.pointers;
+  size_t hv;
+  utf8 p;
   unsigned char buf[1024];
 
   if (prefix[0] == 0)
@@ -396,39 +540,35 @@ static utf8 storePrefix(genxWriter w, constUtf8 prefix, Boolean force)
     prefix = buf;
   }
 
-  high = (int) w->prefixes.count;
-  low = -1;
-  while (high - low > 1)
-  {
-    int probe = (high + low) / 2;
-    if (strcmp((const char *) prefix, (const char *) pp[probe]) < 0)
-      high = probe;
-    else
-      low = probe;
-  }
+  hv = hashString(prefix, NULL);
 
   /* already there? */
-  if (low != -1 && strcmp((const char *) prefix, (const char *) pp[low]) == 0)
+  if ((p = findPrefix(w, prefix, hv)) != NULL)
   {
     if (force)
-      return pp[low];
+      return p;
 
     w->status = GENX_DUPLICATE_PREFIX;
     return NULL;
   }
 
   /* copy & insert */
-  if ((prefix = copy(w, prefix)) == NULL)
+  if ((p = copy(w, prefix)) == NULL)
   {
     w->status = GENX_ALLOC_FAILED;
     return NULL;
   }
 
-  w->status = listInsert(&w->prefixes, (void *) prefix, (size_t) high);
-  if (w->status != GENX_SUCCESS)
+  if ((w->status = listAppend(&w->prefixes, p)) != GENX_SUCCESS)
+  {
+    deallocate(w, p);
+    return NULL;
+  }
+
+  if ((w->status = hashInsert(&w->prefixIndex, hv, p)) != GENX_SUCCESS)
     return NULL;
 
-  return (utf8) prefix;
+  return p;
 }
 
 /*******************************
@@ -529,6 +669,8 @@ malformed:
   return -1;
 }
 
+#include <libstudxml/details/genx/text-scan.h>
+
 static Boolean isXMLChar(genxWriter w, int c)
 {
   if (c < 0)
@@ -601,7 +743,11 @@ genxWriter genxNew(genxAlloc alloc, genxDealloc dealloc, void * userData)
       initPlist(w, &w->elements) != GENX_SUCCESS ||
       initPlist(w, &w->attributes) != GENX_SUCCESS ||
       initPlist(w, &w->prefixes) != GENX_SUCCESS ||
-      initPlist(w, &w->stack) != GENX_SUCCESS)
+      initPlist(w, &w->stack) != GENX_SUCCESS ||
+      initHash(w, &w->namespaceIndex) != GENX_SUCCESS ||
+      initHash(w, &w->elementIndex) != GENX_SUCCESS ||
+      initHash(w, &w->attributeIndex) != GENX_SUCCESS ||
+      initHash(w, &w->prefixIndex) != GENX_SUCCESS)
     return NULL;
 
   if ((w->status = initCollector(w, &w->arec.value)) != GENX_SUCCESS)
@@ -868,6 +1014,11 @@ void genxDispose(genxWriter w)
   deallocate(w, w->prefixes.pointers);
   deallocate(w, w->stack.pointers);
 
+  deallocate(w, w->namespaceIndex.slots);
+  deallocate(w, w->elementIndex.slots);
+  deallocate(w, w->attributeIndex.slots);
+  deallocate(w, w->prefixIndex.slots);
+
   deallocate(w, w->arec.value.buf);
 
   deallocate(w, w->empty);
@@ -990,6 +1141,7 @@ genxNamespace genxDeclareNamespace(genxWriter w, constUtf8 uri,
   genxNamespace ns;
   genxAttribute defaultDecl;
   unsigned char newPrefix[100];
+  size_t hv;
 
   if (uri == NULL || uri[0] == 0)
   {
@@ -997,16 +1149,14 @@ genxNamespace genxDeclareNamespace(genxWriter w, constUtf8 uri,
     goto busted;
   }
 
-  if ((w->status = genxCheckText(w, uri)) != GENX_SUCCESS)
-    goto busted;
-
   /* if a prefix is provided, it has to be an NCname */
   if (defaultPref != NULL && defaultPref[0] != 0 &&
       (w->status = checkNCName(w, defaultPref)) != GENX_SUCCESS)
     goto busted;
 
-  /* previously declared? */
-  if ((ns = findNamespace(&w->namespaces, uri)))
+  /* previously declared? (in which case the URI has been checked) */
+  hv = hashString(uri, NULL);
+  if ((ns = findNamespace(w, uri, hv)))
   {
     /* just a lookup, really */
     if ((defaultPref == NULL) ||
@@ -1022,6 +1172,9 @@ genxNamespace genxDeclareNamespace(genxWriter w, constUtf8 uri,
   /* wasn't already declared */
   else
   {
+    if ((w->status = genxCheckText(w, uri)) != GENX_SUCCESS)
+      goto busted;
+
     /* make a default prefix if none provided */
     if (defaultPref == NULL)
     {
@@ -1050,6 +1203,8 @@ genxNamespace genxDeclareNamespace(genxWriter w, constUtf8 uri,
 
     if ((w->status = listAppend(&w->namespaces, ns)) != GENX_SUCCESS)
       goto busted;
+    if ((w->status = hashInsert(&w->namespaceIndex, hv, ns)) != GENX_SUCCESS)
+      goto busted;
     ns->defaultDecl = ns->declaration = NULL;
     ns->declCount = 0;
   }
@@ -1113,6 +1268,14 @@ genxElement genxDeclareElement(genxWriter w,
 {
   genxElement old;
   genxElement el;
+  size_t hv = hashString(name, ns);
+
+  /* already declared? (in which case the name has been checked) */
+  if ((old = findElement(w, ns, name, hv)))
+  {
+    w->status = *statusP = GENX_SUCCESS;
+    return old;
+  }
 
   if ((w->status = checkNCName(w, name)) != GENX_SUCCESS)
   {
@@ -1120,11 +1283,6 @@ genxElement genxDeclareElement(genxWriter w,
     return NULL;
   }
 
-  /* already declared? */
-  old = findElement(&w->elements, (ns == NULL) ? NULL : ns->name, name);
-  if (old)
-    return old;
-
   if ((el = (genxElement) allocate(w, sizeof(struct genxElement_rec))) == NULL)
   {
     w->status = *statusP = GENX_ALLOC_FAILED;
@@ -1139,7 +1297,8 @@ genxElement genxDeclareElement(genxWriter w,
     return NULL;
   }
 
-  if ((w->status = listAppend(&w->elements, el)) != GENX_SUCCESS)
+  if ((w->status = listAppend(&w->elements, el)) != GENX_SUCCESS ||
+      (w->status = hashInsert(&w->elementIndex, hv, el)) != GENX_SUCCESS)
   {
     *statusP = w->status;
     return NULL;
@@ -1191,6 +1350,7 @@ static genxAttribute declareAttribute(genxWriter w, genxNamespace ns,
   int high, low;
   genxAttribute * aa = (genxAttribute *) w->attributes.pointers;
   genxAttribute a;
+  size_t hv = hashString(name, ns);
 
   w->arec.ns = ns;
   w->arec.name = (utf8) name;
@@ -1208,7 +1368,15 @@ static genxAttribute declareAttribute(genxWriter w, genxNamespace ns,
     goto busted;
   }
 
-  /* attribute list has to be kept sorted per c14n rules */
+  /* already declared? */
+  if ((a = findAttribute(w, ns, name, hv)))
+  {
+    *statusP = GENX_SUCCESS;
+    return a;
+  }
+
+  /* attribute list has to be kept sorted per c14n rules (no need to check
+     for the exact match, see above) */
   high = (int) w->attributes.count;
   low = -1;
   while (high - low > 1)
@@ -1220,10 +1388,6 @@ static genxAttribute declareAttribute(genxWriter w, genxNamespace ns,
       low = probe;
   }
 
-  /* if it was already there */
-  if (low != -1 && orderAttributes(&w->arec, aa[low]) == 0)
-    return aa[low];
-
   /* not there, build it */
   a = (genxAttribute) allocate(w, sizeof(struct genxAttribute_rec));
   if (a == NULL)
@@ -1255,6 +1419,9 @@ static genxAttribute declareAttribute(genxWriter w, genxNamespace ns,
   if (w->status != GENX_SUCCESS)
     goto busted;
 
+  if ((w->status = hashInsert(&w->attributeIndex, hv, a)) != GENX_SUCCESS)
+    goto busted;
+
   *statusP = GENX_SUCCESS;
   return a;
 
@@ -1270,6 +1437,17 @@ genxAttribute genxDeclareAttribute(genxWriter w,
 				   genxNamespace ns, constUtf8 name,
 				   genxStatus * statusP)
 {
+  genxAttribute a = findAttribute(w, ns, name, hashString(name, ns));
+
+  /* already declared? (in which case the name has been checked unless it
+     is one of the internal namespace declaration attributes) */
+  if (a != NULL && a->atype != ATTR_NSDECL &&
+      (ns == NULL || ns->defaultDecl != w->xmlnsEquals))
+  {
+    w->status = *statusP = GENX_SUCCESS;
+    return a;
+  }
+
   if ((w->status = checkNCName(w, name)) != GENX_SUCCESS)
   {
     *statusP = w->status;
@@ -1706,11 +1884,26 @@ static genxStatus collectAttributeValue (genxWriter w, collector* value,
   /* If end is NULL then the length of the value is unknown and
      the value is 0-terminated. */
 
-  utf8 last = (utf8) start;
+  utf8 last;
+
+  if (end == NULL)
+    end = start + strlen((const char *) start);
 
-  while (end != NULL ? start < end : *start)
+  while (start < end)
   {
-    int c = genxNextUnicodeChar(&start);
+    int c;
+
+    /* Collect the run of characters that don't need escaping at once. */
+    last = (utf8) scanPlainText(start, end, True);
+    if (last != start)
+    {
+      collectPiece(w, value, (const char *) start, last - start);
+      start = last;
+      if (start == end)
+        break;
+    }
+
+    c = genxNextUnicodeChar(&start);
 
     if (c == -1)
       return w->status = GENX_BAD_UTF8;
@@ -2097,9 +2290,18 @@ genxStatus genxAddText(genxWriter w, constUtf8 start)
 
   if (w->sequence == SEQUENCE_CONTENT)
   {
-    while (*start)
+    constUtf8 end = start + strlen((const char *) start);
+
+    while (start < end)
     {
-      int c = genxNextUnicodeChar(&start);
+      int c;
+
+      /* Skip the run of characters that don't need escaping. */
+      start = lasts = scanPlainText(start, end, False);
+      if (start == end)
+        break;
+
+      c = genxNextUnicodeChar(&start);
 
       w->status = addChar(w, c, start, &lasts, &breaker);
       if (w->status != GENX_SUCCESS)
@@ -2132,7 +2334,14 @@ genxStatus genxAddBoundedText(genxWriter w, constUtf8 start, constUtf8 end)
   {
     while (start < end)
     {
-      int c = genxNextUnicodeChar(&start);
+      int c;
+
+      /* Skip the run of characters that don't need escaping. */
+      start = lasts = scanPlainText(start, end, False);
+      if (start == end)
+        break;
+
+      c = genxNextUnicodeChar(&start);
 
       w->status = addChar(w, c, (utf8) start, &lasts, &breaker);
       if (w->status != GENX_SUCCESS)
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) Code Synthesis Tools CC (see the LICENSE file).
+ *
+ * For copying permission, see the accompanying LICENSE file.
+ */
+
+/*
+ * Scanning of text (element content and attribute values) for runs that
+ *  can be written as is, that is, valid UTF-8 without characters that
+ *  need escaping or checking. This file is included into genx.c.
+ *
+ * scanPlainText() returns the pointer to the first character in
+ *  [s, end) that is not plain (or end). The returned pointer is always
+ *  at a character boundary and the caller handles the character at it
+ *  one at a time. The plain characters are:
+ *
+ *  content   -- 0x20-0x7F, TAB, and LF except '<', '&', and '>'.
+ *  attribute -- 0x20-0x7F except '"', '<', and '&'.
+ *
+ *  Plus, if UTF-8 validation is available, all the non-ASCII characters
+ *  (all of them are XML characters unless GENX_CHAR_TABLE_SIZE is
+ *  0x10000, in which case UTF-8 validation is disabled).
+ *
+ * On x86 the text is scanned 16 bytes at a time with SSE2. If supported
+ *  by the CPU (checked at runtime, GCC and Clang only), SSSE3 is used to
+ *  also validate UTF-8 using the lookup algorithm from "Validating UTF-8
+ *  In Less Than One Instruction Per Byte" by John Keiser and Daniel
+ *  Lemire. The rest is scanned one byte at a time (ASCII only).
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define GENX_SCAN_SSE2 1
+#  include <emmintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h> /* _BitScanForward */
+#  endif
+#  if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+  GENX_CHAR_TABLE_SIZE != 0x10000
+#    define GENX_SCAN_UTF8 1
+#    include <tmmintrin.h>
+#  endif
+#endif
+
+static int isPlainAscii(unsigned int c, int attr)
+{
+  if (c >= 0x20)
+    return c < 0x80 && c != '<' && c != '&' && c != (attr ? '"' : '>');
+  else
+    return !attr && (c == 0x9 || c == 0xa);
+}
+
+#ifdef GENX_SCAN_SSE2
+
+static int scanCtz(unsigned int m)
+{
+#ifdef _MSC_VER
+  unsigned long r;
+  _BitScanForward(&r, m);
+  return (int) r;
+#else
+  return __builtin_ctz(m);
+#endif
+}
+
+/*
+ * Return the mask of ASCII bytes in the block that are not plain.
+ */
+static int asciiStopMask(__m128i v, int attr)
+{
+  __m128i ctrl = _mm_andnot_si128(_mm_cmplt_epi8(v, _mm_setzero_si128()),
+				  _mm_cmplt_epi8(v, _mm_set1_epi8(0x20)));
+  __m128i st = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')),
+			    _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+
+  if (attr)
+    st = _mm_or_si128(st, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+  else
+  {
+    st = _mm_or_si128(st, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    ctrl = _mm_andnot_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x9)),
+		   _mm_cmpeq_epi8(v, _mm_set1_epi8(0xa))),
+      ctrl);
+  }
+
+  return _mm_movemask_epi8(_mm_or_si128(st, ctrl));
+}
+
+static constUtf8 scanSSE2(constUtf8 s, constUtf8 end, int attr)
+{
+  while (end - s >= 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *) s);
+    int m = asciiStopMask(v, attr) | _mm_movemask_epi8(v);
+
+    if (m != 0)
+      return s + scanCtz((unsigned int) m);
+
+    s += 16;
+  }
+
+  return s;
+}
+
+#ifdef GENX_SCAN_UTF8
+
+#define U8_TOO_SHORT      (1 << 0)
+#define U8_TOO_LONG       (1 << 1)
+#define U8_OVERLONG_3     (1 << 2)
+#define U8_TOO_LARGE      (1 << 3)
+#define U8_SURROGATE      (1 << 4)
+#define U8_OVERLONG_2     (1 << 5)
+#define U8_TOO_LARGE_1000 (1 << 6)
+#define U8_OVERLONG_4     (1 << 6)
+#define U8_TWO_CONTS      (1 << 7)
+#define U8_CARRY          (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+/*
+ * Return non-zero bytes if the block (with the previous block providing
+ *  the context) contains invalid UTF-8, not counting an incomplete
+ *  character at the end.
+ */
+__attribute__((target("ssse3")))
+static __m128i utf8Error(__m128i v, __m128i prev)
+{
+  const __m128i byte1High = _mm_setr_epi8(
+    U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+    U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+    U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+    U8_TOO_SHORT | U8_OVERLONG_2,
+    U8_TOO_SHORT,
+    U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+    U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4);
+
+  const __m128i byte1Low = _mm_setr_epi8(
+    U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+    U8_CARRY | U8_OVERLONG_2,
+    U8_CARRY,
+    U8_CARRY,
+    U8_CARRY | U8_TOO_LARGE,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000);
+
+  const __m128i byte2High = _mm_setr_epi8(
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 |
+    U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 |
+    U8_TOO_LARGE,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE |
+    U8_TOO_LARGE,
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE |
+    U8_TOO_LARGE,
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT);
+
+  const __m128i low4 = _mm_set1_epi8(0x0f);
+
+  __m128i prev1 = _mm_alignr_epi8(v, prev, 16 - 1);
+  __m128i prev2 = _mm_alignr_epi8(v, prev, 16 - 2);
+  __m128i prev3 = _mm_alignr_epi8(v, prev, 16 - 3);
+
+  /* Errors in the two-byte sequences. */
+  __m128i sc = _mm_and_si128(
+    _mm_and_si128(
+      _mm_shuffle_epi8(byte1High,
+		       _mm_and_si128(_mm_srli_epi16(prev1, 4), low4)),
+      _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, low4))),
+    _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(v, 4), low4)));
+
+  /* Continuations required by the three and four-byte leads (only
+     111_____ and 1111____ end up with the high bit set). */
+  __m128i must23 = _mm_or_si128(
+    _mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xe0 - 0x80))),
+    _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xf0 - 0x80))));
+
+  return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char) 0x80)),
+		       sc);
+}
+
+__attribute__((target("ssse3")))
+static constUtf8 scanSSSE3(constUtf8 s, constUtf8 end, int attr)
+{
+  constUtf8 b = s;
+  __m128i prev = _mm_setzero_si128();
+  int prevAscii = 1;
+  int i;
+
+  while (end - s >= 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *) s);
+    int st = asciiStopMask(v, attr);
+    int na = _mm_movemask_epi8(v);
+
+    if (na == 0 && prevAscii)
+    {
+      if (st != 0)
+	return s + scanCtz((unsigned int) st);
+    }
+    else
+    {
+      __m128i e = utf8Error(v, prev);
+      int ok = _mm_movemask_epi8(_mm_cmpeq_epi8(e, _mm_setzero_si128()));
+
+      if (st != 0 || ok != 0xffff)
+	break;
+    }
+
+    prev = v;
+    prevAscii = (na == 0);
+    s += 16;
+  }
+
+  /*
+   * The last character of the scanned blocks may be incomplete, in which
+   *  case back up to its beginning.
+   */
+  for (i = 1; i <= 3 && i <= s - b; i++)
+  {
+    unsigned int c = s[-i];
+
+    if ((c & 0xc0) != 0x80)
+    {
+      if ((c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1) > i)
+	s -= i;
+      break;
+    }
+  }
+
+  return s;
+}
+
+#endif /* GENX_SCAN_UTF8 */
+#endif /* GENX_SCAN_SSE2 */
+
+static constUtf8 scanPlainText(constUtf8 s, constUtf8 end, int attr)
+{
+#if defined(GENX_SCAN_UTF8)
+  if (end - s >= 16)
+    s = __builtin_cpu_supports("ssse3")
+      ? scanSSSE3(s, end, attr)
+      : scanSSE2(s, end, attr);
+#elif defined(GENX_SCAN_SSE2)
+  if (end - s >= 16)
+    s = scanSSE2(s, end, attr);
+#endif
+
+  while (s < end && isPlainAscii(*s, attr))
+    s++;
+
+  return s;
+}
@@ -11,8 +11,16 @@
 namespace xml
 {
   class qname;
+  class allocator;
+  class name_table;
   class parser;
+  class parser_pool;
+  class path_engine;
+  class input_source;
+  class output_sink;
   class serializer;
+  class record_index;
+  class record_parser;
   class exception;
 }
 
@@ -0,0 +1,65 @@
+// file      : libstudxml/input-source.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef _WIN32
+#  include <unistd.h> // read()
+#else
+#  include <io.h>     // _read()
+#endif
+
+#include <errno.h>
+
+#include <climits>      // INT_MAX
+#include <system_error>
+
+#include <libstudxml/input-source.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  // input_source
+  //
+  input_source::
+  ~input_source ()
+  {
+  }
+
+  // fd_input_source
+  //
+  size_t fd_input_source::
+  read (void* buf, size_t max)
+  {
+    for (;;)
+    {
+#ifndef _WIN32
+      ssize_t r (::read (fd_, buf, max));
+#else
+      int r (_read (fd_,
+                    buf,
+                    static_cast<unsigned int> (max < INT_MAX ? max : INT_MAX)));
+#endif
+      if (r != -1)
+        return static_cast<size_t> (r);
+
+      if (errno != EINTR)
+        throw system_error (errno, generic_category (), "unable to read");
+    }
+  }
+
+  // file_input_source
+  //
+  size_t file_input_source::
+  read (void* buf, size_t max)
+  {
+    // Note that fread() blocks until max bytes have been read or the end
+    // of file is reached.
+    //
+    size_t r (fread (buf, 1, max, file_));
+
+    if (r == 0 && ferror (file_))
+      throw system_error (errno, generic_category (), "unable to read");
+
+    return r;
+  }
+}
@@ -0,0 +1,101 @@
+// file      : libstudxml/input-source.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_INPUT_SOURCE_HXX
+#define LIBSTUDXML_INPUT_SOURCE_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <cstdio>     // std::FILE
+#include <cstddef>    // std::size_t
+#include <utility>    // std::move
+#include <functional>
+
+#include <libstudxml/forward.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Source of the input data for the parser that can be used instead of
+  // std::istream in order to avoid the iostream overhead. The parser reads
+  // the data in chunks (see parser::chunk_size()) directly into the Expat
+  // buffer.
+  //
+  class LIBSTUDXML_EXPORT input_source
+  {
+  public:
+    virtual
+    ~input_source ();
+
+    // Read up to max bytes into the buffer and return the number of bytes
+    // read. Return 0 only at the end of input. Note that returning less
+    // than max bytes (for example, whatever is currently available in a
+    // pipe or socket) is not an indication of the end of input. Report
+    // errors by throwing exceptions (which are propagated to the caller of
+    // the parser function).
+    //
+    virtual std::size_t
+    read (void* buf, std::size_t max) = 0;
+  };
+
+  // Read from a file descriptor with read(2) (_read() on Windows). The
+  // descriptor is not closed. Errors are reported by throwing
+  // std::system_error.
+  //
+  class LIBSTUDXML_EXPORT fd_input_source: public input_source
+  {
+  public:
+    explicit
+    fd_input_source (int fd): fd_ (fd) {}
+
+    virtual std::size_t
+    read (void*, std::size_t);
+
+    int
+    fd () const {return fd_;}
+
+  private:
+    int fd_;
+  };
+
+  // Read from a C stream with fread(). The stream is not closed. Errors
+  // are reported by throwing std::system_error.
+  //
+  class LIBSTUDXML_EXPORT file_input_source: public input_source
+  {
+  public:
+    explicit
+    file_input_source (std::FILE* f): file_ (f) {}
+
+    virtual std::size_t
+    read (void*, std::size_t);
+
+    std::FILE*
+    file () const {return file_;}
+
+  private:
+    std::FILE* file_;
+  };
+
+  // Read by calling a function object that has the read() semantics.
+  //
+  class LIBSTUDXML_EXPORT callback_input_source: public input_source
+  {
+  public:
+    typedef std::function<std::size_t (void*, std::size_t)> callback_type;
+
+    explicit
+    callback_input_source (callback_type c): callback_ (std::move (c)) {}
+
+    virtual std::size_t
+    read (void* buf, std::size_t max) {return callback_ (buf, max);}
+
+  private:
+    callback_type callback_;
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_INPUT_SOURCE_HXX
@@ -0,0 +1,176 @@
+// file      : libstudxml/mapped-file.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <libstudxml/mapped-file.hxx>
+
+#ifndef _WIN32
+#  include <fcntl.h>    // open()
+#  include <unistd.h>   // close()
+#  include <sys/mman.h> // mmap(), munmap(), madvise()
+#  include <sys/stat.h> // fstat()
+#  include <errno.h>
+#else
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#    undef WIN32_LEAN_AND_MEAN
+#  else
+#    include <windows.h>
+#  endif
+#endif
+
+#include <system_error>
+
+using namespace std;
+
+namespace xml
+{
+#ifndef _WIN32
+  [[noreturn]] static void
+  throw_error (int e, const string& what, const string& path)
+  {
+    throw system_error (e, generic_category (), what + " " + path);
+  }
+
+  mapped_file::
+  mapped_file (const string& path, flags_type f)
+      : data_ (0), size_ (0), path_ (path)
+  {
+    int fd (open (path.c_str (), O_RDONLY));
+    if (fd == -1)
+      throw_error (errno, "unable to open", path);
+
+    struct stat s;
+    if (fstat (fd, &s) == -1)
+    {
+      int e (errno);
+      close (fd);
+      throw_error (e, "unable to stat", path);
+    }
+
+    size_ = static_cast<size_t> (s.st_size);
+
+    // Mapping an empty file is an error.
+    //
+    if (size_ != 0)
+    {
+      void* d (mmap (0, size_, PROT_READ, MAP_PRIVATE, fd, 0));
+
+      if (d == MAP_FAILED)
+      {
+        int e (errno);
+        close (fd);
+        throw_error (e, "unable to map", path);
+      }
+
+      data_ = d;
+
+      // These are only hints so ignore errors.
+      //
+#ifdef MADV_HUGEPAGE
+      if ((f & huge_pages) != 0)
+        madvise (data_, size_, MADV_HUGEPAGE);
+#endif
+
+      if ((f & sequential) != 0)
+      {
+        madvise (data_, size_, MADV_SEQUENTIAL);
+        madvise (data_, size_, MADV_WILLNEED);
+      }
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    //
+    close (fd);
+  }
+
+  mapped_file::
+  ~mapped_file ()
+  {
+    if (data_ != 0)
+      munmap (data_, size_);
+  }
+#else
+  [[noreturn]] static void
+  throw_error (const string& what, const string& path)
+  {
+    throw system_error (static_cast<int> (GetLastError ()),
+                        system_category (),
+                        what + " " + path);
+  }
+
+  mapped_file::
+  mapped_file (const string& path, flags_type f)
+      : data_ (0), size_ (0), path_ (path), file_ (0), mapping_ (0)
+  {
+    HANDLE h (CreateFileA (path.c_str (),
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           0,
+                           OPEN_EXISTING,
+                           ((f & sequential) != 0
+                            ? FILE_FLAG_SEQUENTIAL_SCAN
+                            : FILE_ATTRIBUTE_NORMAL),
+                           0));
+
+    if (h == INVALID_HANDLE_VALUE)
+      throw_error ("unable to open", path);
+
+    LARGE_INTEGER s;
+    if (!GetFileSizeEx (h, &s))
+    {
+      DWORD e (GetLastError ());
+      CloseHandle (h);
+      SetLastError (e);
+      throw_error ("unable to stat", path);
+    }
+
+    size_ = static_cast<size_t> (s.QuadPart);
+
+    // Mapping an empty file is an error. Note also that huge pages are
+    // not supported for file mappings.
+    //
+    if (size_ != 0)
+    {
+      HANDLE m (CreateFileMappingA (h, 0, PAGE_READONLY, 0, 0, 0));
+
+      if (m == 0)
+      {
+        DWORD e (GetLastError ());
+        CloseHandle (h);
+        SetLastError (e);
+        throw_error ("unable to map", path);
+      }
+
+      void* d (MapViewOfFile (m, FILE_MAP_READ, 0, 0, 0));
+
+      if (d == 0)
+      {
+        DWORD e (GetLastError ());
+        CloseHandle (m);
+        CloseHandle (h);
+        SetLastError (e);
+        throw_error ("unable to map", path);
+      }
+
+      data_ = d;
+      mapping_ = m;
+    }
+
+    file_ = h;
+  }
+
+  mapped_file::
+  ~mapped_file ()
+  {
+    if (data_ != 0)
+      UnmapViewOfFile (data_);
+
+    if (mapping_ != 0)
+      CloseHandle (static_cast<HANDLE> (mapping_));
+
+    if (file_ != 0)
+      CloseHandle (static_cast<HANDLE> (file_));
+  }
+#endif
+}
@@ -0,0 +1,79 @@
+// file      : libstudxml/mapped-file.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_MAPPED_FILE_HXX
+#define LIBSTUDXML_MAPPED_FILE_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <string>
+#include <cstddef> // std::size_t
+
+#include <libstudxml/forward.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Read-only memory-mapped file that can be parsed without copying by
+  // passing its data() and size() to the parser's memory buffer
+  // constructor, for example:
+  //
+  // xml::mapped_file f ("input.xml");
+  // xml::parser p (f.data (), f.size (), f.path ());
+  //
+  // The mapping should outlive the parser. Note also that the parser
+  // requires a non-empty buffer.
+  //
+  // Unless disabled, the kernel is advised that the file will be read
+  // sequentially and in its entirety. Huge pages, if requested, are used
+  // where supported and ignored otherwise.
+  //
+  // Errors are reported by throwing std::system_error.
+  //
+  class LIBSTUDXML_EXPORT mapped_file
+  {
+  public:
+    typedef unsigned short flags_type;
+
+    static const flags_type sequential = 0x01; // Sequential access hints.
+    static const flags_type huge_pages = 0x02; // Use huge pages.
+
+    static const flags_type default_flags = sequential;
+
+    explicit
+    mapped_file (const std::string& path, flags_type = default_flags);
+
+    ~mapped_file ();
+
+    const void*
+    data () const {return data_;}
+
+    std::size_t
+    size () const {return size_;}
+
+    bool
+    empty () const {return size_ == 0;}
+
+    const std::string&
+    path () const {return path_;}
+
+  private:
+    mapped_file (const mapped_file&);
+    mapped_file& operator= (const mapped_file&);
+
+  private:
+    void* data_;
+    std::size_t size_;
+    std::string path_;
+
+#ifdef _WIN32
+    void* file_;    // HANDLE
+    void* mapping_; // HANDLE
+#endif
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_MAPPED_FILE_HXX
@@ -0,0 +1,158 @@
+// file      : libstudxml/name-table.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <cstring> // std::memcmp
+
+#include <libstudxml/name-table.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  const name_table::id_type name_table::unknown;
+
+  // FNV-1a.
+  //
+  static inline size_t
+  hash (const char* s, size_t n, size_t h = 2166136261U)
+  {
+    for (size_t i (0); i != n; ++i)
+    {
+      h ^= static_cast<unsigned char> (s[i]);
+      h *= 16777619U;
+    }
+
+    return h;
+  }
+
+  static inline void
+  make_key (const string& ns, const string& name, string& r)
+  {
+    if (!ns.empty ())
+    {
+      r = ns;
+      r += ' ';
+      r += name;
+    }
+    else
+      r = name;
+  }
+
+  name_table::id_type name_table::
+  find (const char* s, size_t n) const
+  {
+    if (buckets_.empty ())
+      return unknown;
+
+    size_t m (buckets_.size () - 1);
+
+    for (size_t i (hash (s, n) & m);; i = (i + 1) & m)
+    {
+      id_type id (buckets_[i]);
+
+      if (id == unknown)
+        return unknown;
+
+      const string& k (keys_[id - 1]);
+
+      if (k.size () == n && memcmp (k.data (), s, n) == 0)
+        return id;
+    }
+  }
+
+  name_table::id_type name_table::
+  find (const string& ns, const string& name) const
+  {
+    if (ns.empty ())
+      return find (name.data (), name.size ());
+
+    if (buckets_.empty ())
+      return unknown;
+
+    // Hash and compare the key components in place rather than building
+    // the key (this is used for every name on the id-based fast paths).
+    //
+    size_t h (hash (ns.data (), ns.size ()));
+    h = hash (" ", 1, h);
+    h = hash (name.data (), name.size (), h);
+
+    size_t n (ns.size () + 1 + name.size ());
+    size_t m (buckets_.size () - 1);
+
+    for (size_t i (h & m);; i = (i + 1) & m)
+    {
+      id_type id (buckets_[i]);
+
+      if (id == unknown)
+        return unknown;
+
+      const string& k (keys_[id - 1]);
+
+      if (k.size () == n &&
+          k[ns.size ()] == ' ' &&
+          memcmp (k.data (), ns.data (), ns.size ()) == 0 &&
+          memcmp (k.data () + ns.size () + 1, name.data (), name.size ()) == 0)
+        return id;
+    }
+  }
+
+  name_table::id_type name_table::
+  find (const qname_type& qn) const
+  {
+    return find (qn.namespace_ (), qn.name ());
+  }
+
+  name_table::id_type name_table::
+  insert (const string& ns, const string& name)
+  {
+    string k;
+    make_key (ns, name, k);
+
+    if (id_type id = find (k.data (), k.size ()))
+      return id;
+
+    // Keep the load factor at or below 0.5.
+    //
+    if ((keys_.size () + 1) * 2 > buckets_.size ())
+    {
+      size_t n (buckets_.empty () ? 64 : buckets_.size () * 2);
+
+      buckets_.assign (n, unknown);
+
+      for (size_t i (0); i != keys_.size (); ++i)
+      {
+        const string& k (keys_[i]);
+
+        size_t j (hash (k.data (), k.size ()) & (n - 1));
+        while (buckets_[j] != unknown)
+          j = (j + 1) & (n - 1);
+
+        buckets_[j] = i + 1;
+      }
+    }
+
+    size_t m (buckets_.size () - 1);
+    size_t j (hash (k.data (), k.size ()) & m);
+    while (buckets_[j] != unknown)
+      j = (j + 1) & m;
+
+    keys_.push_back (k);
+    names_.push_back (qname_type (ns, name));
+
+    id_type id (keys_.size ());
+    buckets_[j] = id;
+    return id;
+  }
+
+  name_table::id_type name_table::
+  insert (const string& name)
+  {
+    return insert (string (), name);
+  }
+
+  name_table::id_type name_table::
+  insert (const qname_type& qn)
+  {
+    return insert (qn.namespace_ (), qn.name ());
+  }
+}
@@ -0,0 +1,88 @@
+// file      : libstudxml/name-table.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_NAME_TABLE_HXX
+#define LIBSTUDXML_NAME_TABLE_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <string>
+#include <vector>
+#include <cstddef> // std::size_t
+
+#include <libstudxml/forward.hxx>
+#include <libstudxml/qname.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Table of qualified names mapped to small integer ids. Ids are assigned
+  // sequentially, starting from 1, in the order of insertion which makes
+  // it possible to pre-register a vocabulary with ids known at compile
+  // time (for example, as enumerators). The 0 id (unknown) is used for
+  // names that are not in the table.
+  //
+  // Once populated, the table can be shared by multiple parsers, including
+  // those running in different threads, provided it is no longer modified.
+  // See parser::names() for details.
+  //
+  class LIBSTUDXML_EXPORT name_table
+  {
+  public:
+    typedef xml::qname qname_type;
+    typedef std::size_t id_type;
+
+    static const id_type unknown = 0;
+
+    // Insert the name returning its id. If the name is already in the
+    // table, then return the existing id. Note that the prefix is ignored.
+    //
+    id_type
+    insert (const qname_type&);
+
+    id_type
+    insert (const std::string& name);
+
+    id_type
+    insert (const std::string& ns, const std::string& name);
+
+    // Return the name id or unknown if the name is not in the table.
+    //
+    id_type
+    find (const qname_type&) const;
+
+    id_type
+    find (const std::string& ns, const std::string& name) const;
+
+    // Find the name in the "[<namespace> ]<name>" form (which is how Expat
+    // returns names when namespace processing is enabled).
+    //
+    id_type
+    find (const char* name, std::size_t size) const;
+
+    // Return the name corresponding to the id. The id should be valid.
+    //
+    const qname_type&
+    name (id_type id) const {return names_[id - 1];}
+
+    std::size_t
+    size () const {return names_.size ();}
+
+    bool
+    empty () const {return names_.empty ();}
+
+  private:
+    // Open-addressing hash table (with linear probing) of indexes into
+    // keys_/names_ plus 1 (0 means empty bucket).
+    //
+    std::vector<id_type> buckets_;
+
+    std::vector<std::string> keys_; // In the "[<namespace> ]<name>" form.
+    std::vector<qname_type> names_;
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_NAME_TABLE_HXX
@@ -0,0 +1,80 @@
+// file      : libstudxml/output-sink.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef _WIN32
+#  include <unistd.h> // write()
+#else
+#  include <io.h>     // _write()
+#endif
+
+#include <errno.h>
+
+#include <climits>      // INT_MAX
+#include <system_error>
+
+#include <libstudxml/output-sink.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  // output_sink
+  //
+  output_sink::
+  ~output_sink ()
+  {
+  }
+
+  void output_sink::
+  flush ()
+  {
+  }
+
+  // fd_output_sink
+  //
+  void fd_output_sink::
+  write (const void* buf, size_t n)
+  {
+    const char* p (static_cast<const char*> (buf));
+
+    // Note that write() may write less than requested (for example, to a
+    // pipe or socket).
+    //
+    while (n != 0)
+    {
+#ifndef _WIN32
+      ssize_t r (::write (fd_, p, n));
+#else
+      int r (_write (fd_,
+                     p,
+                     static_cast<unsigned int> (n < INT_MAX ? n : INT_MAX)));
+#endif
+      if (r == -1)
+      {
+        if (errno == EINTR)
+          continue;
+
+        throw system_error (errno, generic_category (), "unable to write");
+      }
+
+      p += r;
+      n -= static_cast<size_t> (r);
+    }
+  }
+
+  // file_output_sink
+  //
+  void file_output_sink::
+  write (const void* buf, size_t n)
+  {
+    if (fwrite (buf, 1, n, file_) != n)
+      throw system_error (errno, generic_category (), "unable to write");
+  }
+
+  void file_output_sink::
+  flush ()
+  {
+    if (fflush (file_) != 0)
+      throw system_error (errno, generic_category (), "unable to flush");
+  }
+}
@@ -0,0 +1,161 @@
+// file      : libstudxml/output-sink.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_OUTPUT_SINK_HXX
+#define LIBSTUDXML_OUTPUT_SINK_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <cstdio>     // std::FILE
+#include <string>
+#include <vector>
+#include <cstddef>    // std::size_t
+#include <utility>    // std::move
+#include <functional>
+
+#include <libstudxml/forward.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Destination of the serializer output that can be used instead of
+  // std::ostream in order to avoid the iostream overhead. The serializer
+  // accumulates the output in its buffer and writes it to the sink in
+  // blocks (see serializer::buffer_size() and serializer::flush_policy()).
+  //
+  class LIBSTUDXML_EXPORT output_sink
+  {
+  public:
+    virtual
+    ~output_sink ();
+
+    // Write all the data. Report errors by throwing exceptions (which are
+    // propagated to the caller of the serializer function).
+    //
+    virtual void
+    write (const void* data, std::size_t size) = 0;
+
+    // Flush any data buffered by the sink itself. Called at the end of the
+    // document as well as on serializer::flush() and according to the
+    // flush policy. The default implementation does nothing.
+    //
+    virtual void
+    flush ();
+  };
+
+  // Write to a file descriptor with write(2) (_write() on Windows). The
+  // descriptor is not closed. Errors are reported by throwing
+  // std::system_error.
+  //
+  class LIBSTUDXML_EXPORT fd_output_sink: public output_sink
+  {
+  public:
+    explicit
+    fd_output_sink (int fd): fd_ (fd) {}
+
+    virtual void
+    write (const void*, std::size_t);
+
+    int
+    fd () const {return fd_;}
+
+  private:
+    int fd_;
+  };
+
+  // Write to a C stream with fwrite() and flush it with fflush(). The
+  // stream is not closed. Errors are reported by throwing
+  // std::system_error.
+  //
+  class LIBSTUDXML_EXPORT file_output_sink: public output_sink
+  {
+  public:
+    explicit
+    file_output_sink (std::FILE* f): file_ (f) {}
+
+    virtual void
+    write (const void*, std::size_t);
+
+    virtual void
+    flush ();
+
+    std::FILE*
+    file () const {return file_;}
+
+  private:
+    std::FILE* file_;
+  };
+
+  // Append to a string.
+  //
+  class LIBSTUDXML_EXPORT string_output_sink: public output_sink
+  {
+  public:
+    explicit
+    string_output_sink (std::string& s): str_ (s) {}
+
+    virtual void
+    write (const void* d, std::size_t n)
+    {
+      str_.append (static_cast<const char*> (d), n);
+    }
+
+    std::string&
+    str () const {return str_;}
+
+  private:
+    std::string& str_;
+  };
+
+  // Append to a vector of characters.
+  //
+  class LIBSTUDXML_EXPORT vector_output_sink: public output_sink
+  {
+  public:
+    explicit
+    vector_output_sink (std::vector<char>& v): vec_ (v) {}
+
+    virtual void
+    write (const void* d, std::size_t n)
+    {
+      const char* p (static_cast<const char*> (d));
+      vec_.insert (vec_.end (), p, p + n);
+    }
+
+    std::vector<char>&
+    vec () const {return vec_;}
+
+  private:
+    std::vector<char>& vec_;
+  };
+
+  // Write by calling a function object that has the write() semantics.
+  // The flush callback, if specified, is called on flush().
+  //
+  class LIBSTUDXML_EXPORT callback_output_sink: public output_sink
+  {
+  public:
+    typedef std::function<void (const void*, std::size_t)> callback_type;
+    typedef std::function<void ()> flush_callback_type;
+
+    explicit
+    callback_output_sink (callback_type c,
+                          flush_callback_type f = flush_callback_type ())
+        : callback_ (std::move (c)), flush_ (std::move (f)) {}
+
+    virtual void
+    write (const void* d, std::size_t n) {callback_ (d, n);}
+
+    virtual void
+    flush () {if (flush_) flush_ ();}
+
+  private:
+    callback_type callback_;
+    flush_callback_type flush_;
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_OUTPUT_SINK_HXX
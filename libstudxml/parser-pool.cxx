@@ -0,0 +1,209 @@
+// file      : libstudxml/parser-pool.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <new> // std::bad_alloc
+
+#include <libstudxml/parser-pool.hxx>
+#include <libstudxml/record-index.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  // parser_pool::handle
+  //
+  parser_pool::handle& parser_pool::handle::
+  operator= (handle&& h)
+  {
+    if (this != &h)
+    {
+      release ();
+
+      pool_ = h.pool_;
+      p_ = h.p_;
+      record_ = h.record_;
+      h.p_ = 0;
+    }
+
+    return *this;
+  }
+
+  parser_pool::handle::
+  ~handle ()
+  {
+    release ();
+  }
+
+  void parser_pool::handle::
+  release ()
+  {
+    if (p_ != 0)
+    {
+      pool_->release (p_, record_);
+      p_ = 0;
+    }
+  }
+
+  // parser_pool
+  //
+  parser_pool::
+  ~parser_pool ()
+  {
+    clear ();
+  }
+
+  void parser_pool::
+  clear ()
+  {
+    for (parser* p: parsers_)
+      delete p;
+
+    for (record_parser* p: records_)
+      delete p;
+
+    parsers_.clear ();
+    records_.clear ();
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (istream& is, const string& iname, feature_type f)
+  {
+    if (parsers_.empty ())
+      return handle (this, new parser (is, iname, f, alloc_));
+
+    // Reset before taking the parser off the pool in case this throws.
+    //
+    parsers_.back ()->reset (is, iname, f);
+
+    handle r (this, parsers_.back ());
+    parsers_.pop_back ();
+    return r;
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (const void* data, size_t size, const string& iname, feature_type f)
+  {
+    if (parsers_.empty ())
+      return handle (this, new parser (data, size, iname, f, alloc_));
+
+    parsers_.back ()->reset (data, size, iname, f);
+
+    handle r (this, parsers_.back ());
+    parsers_.pop_back ();
+    return r;
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (const parser::segment* segs,
+           size_t n,
+           const string& iname,
+           feature_type f)
+  {
+    if (parsers_.empty ())
+      return handle (this, new parser (segs, n, iname, f, alloc_));
+
+    parsers_.back ()->reset (segs, n, iname, f);
+
+    handle r (this, parsers_.back ());
+    parsers_.pop_back ();
+    return r;
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (input_source& src, const string& iname, feature_type f)
+  {
+    if (parsers_.empty ())
+      return handle (this, new parser (src, iname, f, alloc_));
+
+    parsers_.back ()->reset (src, iname, f);
+
+    handle r (this, parsers_.back ());
+    parsers_.pop_back ();
+    return r;
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (parser::push_mode_t pm, const string& iname, feature_type f)
+  {
+    if (parsers_.empty ())
+      return handle (this, new parser (pm, iname, f, alloc_));
+
+    parsers_.back ()->reset (pm, iname, f);
+
+    handle r (this, parsers_.back ());
+    parsers_.pop_back ();
+    return r;
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (const record_index& x,
+           size_t i,
+           const void* data,
+           const string& iname,
+           feature_type f)
+  {
+    if (records_.empty ())
+      return handle (this,
+                     new record_parser (x, i, data, iname, f, alloc_),
+                     true);
+
+    records_.back ()->reset (x, i, data, iname, f);
+
+    handle r (this, records_.back (), true);
+    records_.pop_back ();
+    return r;
+  }
+
+  parser_pool::handle parser_pool::
+  acquire (const record_index& x,
+           size_t i,
+           istream& is,
+           const string& iname,
+           feature_type f)
+  {
+    if (records_.empty ())
+      return handle (this,
+                     new record_parser (x, i, is, iname, f, alloc_),
+                     true);
+
+    records_.back ()->reset (x, i, is, iname, f);
+
+    handle r (this, records_.back (), true);
+    records_.pop_back ();
+    return r;
+  }
+
+  void parser_pool::
+  release (parser* p, bool record)
+  {
+    record_parser* rp (record ? static_cast<record_parser*> (p) : 0);
+
+    if (size () < capacity_)
+    {
+      try
+      {
+        if (rp != 0)
+          records_.push_back (rp);
+        else
+          parsers_.push_back (p);
+
+        return;
+      }
+      catch (const bad_alloc&)
+      {
+      }
+    }
+
+    if (rp != 0)
+      delete rp;
+    else
+      delete p;
+  }
+
+  parser_pool& parser_pool::
+  local ()
+  {
+    static thread_local parser_pool pool;
+    return pool;
+  }
+}
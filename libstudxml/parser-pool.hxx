@@ -0,0 +1,180 @@
+// file      : libstudxml/parser-pool.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_PARSER_POOL_HXX
+#define LIBSTUDXML_PARSER_POOL_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <cstddef> // std::size_t
+
+#include <libstudxml/forward.hxx>
+#include <libstudxml/parser.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Pool of parsers that are reused (see parser::reset()) across documents.
+  // For example:
+  //
+  // xml::parser_pool::handle p (
+  //   xml::parser_pool::local ().acquire (is, "message"));
+  //
+  // p->next_expect (xml::parser::start_element, "message");
+  // ...
+  //
+  // The parser is returned to the pool when the handle is destroyed and
+  // the handle should not outlive the pool. At most capacity idle parsers
+  // are kept in the pool with the rest destroyed on release.
+  //
+  // The pool is not thread-safe. Normally, each thread would use its own
+  // pool, such as the one returned by local().
+  //
+  class LIBSTUDXML_EXPORT parser_pool
+  {
+  public:
+    typedef parser::feature_type feature_type;
+
+    class LIBSTUDXML_EXPORT handle
+    {
+    public:
+      handle (): pool_ (0), p_ (0), record_ (false) {}
+
+      handle (handle&& h): pool_ (h.pool_), p_ (h.p_), record_ (h.record_)
+      {
+        h.p_ = 0;
+      }
+
+      handle&
+      operator= (handle&&);
+
+      ~handle ();
+
+      parser&
+      operator* () const {return *p_;}
+
+      parser*
+      operator-> () const {return p_;}
+
+      parser*
+      get () const {return p_;}
+
+      // Return the parser to the pool.
+      //
+      void
+      release ();
+
+    private:
+      handle (const handle&);
+      handle& operator= (const handle&);
+
+    private:
+      friend class parser_pool;
+
+      handle (parser_pool* pool, parser* p, bool record = false)
+          : pool_ (pool), p_ (p), record_ (record) {}
+
+      parser_pool* pool_;
+      parser* p_;
+      bool record_; // p_ is record_parser.
+    };
+
+    // If the allocator is specified, then it is passed to the parsers
+    // created by the pool (see parser for details).
+    //
+    explicit
+    parser_pool (std::size_t capacity = 16, allocator* a = 0)
+        : capacity_ (capacity), alloc_ (a) {}
+
+    ~parser_pool ();
+
+    // Get a parser from the pool, resetting it to parse the specified
+    // input, or create a new one if the pool is empty. The arguments have
+    // the same semantics as in the parser constructors.
+    //
+    handle
+    acquire (std::istream&,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    handle
+    acquire (const void* data,
+             std::size_t size,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    handle
+    acquire (const parser::segment* segments,
+             std::size_t count,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    handle
+    acquire (input_source&,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    handle
+    acquire (parser::push_mode_t,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    // Get a parser for a single record (see record_parser). Such parsers
+    // are kept in the pool separately from the rest and are only reused
+    // for records.
+    //
+    handle
+    acquire (const record_index&,
+             std::size_t record,
+             const void* data,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    handle
+    acquire (const record_index&,
+             std::size_t record,
+             std::istream&,
+             const std::string& input_name,
+             feature_type = parser::receive_default);
+
+    // Return the calling thread's pool.
+    //
+    static parser_pool&
+    local ();
+
+    // The number of idle parsers in the pool.
+    //
+    std::size_t
+    size () const {return parsers_.size () + records_.size ();}
+
+    std::size_t
+    capacity () const {return capacity_;}
+
+    // Destroy all the idle parsers.
+    //
+    void
+    clear ();
+
+  private:
+    parser_pool (const parser_pool&);
+    parser_pool& operator= (const parser_pool&);
+
+  private:
+    void
+    release (parser*, bool record);
+
+  private:
+    std::size_t capacity_;
+    allocator* alloc_;
+    std::vector<parser*> parsers_;
+    std::vector<record_parser*> records_;
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_PARSER_POOL_HXX
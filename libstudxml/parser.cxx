@@ -1,14 +1,20 @@
 // file      : libstudxml/parser.cxx
 // license   : MIT; see accompanying LICENSE file
 
-#include <new>     // std::bad_alloc
+#include <new>       // std::bad_alloc
 #include <cassert>
-#include <cstring> // std::strchr
+#include <cstddef>   // std::ptrdiff_t
+#include <chrono>
+#include <algorithm> // std::rotate, std::min, std::search
+#include <cstring>   // std::strchr, std::memchr, std::strlen, std::strncmp
 #include <istream>
 #include <ostream>
 #include <sstream>
 
 #include <libstudxml/parser.hxx>
+#include <libstudxml/binary.hxx>
+#include <libstudxml/input-source.hxx>
+#include <libstudxml/details/allocator.hxx>
 
 using namespace std;
 
@@ -26,6 +32,10 @@ namespace xml
     what_ = os.str ();
   }
 
+  // parser
+  //
+  const parser::push_mode_t parser::push_mode = parser::push_mode_t ();
+
   // parser::event_type
   //
   static const char* parser_event_str[] =
@@ -37,7 +47,8 @@ namespace xml
     "characters",
     "start namespace declaration",
     "end namespace declaration",
-    "end of file"
+    "end of file",
+    "need more input"
   };
 
   ostream&
@@ -46,6 +57,179 @@ namespace xml
     return os << parser_event_str[e];
   }
 
+  static void
+  split_name (const XML_Char* s, qname& qn)
+  {
+    string& ns (qn.namespace_ ());
+    string& name (qn.name ());
+    string& prefix (qn.prefix ());
+
+    const char* p (strchr (s, ' '));
+
+    if (p == 0)
+    {
+      ns.clear ();
+      name = s;
+      prefix.clear ();
+    }
+    else
+    {
+      ns.assign (s, 0, p - s);
+
+      s = p + 1;
+      p = strchr (s, ' ');
+
+      if (p == 0)
+      {
+        name = s;
+        prefix.clear ();
+      }
+      else
+      {
+        name.assign (s, 0, p - s);
+        prefix = p + 1;
+      }
+    }
+  }
+
+  // Swap the qname components. Unlike std::swap(), this does not involve
+  // any temporaries.
+  //
+  static inline void
+  swap_qname (qname& x, qname& y)
+  {
+    x.namespace_ ().swap (y.namespace_ ());
+    x.name ().swap (y.name ());
+    x.prefix ().swap (y.prefix ());
+  }
+
+  // Find the Expat name (which may include the prefix) in the name table.
+  //
+  static inline name_table::id_type
+  find_name (const name_table& t, const XML_Char* s)
+  {
+    size_t n (strlen (s));
+
+    if (const char* p = static_cast<const char*> (memchr (s, ' ', n)))
+    {
+      if (const char* e = static_cast<const char*> (
+            memchr (p + 1, ' ', n - (p - s) - 1)))
+        n = e - s;
+    }
+
+    return t.find (s, n);
+  }
+
+  // Expat's memory handling suite functions don't receive any context so
+  // we pass the allocator to use for new blocks via a thread-local variable
+  // that is set for the duration of each Expat call that may allocate.
+  // Reallocation and deallocation get the allocator from the block header
+  // (see details/allocator.hxx).
+  //
+  static thread_local allocator* expat_allocator;
+
+  struct expat_allocator_guard
+  {
+    explicit
+    expat_allocator_guard (allocator* a)
+        : a_ (a), p_ (0)
+    {
+      if (a_ != 0)
+      {
+        p_ = expat_allocator;
+        expat_allocator = a_;
+      }
+    }
+
+    ~expat_allocator_guard ()
+    {
+      if (a_ != 0)
+        expat_allocator = p_;
+    }
+
+    allocator* a_;
+    allocator* p_;
+  };
+
+  static void*
+  expat_malloc (size_t n)
+  {
+    return details::c_malloc (*expat_allocator, n);
+  }
+
+  static void*
+  expat_realloc (void* p, size_t n)
+  {
+    return p != 0
+      ? details::c_realloc (p, n)
+      : details::c_malloc (*expat_allocator, n);
+  }
+
+  static void
+  expat_free (void* p)
+  {
+    details::c_free (p);
+  }
+
+  // Return true if the document that starts with the specified data is in
+  // UTF-8 (or US-ASCII) as opposed to, for example, UTF-16 or ISO-8859-1.
+  // If the XML declaration is incomplete, then assume it is not.
+  //
+  static bool
+  utf8_document (const char* b, size_t n)
+  {
+    const char* e (b + n);
+
+    if (n >= 3 && b[0] == '\xEF' && b[1] == '\xBB' && b[2] == '\xBF')
+      b += 3;
+
+    // UTF-16 or UTF-32 (with or without BOM).
+    //
+    for (size_t i (0); i != 4 && b + i != e; ++i)
+    {
+      unsigned char c (static_cast<unsigned char> (b[i]));
+
+      if (c == 0 || c >= 0xFE)
+        return false;
+    }
+
+    if (e - b < 5 || strncmp (b, "<?xml", 5) != 0)
+      return true;
+
+    const char de[] = "?>";
+    const char en[] = "encoding";
+
+    const char* x (search (b, e, de, de + 2));
+    if (x == e)
+      return false;
+
+    e = x;
+
+    const char* p (search (b, e, en, en + 8));
+    if (p == e)
+      return true;
+
+    // Skip '=', quote, and whitespaces around them.
+    //
+    for (p += 8; p != e && (*p == ' ' || *p == '=' || *p == '\t' ||
+                            *p == '\n' || *p == '\r'); ++p) ;
+
+    if (p == e || (*p != '"' && *p != '\''))
+      return false;
+
+    const char* v (++p);
+    for (; p != e && *p != v[-1]; ++p) ;
+
+    string s (v, p);
+    for (string::iterator i (s.begin ()); i != s.end (); ++i)
+    {
+      if (*i >= 'a' && *i <= 'z')
+        *i = static_cast<char> (*i - 'a' + 'A');
+    }
+
+    return s == "UTF-8" || s == "US-ASCII";
+  }
+
   // parser
   //
   parser::
@@ -58,54 +242,163 @@ namespace xml
   void parser::
   init ()
   {
+    pos_ = 0;
+    need_input_ = false;
+
+    chunk_ = 4096;
+    chunk_max_ = chunk_;
+    chunk_prev_ = chunk_;
+    chunk_reads_ = 0;
+    chunk_time_ = 0;
+    chunk_rate_ = 0;
+    chunk_cur_ = 0;
+    chunk_cur_time_ = 0;
+
     depth_ = 0;
+    skip_depth_ = 0;
+    error_ = false;
+
+    handler_ = 0;
+    handler_error_ = nullptr;
+    text_.clear ();
+    end_pending_ = false;
+    filling_ = false;
     state_ = state_next;
     event_ = eof;
-    queue_ = eof;
 
     pqname_ = &qname_;
     pvalue_ = &value_;
+    praw_ = 0;
+
+    names_ = 0;
+    name_id_ = 0;
+    qname_id_ = 0;
 
     line_ = 0;
     column_ = 0;
+    loc_byte_ = 0;
+    loc_pending_ = false;
+
+    cur_seg_ = 0;
+    cur_pos_ = 0;
+    cur_byte_ = 0;
+    cur_line_ = 1;
+    cur_column_ = 0;
+    cur_cr_ = false;
+
+    // The lazy location calculation requires the whole document to be
+    // available in memory and Expat's column numbers to be the same as
+    // what we calculate (see locate()).
+    //
+    if ((feature_ & no_locations) != 0)
+      location_ = location_none;
+    else if (input_ == input_buffer)
+      location_ = utf8_document (static_cast<const char*> (data_.buf), size_)
+        ? location_lazy
+        : location_eager;
+    else if (input_ == input_segments)
+    {
+      size_t i (0);
+      for (; i != segs_n_ && segs_[i].size == 0; ++i) ;
+
+      location_ = i == segs_n_ ||
+        utf8_document (static_cast<const char*> (segs_[i].data),
+                       segs_[i].size)
+        ? location_lazy
+        : location_eager;
+    }
+    else
+      location_ = location_eager;
 
+    attr_n_ = 0;
     attr_i_ = 0;
     start_ns_i_ = 0;
     end_ns_i_ = 0;
 
+    queue_b_ = 0;
+    queue_n_ = 0;
+
+    chars_max_ = 65536;
+    chars_buf_ = 0;
+    chars_size_ = 0;
+    chars_pos_ = 0;
+    chars_last_ = true;
+
+    attr_stack_n_ = 0;
+
     if ((feature_ & receive_attributes_map) != 0 &&
         (feature_ & receive_attributes_event) != 0)
       feature_ &= ~receive_attributes_map;
 
-    // Allocate the parser. Make sure nothing else can throw after
-    // this call since otherwise we will leak it.
-    //
-    p_ = XML_ParserCreateNS (0, XML_Char (' '));
+    expat_allocator_guard ag (alloc_);
 
     if (p_ == 0)
-      throw bad_alloc ();
+    {
+      // Allocate the parser. Make sure nothing else can throw after
+      // this call since otherwise we will leak it.
+      //
+      if (alloc_ == 0)
+        p_ = XML_ParserCreateNS (0, XML_Char (' '));
+      else
+      {
+        const XML_Memory_Handling_Suite ms = {
+          &expat_malloc, &expat_realloc, &expat_free};
+
+        p_ = XML_ParserCreate_MM (0, &ms, " ");
+      }
+
+      if (p_ == 0)
+        throw bad_alloc ();
+    }
+    else
+    {
+      // Reset. Note that clear() keeps the capacity and the rest of the
+      // containers are reused based on the counters reset above.
+      //
+      qname_ = qname_type ();
+      value_.clear ();
+      start_ns_.clear ();
+      end_ns_.clear ();
+      queue_ns_.clear ();
+      element_state_.clear ();
+
+      // This only fails for child (external entity) parsers. Note that
+      // all the handlers are cleared and we set them again below.
+      //
+      if (!XML_ParserReset (p_, 0))
+        throw bad_alloc ();
+    }
 
     // Get prefixes in addition to namespaces and local names.
     //
     XML_SetReturnNSTriplet (p_, true);
 
-    // Set handlers.
-    //
     XML_SetUserData(p_, this);
+    set_handlers ();
+  }
+
+  void parser::
+  set_handlers ()
+  {
+    bool h (handler_ != 0);
 
     if ((feature_ & receive_elements) != 0)
     {
-      XML_SetStartElementHandler (p_, &start_element_);
-      XML_SetEndElementHandler (p_, &end_element_);
+      XML_SetStartElementHandler (
+        p_, h ? &handler_start_element_ : &start_element_);
+      XML_SetEndElementHandler (
+        p_, h ? &handler_end_element_ : &end_element_);
     }
 
     if ((feature_ & receive_characters) != 0)
-      XML_SetCharacterDataHandler (p_, &characters_);
+      XML_SetCharacterDataHandler (
+        p_, h ? &handler_characters_ : &characters_);
 
     if ((feature_ & receive_namespace_decls) != 0)
-      XML_SetNamespaceDeclHandler (p_,
-                                   &start_namespace_decl_,
-                                   &end_namespace_decl_);
+      XML_SetNamespaceDeclHandler (
+        p_,
+        &start_namespace_decl_,
+        h ? &handler_end_namespace_decl_ : &end_namespace_decl_);
   }
 
   void parser::
@@ -113,28 +406,10 @@ namespace xml
   {
     XML_Error e (XML_GetErrorCode (p_));
 
-    if (e == XML_ERROR_ABORTED)
-    {
-      // For now we only abort the parser in the characters_() and
-      // start_element_() handlers.
-      //
-      switch (content ())
-      {
-      case content_type::empty:
-        throw parsing (*this, "characters in empty content");
-      case content_type::simple:
-        throw parsing (*this, "element in simple content");
-      case content_type::complex:
-        throw parsing (*this, "characters in complex content");
-      default:
-        assert (false);
-      }
-    }
-    else
-      throw parsing (iname_,
-                     XML_GetCurrentLineNumber (p_),
-                     XML_GetCurrentColumnNumber (p_),
-                     XML_ErrorString (e));
+    throw parsing (iname_,
+                   XML_GetCurrentLineNumber (p_),
+                   XML_GetCurrentColumnNumber (p_),
+                   XML_ErrorString (e));
   }
 
   struct stream_exception_controller
@@ -212,67 +487,273 @@ namespace xml
     }
   }
 
-  const string& parser::
-  attribute (const qname_type& qn) const
+  parser::handler::
+  ~handler ()
   {
-    if (const element_entry* e = get_element ())
+  }
+
+  parser::event_type parser::
+  parse (handler& h)
+  {
+    // First deliver the peeked event and the events that have already
+    // been queued, if any, the usual way.
+    //
+    for (;;)
     {
-      attribute_map_type::const_iterator i (e->attr_map_.find (qn));
+      event_type e;
+
+      if (state_ == state_peek)
+        e = next ();
+      else if (queue_n_ != 0 ||
+               start_ns_i_ < start_ns_.size () ||
+               attr_i_ < attr_n_)
+        e = next_ (false);
+      else
+        break;
 
-      if (i != e->attr_map_.end ())
+      switch (e)
       {
-        if (!i->second.handled)
-        {
-          i->second.handled = true;
-          e->attr_unhandled_--;
-        }
-        return i->second.value;
+      case start_element:        h.start_element (*this);        break;
+      case end_element:          h.end_element (*this);          break;
+      case start_attribute:      h.start_attribute (*this);      break;
+      case end_attribute:        h.end_attribute (*this);        break;
+      case characters:           h.characters (*this);           break;
+      case start_namespace_decl: h.start_namespace_decl (*this); break;
+      case end_namespace_decl:   h.end_namespace_decl (*this);   break;
+      case eof:
+      case need_more_input:      return e;
       }
     }
 
-    throw parsing (*this, "attribute '" + qn.string () + "' expected");
+    // Now parse the rest of the input calling the handler from the Expat
+    // handlers. If we are in the middle of skip(), then the handlers will
+    // be switched once it is over (see skip_end_element_()).
+    //
+    struct handler_guard
+    {
+      handler_guard (parser& p, handler& h)
+          : p_ (p)
+      {
+        p_.handler_ = &h;
+
+        if (p_.skip_depth_ == 0)
+          p_.set_handlers ();
+      }
+
+      ~handler_guard ()
+      {
+        p_.handler_ = 0;
+
+        if (p_.skip_depth_ == 0)
+          p_.set_handlers ();
+      }
+
+      parser& p_;
+    } hg (*this, h);
+
+    // Nothing is queued in this mode so this only returns once we have
+    // reached eof or need more input.
+    //
+    fill ();
+    assert (queue_n_ == 0);
+
+    if (need_input_)
+    {
+      // Put the text accumulated so far into the queue and continue once
+      // we have more input (see next_body()).
+      //
+      if (!text_.empty ())
+      {
+        event_entry& e (push_event (characters));
+        e.value.swap (text_);
+        e.line = line_;
+        e.column = column_;
+        e.byte = loc_byte_;
+        text_.clear ();
+      }
+
+      return event_ = need_more_input;
+    }
+
+    // Without elements the text can continue until eof.
+    //
+    if (!text_.empty ())
+      dispatch_text (true);
+
+    // The input data may no longer be valid after eof.
+    //
+    if (loc_pending_)
+      locate ();
+
+    return event_ = eof;
   }
 
-  string parser::
-  attribute (const qname_type& qn, const string& dv) const
+  parser::attribute_map_type::const_iterator parser::attribute_map_type::
+  find (const key_type& qn) const
   {
-    if (const element_entry* e = get_element ())
+    const_iterator i (begin ()), e (end ());
+    for (; i != e; ++i)
     {
-      attribute_map_type::const_iterator i (e->attr_map_.find (qn));
+      const qname_type& n (i->first);
+
+      if (n.name () == qn.name () && n.namespace_ () == qn.namespace_ ())
+        break;
+    }
+
+    return i;
+  }
 
-      if (i != e->attr_map_.end ())
+  const parser::attribute_value_type* parser::
+  find_attribute (const qname_type& qn) const
+  {
+    if (const element_entry* e = get_element ())
+    {
+      for (size_t i (e->attr_b); i != e->attr_e; ++i)
       {
-        if (!i->second.handled)
+        const attribute_slot& s (attr_stack_[i]);
+        const qname_type& n (s.entry.first);
+
+        if (n.name () == qn.name () && n.namespace_ () == qn.namespace_ ())
         {
-          i->second.handled = true;
-          e->attr_unhandled_--;
+          const attribute_value_type& v (s.entry.second);
+
+          if (!v.handled)
+          {
+            v.handled = true;
+            e->attr_unhandled_--;
+          }
+
+          return &v;
         }
-        return i->second.value;
       }
     }
 
-    return dv;
+    return 0;
   }
 
-  bool parser::
-  attribute_present (const qname_type& qn) const
+  const parser::attribute_value_type* parser::
+  find_attribute (name_id_type id) const
   {
+    assert (names_ != 0 && id != name_table_type::unknown);
+
     if (const element_entry* e = get_element ())
     {
-      attribute_map_type::const_iterator i (e->attr_map_.find (qn));
-
-      if (i != e->attr_map_.end ())
+      for (size_t i (e->attr_b); i != e->attr_e; ++i)
       {
-        if (!i->second.handled)
+        const attribute_slot& s (attr_stack_[i]);
+
+        if (s.id == id)
         {
-          i->second.handled = true;
-          e->attr_unhandled_--;
+          const attribute_value_type& v (s.entry.second);
+
+          if (!v.handled)
+          {
+            v.handled = true;
+            e->attr_unhandled_--;
+          }
+
+          return &v;
         }
-        return true;
       }
     }
 
-    return false;
+    return 0;
+  }
+
+  const string& parser::
+  attribute (const qname_type& qn) const
+  {
+    if (const attribute_value_type* v = find_attribute (qn))
+      return v->value;
+
+    throw parsing (*this, "attribute '" + qn.string () + "' expected");
+  }
+
+  const string& parser::
+  attribute (name_id_type id) const
+  {
+    if (const attribute_value_type* v = find_attribute (id))
+      return v->value;
+
+    throw parsing (*this,
+                   "attribute '" + names_->name (id).string () + "' expected");
+  }
+
+  void parser::
+  skip ()
+  {
+    // Finish the peeked start element, if any.
+    //
+    if (state_ == state_peek)
+      next ();
+
+    if (event_ != start_element)
+      throw parsing (*this,
+                     "skip() called after " +
+                     string (parser_event_str[event_]) +
+                     " instead of start element");
+
+    // Discard the element's attribute and namespace declaration events
+    // that haven't yet been returned. Its end namespace declarations are
+    // discarded as well, either below if the element end is already in
+    // the queue, or by end_namespace_decl_() which ignores them since the
+    // queue is empty after skipping.
+    //
+    attr_i_ = 0;
+    attr_n_ = 0;
+    start_ns_i_ = 0;
+    start_ns_.clear ();
+
+    // First discard the element's content that is already in the queue.
+    //
+    size_t d (1);
+    while (queue_n_ != 0)
+    {
+      event_entry& e (front_event ());
+
+      if (e.event == start_element)
+        d++;
+      else if (e.event == end_element && --d == 0)
+      {
+        pop_event ();
+        break;
+      }
+
+      pop_event ();
+    }
+
+    // If the element end hasn't yet been parsed, then switch to the
+    // handlers that only track the depth. The normal handlers are restored
+    // by skip_end_element_() after the element end.
+    //
+    if (d != 0)
+    {
+      skip_depth_ = d;
+
+      XML_SetElementHandler (p_, &skip_start_element_, &skip_end_element_);
+      XML_SetCharacterDataHandler (p_, 0);
+      XML_SetNamespaceDeclHandler (p_, 0, 0);
+    }
+
+    // Pop the element state (without checking for unhandled attributes).
+    //
+    if (!element_state_.empty () && element_state_.back ().depth == depth_)
+    {
+      attr_stack_n_ = element_state_.back ().attr_b;
+      element_state_.pop_back ();
+    }
+
+    depth_--;
+    event_ = end_element;
+    set_qname (&qname_, qname_id_, (feature_ & string_views) != 0);
+    pvalue_ = &value_;
+  }
+
+  void parser::
+  next_skip ()
+  {
+    next_expect (start_element);
+    skip ();
   }
 
   void parser::
@@ -285,12 +766,23 @@ namespace xml
   void parser::
   next_expect (event_type e, const string& ns, const string& n)
   {
-    if (next () != e || namespace_ () != ns || name () != n)
+    if (next () != e || !qname_equal (ns, n))
       throw parsing (*this,
                      string (parser_event_str[e]) + " '" +
                      qname_type (ns, n).string () + "' expected");
   }
 
+  void parser::
+  next_expect (event_type e, name_id_type id)
+  {
+    assert (names_ != 0 && id != name_table_type::unknown);
+
+    if (next () != e || name_id_ != id)
+      throw parsing (*this,
+                     string (parser_event_str[e]) + " '" +
+                     names_->name (id).string () + "' expected");
+  }
+
   string parser::
   element ()
   {
@@ -315,18 +807,129 @@ namespace xml
     return r;
   }
 
-  string parser::
-  element (const qname_type& qn, const string& dv)
+  void parser::
+  element_binary (output_sink& s, bool base64)
   {
-    if (peek () == start_element && qname () == qn)
-    {
-      next ();
-      return element ();
-    }
+    content (content_type::simple);
+
+    // Receive characters in chunks (into value_) for the duration of this
+    // call.
+    //
+    struct chunked_guard
+    {
+      chunked_guard (parser& p)
+          : p_ (p), feature_ (p.feature_), buf_ (p.chars_buf_)
+      {
+        p.feature_ |= receive_characters_chunked;
+        p.chars_buf_ = 0;
+      }
+
+      ~chunked_guard ()
+      {
+        p_.feature_ = feature_;
+        p_.chars_buf_ = buf_;
+      }
+
+      parser& p_;
+      feature_type feature_;
+      char* buf_;
+    } g (*this);
+
+    base64_decoder bd;
+    hex_decoder hd;
+
+    vector<char> buf (base64
+                      ? base64_decoder::decode_size (chars_max_)
+                      : hex_decoder::decode_size (chars_max_));
+
+    event_type e (next ());
+    for (; e == characters; e = next ())
+    {
+      const string& v (value_);
+      size_t n;
+
+      if (!(base64
+            ? bd.decode (v.data (), v.size (), buf.data (), n)
+            : hd.decode (v.data (), v.size (), buf.data (), n)))
+        break;
+
+      if (n != 0)
+        s.write (buf.data (), n);
+    }
+
+    // We cannot return need_more_input from the middle of the content
+    // (see the documentation for details).
+    //
+    if (e == need_more_input)
+      throw parsing (*this,
+                     base64
+                     ? "incomplete base64 data in push mode"
+                     : "incomplete hex data in push mode");
+
+    if (e != end_element || !(base64 ? bd.finish () : hd.finish ()))
+      throw parsing (*this,
+                     base64 ? "invalid base64 data" : "invalid hex data");
+  }
+
+  string parser::
+  element (const qname_type& qn, const string& dv)
+  {
+    if (peek () == start_element &&
+        qname_equal (qn.namespace_ (), qn.name ()))
+    {
+      next ();
+      return element ();
+    }
 
     return dv;
   }
 
+  void parser::
+  set_qname (const qname_type* qn, name_id_type id, bool raw)
+  {
+    pqname_ = qn;
+    name_id_ = id;
+
+    if (raw)
+    {
+      const string& s (qn->name ());
+
+      praw_ = &s;
+      raw_ns_ = s.find (' ');
+      raw_name_ = raw_ns_ != string::npos
+        ? s.find (' ', raw_ns_ + 1)
+        : string::npos;
+    }
+    else
+      praw_ = 0;
+  }
+
+  const parser::qname_type& parser::
+  split_qname () const
+  {
+    split_name (praw_->c_str (), qsplit_);
+    pqname_ = &qsplit_;
+    praw_ = 0;
+    return qsplit_;
+  }
+
+  bool parser::
+  qname_equal (const string& ns, const string& n) const
+  {
+    if (praw_ == 0)
+      return pqname_->namespace_ () == ns && pqname_->name () == n;
+
+    const string& s (*praw_);
+
+    if (raw_ns_ == string::npos)
+      return ns.empty () && s == n;
+
+    size_t e (raw_name_ != string::npos ? raw_name_ : s.size ());
+
+    return s.compare (0, raw_ns_, ns) == 0 &&
+      s.compare (raw_ns_ + 1, e - raw_ns_ - 1, n) == 0;
+  }
+
   const parser::element_entry* parser::
   get_element_ () const
   {
@@ -359,30 +962,36 @@ namespace xml
     {
       // Find the first unhandled attribute and report it.
       //
-      for (attribute_map_type::const_iterator i (e.attr_map_.begin ());
-           i != e.attr_map_.end (); ++i)
+      for (size_t i (e.attr_b); i != e.attr_e; ++i)
       {
-        if (!i->second.handled)
+        const attribute_slot& s (attr_stack_[i]);
+
+        if (!s.entry.second.handled)
           throw parsing (
-            *this, "unexpected attribute '" + i->first.string () + "'");
+            *this, "unexpected attribute '" + s.entry.first.string () + "'");
       }
       assert (false);
     }
 
+    attr_stack_n_ = e.attr_b;
     element_state_.pop_back ();
   }
 
   parser::event_type parser::
   next_ (bool peek)
   {
+    // While parse() dispatches the events directly, next() and peek()
+    // would return the events that are yet to be dispatched (such as the
+    // current element's attributes) or parse recursively (see fill()).
+    //
+    if (handler_ != 0)
+      throw parsing (*this, "next() or peek() called from parse() handler");
+
     event_type e (next_body ());
 
-    // Content-specific processing. Note that we handle characters in the
-    // characters_() Expat handler for two reasons. Firstly, it is faster
-    // to ignore the whitespaces at the source. Secondly, this allows us
-    // to distinguish between element and attribute characters. We can
-    // move this processing to the handler because the characters event
-    // is never queued.
+    // Content-specific processing. Note that characters are handled in
+    // next_body() since that's where we can distinguish between element
+    // and attribute characters.
     //
     switch (e)
     {
@@ -431,6 +1040,144 @@ namespace xml
     return e;
   }
 
+  inline void parser::
+  set_location (const event_entry& e)
+  {
+    switch (location_)
+    {
+    case location_eager:
+      {
+        line_ = e.line;
+        column_ = e.column;
+        break;
+      }
+    case location_lazy:
+      {
+        loc_byte_ = e.byte;
+        loc_pending_ = true;
+        break;
+      }
+    case location_none:
+      break;
+    }
+  }
+
+  inline void parser::
+  set_location ()
+  {
+    switch (location_)
+    {
+    case location_eager:
+      {
+        line_ = XML_GetCurrentLineNumber (p_);
+        column_ = XML_GetCurrentColumnNumber (p_);
+        break;
+      }
+    case location_lazy:
+      {
+        loc_byte_ = static_cast<unsigned long long> (
+          XML_GetCurrentByteIndex (p_));
+        loc_pending_ = true;
+        break;
+      }
+    case location_none:
+      break;
+    }
+  }
+
+  void parser::
+  locate () const
+  {
+    // Events come in the document order so normally we only move forward.
+    //
+    if (loc_byte_ < cur_byte_)
+    {
+      cur_seg_ = 0;
+      cur_pos_ = 0;
+      cur_byte_ = 0;
+      cur_line_ = 1;
+      cur_column_ = 0;
+      cur_cr_ = false;
+    }
+
+    // Count lines and columns the same way as Expat does for UTF-8: CR,
+    // LF, and CRLF are all newlines and each character (but not each
+    // byte) is a column.
+    //
+    while (cur_byte_ != loc_byte_)
+    {
+      const char* b;
+      size_t n;
+
+      if (input_ == input_buffer)
+      {
+        b = static_cast<const char*> (data_.buf);
+        n = size_;
+      }
+      else
+      {
+        assert (cur_seg_ != segs_n_);
+
+        b = static_cast<const char*> (segs_[cur_seg_].data);
+        n = segs_[cur_seg_].size;
+      }
+
+      if (cur_pos_ == n)
+      {
+        cur_seg_++;
+        cur_pos_ = 0;
+        continue;
+      }
+
+      if (n - cur_pos_ > loc_byte_ - cur_byte_)
+        n = cur_pos_ + static_cast<size_t> (loc_byte_ - cur_byte_);
+
+      unsigned long long l (cur_line_), c (cur_column_);
+      bool cr (cur_cr_);
+
+      for (const char* p (b + cur_pos_), *e (b + n); p != e; ++p)
+      {
+        switch (*p)
+        {
+        case '\r':
+          {
+            l++;
+            c = 0;
+            cr = true;
+            continue;
+          }
+        case '\n':
+          {
+            if (!cr)
+            {
+              l++;
+              c = 0;
+            }
+            break;
+          }
+        default:
+          {
+            if ((static_cast<unsigned char> (*p) & 0xC0) != 0x80)
+              c++;
+            break;
+          }
+        }
+
+        cr = false;
+      }
+
+      cur_byte_ += n - cur_pos_;
+      cur_pos_ = n;
+      cur_line_ = l;
+      cur_column_ = c;
+      cur_cr_ = cr;
+    }
+
+    line_ = cur_line_;
+    column_ = cur_column_;
+    loc_pending_ = false;
+  }
+
   parser::event_type parser::
   next_body ()
   {
@@ -448,7 +1195,7 @@ namespace xml
           {
             start_ns_i_ = 0;
             start_ns_.clear ();
-            pqname_ = &qname_;
+            set_qname (&qname_, qname_id_, (feature_ & string_views) != 0);
             break; // No more declarations.
           }
         }
@@ -456,7 +1203,7 @@ namespace xml
       case start_element:
         {
           event_ = start_namespace_decl;
-          pqname_ = &start_ns_[start_ns_i_];
+          set_qname (&start_ns_[start_ns_i_], 0, false);
           return event_;
         }
       default:
@@ -469,7 +1216,7 @@ namespace xml
 
     // See if we have any attributes we need to return as events.
     //
-    if (attr_i_ < attr_.size ())
+    if (attr_i_ < attr_n_)
     {
       // Based on the previous event determine what's the next one must be.
       //
@@ -488,11 +1235,11 @@ namespace xml
         }
       case end_attribute:
         {
-          if (++attr_i_ == attr_.size ())
+          if (++attr_i_ == attr_n_)
           {
             attr_i_ = 0;
-            attr_.clear ();
-            pqname_ = &qname_;
+            attr_n_ = 0;
+            set_qname (&qname_, qname_id_, (feature_ & string_views) != 0);
             pvalue_ = &value_;
             break; // No more attributes.
           }
@@ -502,7 +1249,9 @@ namespace xml
       case start_namespace_decl:
         {
           event_ = start_attribute;
-          pqname_ = &attr_[attr_i_].qname;
+          set_qname (&attr_[attr_i_].qname,
+                     attr_[attr_i_].id,
+                     (feature_ & string_views) != 0);
           return event_;
         }
       default:
@@ -527,7 +1276,7 @@ namespace xml
           {
             end_ns_i_ = 0;
             end_ns_.clear ();
-            pqname_ = &qname_;
+            set_qname (&qname_, qname_id_, (feature_ & string_views) != 0);
             break; // No more declarations.
           }
         }
@@ -538,253 +1287,774 @@ namespace xml
           // means it can follow pretty much any other event.
           //
           event_ = end_namespace_decl;
-          pqname_ = &end_ns_[end_ns_i_];
+          set_qname (&end_ns_[end_ns_i_], 0, false);
           return event_;
         }
       }
     }
 
-    // Check the queue.
+    // Get the next event from the queue, parsing more input if necessary.
     //
-    if (queue_ != eof)
+    for (;;)
     {
-      event_ = queue_;
-      queue_ = eof;
+      if (queue_n_ == 0 && !fill ())
+      {
+        // The input data may no longer be valid after eof.
+        //
+        if (loc_pending_)
+          locate ();
 
-      line_ = XML_GetCurrentLineNumber (p_);
-      column_ = XML_GetCurrentColumnNumber (p_);
+        return event_ = need_input_ ? need_more_input : eof;
+      }
 
-      return event_;
-    }
+      event_entry& qe (front_event ());
+      set_location (qe);
 
-    // Reset the character accumulation flag.
-    //
-    accumulate_ = false;
+      switch (qe.event)
+      {
+      case start_element:
+        {
+          event_ = start_element;
+          swap_qname (qname_, qe.qname);
+          qname_id_ = qe.id;
+          set_qname (&qname_, qname_id_, (feature_ & string_views) != 0);
 
-    XML_ParsingStatus ps;
-    XML_GetParsingStatus (p_, &ps);
+          bool am ((feature_ & receive_attributes_map) != 0);
 
-    switch (ps.parsing)
-    {
-    case XML_INITIALIZED:
-      {
-        // As if we finished the previous chunk.
-        break;
-      }
-    case XML_PARSING:
-      {
-        assert (false);
-        return event_ = eof;
-      }
-    case XML_FINISHED:
-      {
-        return event_ = eof;
-      }
-    case XML_SUSPENDED:
-      {
-        switch (XML_ResumeParser (p_))
+          if (qe.attr_n != 0)
+          {
+            if (am)
+            {
+              // Provision an entry for this element. Note that we swap
+              // the strings in order to reuse their memory.
+              //
+              element_state_.push_back (
+                element_entry (depth_ + 1, attr_stack_n_));
+              element_entry& pe (element_state_.back ());
+
+              for (attributes::size_type i (0); i != qe.attr_n; ++i)
+              {
+                attribute_type& a (qe.attr[i]);
+
+                if (attr_stack_n_ == attr_stack_.size ())
+                  attr_stack_.push_back (attribute_slot ());
+
+                attribute_slot& s (attr_stack_[attr_stack_n_++]);
+
+                swap_qname (s.entry.first, a.qname);
+                s.entry.second.value.swap (a.value);
+                s.entry.second.handled = false;
+                s.id = a.id;
+              }
+
+              pe.attr_e = attr_stack_n_;
+              pe.attr_unhandled_ = qe.attr_n;
+            }
+            else
+            {
+              // Swap the vectors (rather than the attributes) along with
+              // the attributes that they contain in order to reuse memory.
+              //
+              attr_.swap (qe.attr);
+              attr_n_ = qe.attr_n;
+            }
+          }
+
+          if (!qe.ns.empty ())
+            start_ns_.swap (qe.ns);
+
+          pop_event ();
+          return event_;
+        }
+      case end_element:
         {
-        case XML_STATUS_SUSPENDED:
+          // The end namespace declarations come before the end element.
+          // Leave the entry in the queue until they have been returned.
+          //
+          if (!qe.ns.empty ())
           {
-            // If the parser is again in the suspended state, then
-            // that means we have the next event.
-            //
+            end_ns_.swap (qe.ns);
+
+            event_ = end_namespace_decl;
+            set_qname (&end_ns_[0], 0, false);
             return event_;
           }
-        case XML_STATUS_OK:
-          {
-            // Otherwise, we need to get and parse the next chunk of data
-            // unless this was the last chunk, in which case this is eof.
-            //
-            if (ps.finalBuffer)
-              return event_ = eof;
 
+          event_ = end_element;
+          swap_qname (qname_, qe.qname);
+          qname_id_ = qe.id;
+          set_qname (&qname_, qname_id_, (feature_ & string_views) != 0);
+          pop_event ();
+          return event_;
+        }
+      case characters:
+        {
+          // Content-specific processing. Note that we do it when the
+          // characters are taken off the queue rather than in the
+          // characters_() Expat handler since by then the content model
+          // may have changed.
+          //
+          content_type cont (content ());
+
+          // If this is empty or complex content, see if these are
+          // whitespaces.
+          //
+          switch (cont)
+          {
+          case content_type::empty:
+          case content_type::complex:
+            {
+              const string& v (qe.value);
+
+              for (string::size_type i (0), n (v.size ()); i != n; ++i)
+              {
+                char c (v[i]);
+                if (c == 0x20 || c == 0x0A || c == 0x0D || c == 0x09)
+                  continue;
+
+                throw parsing (*this,
+                               cont == content_type::empty
+                               ? "characters in empty content"
+                               : "characters in complex content");
+              }
+
+              pop_event ();
+              continue; // Ignore whitespaces.
+            }
+          default:
             break;
           }
-        case XML_STATUS_ERROR:
-          handle_error ();
-        }
 
-        break;
+          event_ = characters;
+
+          if ((feature_ & receive_characters_chunked) != 0)
+            return next_chunk ();
+
+          value_.swap (qe.value);
+          pop_event ();
+
+          // In simple content we need to accumulate all the characters
+          // into a single event. Seeing start element is possible but
+          // means violation of the content model.
+          //
+          if (cont == content_type::simple)
+          {
+            while (queue_n_ != 0 || fill ())
+            {
+              event_entry& ne (front_event ());
+
+              if (ne.event == characters)
+              {
+                value_.append (ne.value);
+                pop_event ();
+                continue;
+              }
+
+              if (ne.event == start_element)
+              {
+                set_location (ne);
+                throw parsing (*this, "element in simple content");
+              }
+
+              break;
+            }
+
+            // If we ran out of input in the push mode, then put the
+            // characters accumulated so far back into the queue and
+            // continue once we have more.
+            //
+            if (need_input_)
+            {
+              event_entry& e (push_event (characters));
+              e.value.swap (value_);
+              e.line = line_;
+              e.column = column_;
+              e.byte = loc_byte_;
+              return event_ = need_more_input;
+            }
+          }
+
+          return event_;
+        }
+      default:
+        {
+          assert (false);
+          return event_ = eof;
+        }
       }
     }
+  }
 
-    // Get and parse the next chunk of data until we get the next event
-    // or reach eof.
-    //
-    if (!accumulate_)
-      event_ = eof;
+  // Return the next chunk of characters starting from the front event in
+  // the queue (which should be characters).
+  //
+  parser::event_type parser::
+  next_chunk ()
+  {
+    char* b (chars_buf_);
+    size_t n (0); // Chunk size so far.
+
+    value_.clear ();
 
-    XML_Status s;
-    do
+    chars_last_ = false;
+
+    for (;;)
     {
-      if (size_ != 0)
-      {
-        s = XML_Parse (p_,
-                       static_cast <const char*> (data_.buf),
-                       static_cast <int> (size_),
-                       true);
+      const string& v (front_event ().value);
 
-        if (s == XML_STATUS_ERROR)
-          handle_error ();
+      size_t r (v.size () - chars_pos_); // Remaining in this event.
+      size_t k (chars_max_ - n);         // Remaining in the chunk.
 
-        break;
+      if (k >= r)
+        k = r;
+      else
+      {
+        // Don't split UTF-8 sequences unless the chunk is too small.
+        //
+        size_t m (k);
+        for (; m != 0 &&
+               (static_cast<unsigned char> (v[chars_pos_ + m]) & 0xC0) == 0x80;
+             --m) ;
+
+        if (m != 0 || n != 0)
+          k = m;
       }
+
+      if (b != 0)
+        v.copy (b + n, k, chars_pos_);
       else
+        value_.append (v, chars_pos_, k);
+
+      n += k;
+
+      if (k != r)
       {
-        const size_t cap (4096);
+        chars_pos_ += k; // The chunk is full, leave the rest queued.
+        break;
+      }
 
-        char* b (static_cast<char*> (XML_GetBuffer (p_, cap)));
-        if (b == 0)
-          throw bad_alloc ();
+      pop_event ();
 
-        // Temporarily unset the exception failbit. Also clear the fail bit
-        // when we reset the old state if it was caused by eof.
-        //
-        istream& is (*data_.is);
+      // See if the text continues. If Expat has failed, then return the
+      // chunk accumulated so far (not as the last one) and report the
+      // error on the next call (see fill()). Note that the error could
+      // have been detected by an earlier fill() call (while the events
+      // before it were still queued) or by this one.
+      //
+      bool more (queue_n_ != 0);
+
+      if (!more)
+      {
+        if (error_ && n != 0)
+          break;
+
+        try
+        {
+          more = fill ();
+        }
+        catch (const parsing&)
         {
-          stream_exception_controller sec (is);
-          is.read (b, static_cast<streamsize> (cap));
+          // Only an Expat error can be reported again.
+          //
+          if (n == 0 || XML_GetErrorCode (p_) == XML_ERROR_NONE)
+            throw;
+
+          error_ = true;
+          break;
         }
+      }
 
-        // If the caller hasn't configured the stream to use exceptions,
-        // then use the parsing exception to report an error.
+      if (!more)
+      {
+        // If we ran out of input in the push mode, then put the
+        // characters accumulated so far back into the queue and
+        // continue once we have more.
         //
-        if (is.bad () || (is.fail () && !is.eof ()))
-          throw parsing (*this, "io failure");
+        if (need_input_)
+        {
+          event_entry& e (push_event (characters));
 
-        bool eof (is.eof ());
+          if (b != 0)
+            e.value.assign (b, n);
+          else
+            e.value.swap (value_);
 
-        s = XML_ParseBuffer (p_, static_cast<int> (is.gcount ()), eof);
+          e.line = line_;
+          e.column = column_;
+          e.byte = loc_byte_;
+          return event_ = need_more_input;
+        }
 
-        if (s == XML_STATUS_ERROR)
-          handle_error ();
+        chars_last_ = true;
+        break;
+      }
 
-        if (eof)
-          break;
+      if (front_event ().event != characters)
+      {
+        chars_last_ = true;
+        break;
       }
-    } while (s != XML_STATUS_SUSPENDED);
 
+      if (n == chars_max_)
+        break;
+    }
+
+    chars_size_ = n;
     return event_;
   }
 
-  static void
-  split_name (const XML_Char* s, qname& qn)
+  void parser::
+  characters_chunk (size_t n, char* b)
   {
-    string& ns (qn.namespace_ ());
-    string& name (qn.name ());
-    string& prefix (qn.prefix ());
+    assert (n != 0);
 
-    const char* p (strchr (s, ' '));
+    chars_max_ = n;
+    chars_buf_ = b;
+  }
 
-    if (p == 0)
+  // Parse more input until we have at least one event in the queue or
+  // reach eof. Return false in the latter case as well as if we have
+  // consumed all the input fed so far in the push mode (in which case
+  // also set need_input_).
+  //
+  bool parser::
+  fill ()
+  {
+    // The only way to get here recursively is by calling next() or peek()
+    // from a parse() handler.
+    //
+    if (filling_)
+      throw parsing (*this, "next() or peek() called from parse() handler");
+
+    struct fill_guard
     {
-      ns.clear ();
-      name = s;
-      prefix.clear ();
-    }
-    else
+      fill_guard (bool& f): f_ (f) {f_ = true;}
+      ~fill_guard () {f_ = false;}
+      bool& f_;
+    } fg (filling_);
+
+    need_input_ = false;
+
+    // Any events that were queued before Expat has failed should be
+    // returned before we report the error.
+    //
+    if (error_)
+      handle_error ();
+
+    expat_allocator_guard ag (alloc_);
+
+    while (queue_n_ == 0)
     {
-      ns.assign (s, 0, p - s);
+      XML_ParsingStatus ps;
+      XML_GetParsingStatus (p_, &ps);
 
-      s = p + 1;
-      p = strchr (s, ' ');
+      XML_Status s;
 
-      if (p == 0)
-      {
-        name = s;
-        prefix.clear ();
-      }
-      else
+      switch (ps.parsing)
       {
-        name.assign (s, 0, p - s);
-        prefix = p + 1;
+      case XML_FINISHED:
+        {
+          return false;
+        }
+      case XML_SUSPENDED:
+        {
+          // The queue has reached its limit in the middle of the chunk.
+          // If we are measuring this chunk, then count the time it takes
+          // to parse the rest of it.
+          //
+          if (chunk_cur_ != 0)
+          {
+            using namespace std::chrono;
+
+            steady_clock::time_point t (steady_clock::now ());
+            s = XML_ResumeParser (p_);
+            chunk_cur_time_ += static_cast<unsigned long long> (
+              duration_cast<nanoseconds> (steady_clock::now () - t).count ());
+          }
+          else
+            s = XML_ResumeParser (p_);
+
+          break;
+        }
+      default:
+        {
+          // Get and parse the next chunk of data.
+          //
+          if (input_ != input_stream && input_ != input_src)
+          {
+            const size_t cap (chunk_);
+
+            if (pos_ == size_ && !last_)
+            {
+              if (input_ == input_push)
+              {
+                need_input_ = true;
+                return false;
+              }
+
+              // Move on to the next segment.
+              //
+              const segment& sg (segs_[segs_i_]);
+              data_.buf = sg.data != 0 ? sg.data : "";
+              size_ = sg.size;
+              pos_ = 0;
+              last_ = (++segs_i_ == segs_n_);
+            }
+
+            // Feed the buffer to Expat in chunks which keeps the number of
+            // queued events bounded (and the size within the int range).
+            // Expat parses directly from our buffer unless a chunk ends
+            // in the middle of a token, in which case the leftover and
+            // the next chunk are copied into its internal buffer. To avoid
+            // this we try to end each chunk after '>'.
+            //
+            const char* b (static_cast<const char*> (data_.buf) + pos_);
+            size_t n (size_ - pos_);
+            bool last (n <= cap && last_);
+
+            if (n > cap)
+            {
+              n = cap;
+              for (size_t i (n); i != 0; --i)
+              {
+                if (b[i - 1] == '>')
+                {
+                  n = i;
+                  break;
+                }
+              }
+            }
+
+            pos_ += n;
+            s = XML_Parse (p_, b, static_cast<int> (n), last);
+          }
+          else
+          {
+            using namespace std::chrono;
+
+            // If we are adapting the chunk size, then time reading and
+            // parsing of each chunk (the previous chunk, if any, has been
+            // fully parsed by now).
+            //
+            bool adapt (chunk_max_ > chunk_ &&
+                        (feature_ & partial_reads) == 0);
+
+            if (adapt && chunk_cur_ != 0)
+            {
+              adapt_chunk (chunk_cur_, chunk_cur_time_);
+              chunk_cur_ = 0;
+            }
+
+            const size_t cap (chunk_);
+
+            steady_clock::time_point t;
+            if (adapt)
+              t = steady_clock::now ();
+
+            char* b (static_cast<char*> (XML_GetBuffer (p_, cap)));
+            if (b == 0)
+              throw bad_alloc ();
+
+            size_t n;
+            bool last;
+
+            if (input_ == input_stream)
+            {
+              // Temporarily unset the exception failbit. Also clear the
+              // fail bit when we reset the old state if it was caused by
+              // eof.
+              //
+              istream& is (*data_.is);
+              {
+                stream_exception_controller sec (is);
+
+                if ((feature_ & partial_reads) != 0)
+                {
+                  // Take whatever is already buffered and only block (for
+                  // a single character) if there is nothing.
+                  //
+                  streamsize m (
+                    is.readsome (b, static_cast<streamsize> (cap)));
+
+                  if (m == 0 && !is.eof ())
+                  {
+                    is.read (b, 1);
+
+                    if ((m = is.gcount ()) != 0 && cap != 1)
+                      m += is.readsome (b + 1,
+                                        static_cast<streamsize> (cap - 1));
+                  }
+
+                  n = static_cast<size_t> (m);
+                }
+                else
+                {
+                  is.read (b, static_cast<streamsize> (cap));
+                  n = static_cast<size_t> (is.gcount ());
+                }
+              }
+
+              // If the caller hasn't configured the stream to use
+              // exceptions, then use the parsing exception to report an
+              // error.
+              //
+              if (is.bad () || (is.fail () && !is.eof ()))
+                throw parsing (*this, "io failure");
+
+              last = is.eof ();
+            }
+            else
+            {
+              n = data_.src->read (b, cap);
+              last = (n == 0);
+            }
+
+            s = XML_ParseBuffer (p_, static_cast<int> (n), last);
+
+            if (adapt)
+            {
+              nanoseconds d (
+                duration_cast<nanoseconds> (steady_clock::now () - t));
+
+              chunk_cur_ = n;
+              chunk_cur_time_ = static_cast<unsigned long long> (d.count ());
+            }
+          }
+
+          break;
+        }
+      }
+
+      // Deliver the end element if it can still be followed by the end
+      // namespace declarations (see dispatch_end_element()).
+      //
+      if (end_pending_ && !handler_error_)
+        dispatch_end ();
+
+      if (s == XML_STATUS_ERROR)
+      {
+        // Expat was aborted because of an exception thrown from one of
+        // the parse() handlers.
+        //
+        if (handler_error_)
+        {
+          exception_ptr e (handler_error_);
+          handler_error_ = nullptr;
+          error_ = true;
+          rethrow_exception (e);
+        }
+
+        if (queue_n_ == 0)
+          handle_error ();
+
+        error_ = true;
       }
     }
+
+    return true;
   }
 
-  void XMLCALL parser::
-  start_element_ (void* v, const XML_Char* name, const XML_Char** atts)
+  void parser::
+  feed (const void* data, size_t size, bool last)
   {
-    parser& p (*static_cast<parser*> (v));
+    assert (input_ == input_push && !last_ && pos_ == size_);
 
-    XML_ParsingStatus ps;
-    XML_GetParsingStatus (p.p_, &ps);
+    data_.buf = data != 0 ? data : "";
+    size_ = size;
+    pos_ = 0;
+    last_ = last;
 
-    // Expat has a (mis)-feature of a possibily calling handlers even
-    // after the non-resumable XML_StopParser call.
+    // If we have peeked at need_more_input, then forget about it.
     //
-    if (ps.parsing == XML_FINISHED)
-      return;
+    if (state_ == state_peek && event_ == need_more_input)
+      state_ = state_next;
+  }
 
-    // Cannot be a followup event.
+  void parser::
+  chunk_size (size_t n, size_t max)
+  {
+    // Keep it within the int range that Expat works with.
     //
-    assert (ps.parsing == XML_PARSING);
+    assert (n != 0 && n <= 0x40000000 && max <= 0x40000000);
+
+    chunk_ = n;
+    chunk_max_ = max > n ? max : n;
+    chunk_prev_ = n;
+    chunk_reads_ = 0;
+    chunk_time_ = 0;
+    chunk_rate_ = 0;
+    chunk_cur_ = 0;
+  }
 
-    // When accumulating characters in simple content, we expect to
-    // see more characters or end element. Seeing start element is
-    // possible but means violation of the content model.
+  // Number of reads over which we measure the throughput for each chunk
+  // size.
+  //
+  static const size_t chunk_samples = 4;
+
+  void parser::
+  adapt_chunk (size_t n, unsigned long long ns)
+  {
+    // Ignore short reads (end of stream, etc).
     //
-    if (p.accumulate_)
-    {
-      // It would have been easier to throw the exception directly,
-      // however, the Expat code is most likely not exception safe.
-      //
-      p.line_ = XML_GetCurrentLineNumber (p.p_);
-      p.column_ = XML_GetCurrentColumnNumber (p.p_);
-      XML_StopParser (p.p_, false);
+    if (n != chunk_)
       return;
-    }
 
-    p.event_ = start_element;
-    split_name (name, p.qname_);
+    chunk_time_ += ns;
 
-    p.line_ = XML_GetCurrentLineNumber (p.p_);
-    p.column_ = XML_GetCurrentColumnNumber (p.p_);
+    if (++chunk_reads_ != chunk_samples)
+      return;
 
-    // Handle attributes.
+    double r (static_cast<double> (chunk_ * chunk_samples) /
+              static_cast<double> (chunk_time_ != 0 ? chunk_time_ : 1));
+
+    // Double the chunk size if the throughput has improved by at least 10%.
+    // Otherwise, go back to the previous size (which is not necessarily
+    // half of the current one if the doubling was capped by the maximum)
+    // and stop adapting.
     //
-    if (*atts != 0)
+    if (r > chunk_rate_ * 1.1)
     {
-      bool am ((p.feature_ & receive_attributes_map) != 0);
-      bool ae ((p.feature_ & receive_attributes_event) != 0);
+      chunk_rate_ = r;
+      chunk_prev_ = chunk_;
+      chunk_ = min (chunk_ * 2, chunk_max_);
+    }
+    else
+      chunk_max_ = chunk_ = chunk_prev_;
 
-      // Provision an entry for this element.
+    chunk_reads_ = 0;
+    chunk_time_ = 0;
+  }
+
+  // The maximum number of events we let Expat queue before suspending it.
+  // Note that the handlers may still append a few followup events after
+  // the suspension.
+  //
+  static const size_t event_queue_limit = 256;
+
+  parser::event_entry& parser::
+  push_event (event_type e)
+  {
+    event_queue::size_type n (queue_.size ());
+
+    if (queue_n_ == n)
+    {
+      // Grow the ring buffer making sure the entries stay in order.
       //
-      element_entry* pe (0);
-      if (am)
+      if (queue_b_ != 0)
       {
-        p.element_state_.push_back (element_entry (p.depth_ + 1));
-        pe = &p.element_state_.back ();
+        rotate (queue_.begin (),
+                queue_.begin () + static_cast<ptrdiff_t> (queue_b_),
+                queue_.end ());
+        queue_b_ = 0;
       }
 
-      if (am || ae)
+      queue_.resize (n != 0 ? n * 2 : 16);
+      n = queue_.size ();
+    }
+
+    event_queue::size_type i (queue_b_ + queue_n_);
+    event_entry& r (queue_[i < n ? i : i - n]);
+
+    r.event = e;
+
+    switch (location_)
+    {
+    case location_eager:
       {
-        for (; *atts != 0; atts += 2)
-        {
-          if (am)
-          {
-            qname_type qn;
-            split_name (*atts, qn);
-            attribute_map_type::value_type v (qn, attribute_value_type ());
-            v.second.value = *(atts + 1);
-            v.second.handled = false;
-            pe->attr_map_.insert (v);
-          }
-          else
-          {
-            p.attr_.push_back (attribute_type ());
-            split_name (*atts, p.attr_.back ().qname);
-            p.attr_.back ().value = *(atts + 1);
-          }
-        }
+        r.line = XML_GetCurrentLineNumber (p_);
+        r.column = XML_GetCurrentColumnNumber (p_);
+        break;
+      }
+    case location_lazy:
+      {
+        r.byte = static_cast<unsigned long long> (
+          XML_GetCurrentByteIndex (p_));
+        break;
+      }
+    case location_none:
+      break;
+    }
+
+    if (++queue_n_ == event_queue_limit)
+      XML_StopParser (p_, true);
+
+    return r;
+  }
+
+  void parser::
+  pop_event ()
+  {
+    if (++queue_b_ == queue_.size ())
+      queue_b_ = 0;
+
+    queue_n_--;
+    chars_pos_ = 0;
+  }
+
+  void XMLCALL parser::
+  start_element_ (void* v, const XML_Char* name, const XML_Char** atts)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    bool raw ((p.feature_ & string_views) != 0);
+
+    event_entry& e (p.push_event (start_element));
+
+    if (raw)
+      e.qname.name ().assign (name);
+    else
+      split_name (name, e.qname);
+
+    e.id = p.names_ != 0 ? find_name (*p.names_, name) : 0;
+
+    // Start namespace declarations for this element, if any.
+    //
+    e.ns.clear ();
+    if (!p.queue_ns_.empty ())
+      e.ns.swap (p.queue_ns_);
+
+    // Handle attributes.
+    //
+    e.attr_n = 0;
+    if (*atts != 0 &&
+        (p.feature_ & (receive_attributes_map | receive_attributes_event)))
+    {
+      // Attribute map keys are always split.
+      //
+      if ((p.feature_ & receive_attributes_map) != 0)
+        raw = false;
+
+      for (; *atts != 0; atts += 2)
+      {
+        if (e.attr_n == e.attr.size ())
+          e.attr.push_back (attribute_type ());
 
-        if (am)
-          pe->attr_unhandled_ = pe->attr_map_.size ();
+        attribute_type& a (e.attr[e.attr_n++]);
+
+        if (raw)
+          a.qname.name ().assign (*atts);
+        else
+          split_name (*atts, a.qname);
+
+        a.id = p.names_ != 0 ? find_name (*p.names_, *atts) : 0;
+        a.value = *(atts + 1);
       }
     }
+  }
 
-    XML_StopParser (p.p_, true);
+  void XMLCALL parser::
+  skip_start_element_ (void* v, const XML_Char*, const XML_Char**)
+  {
+    static_cast<parser*> (v)->skip_depth_++;
+  }
+
+  void XMLCALL parser::
+  skip_end_element_ (void* v, const XML_Char*)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    if (--p.skip_depth_ == 0)
+      p.set_handlers ();
   }
 
   void XMLCALL parser::
@@ -792,58 +2062,349 @@ namespace xml
   {
     parser& p (*static_cast<parser*> (v));
 
-    XML_ParsingStatus ps;
-    XML_GetParsingStatus (p.p_, &ps);
+    event_entry& e (p.push_event (end_element));
+
+    if ((p.feature_ & string_views) != 0)
+      e.qname.name ().assign (name);
+    else
+      split_name (name, e.qname);
+
+    e.id = p.names_ != 0 ? find_name (*p.names_, name) : 0;
+    e.ns.clear ();
+  }
+
+  void XMLCALL parser::
+  characters_ (void* v, const XML_Char* s, int n)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    p.push_event (characters).value.assign (s, n);
+  }
+
+  void XMLCALL parser::
+  start_namespace_decl_ (void* v, const XML_Char* prefix, const XML_Char* ns)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    p.queue_ns_.push_back (qname_type ());
+    p.queue_ns_.back ().prefix () = (prefix != 0 ? prefix : "");
+    p.queue_ns_.back ().namespace_ () = (ns != 0 ? ns : "");
+  }
+
+  void XMLCALL parser::
+  end_namespace_decl_ (void* v, const XML_Char* prefix)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    // Expat reports end namespace declarations right after the end
+    // element they belong to, which means it is the last entry in the
+    // queue.
+    //
+    if (p.queue_n_ == 0)
+      return;
+
+    event_queue::size_type i (p.queue_b_ + p.queue_n_ - 1);
+    event_queue::size_type n (p.queue_.size ());
+    event_entry& e (p.queue_[i < n ? i : i - n]);
+
+    if (e.event != end_element)
+      return;
+
+    e.ns.push_back (qname_type ());
+    e.ns.back ().prefix () = (prefix != 0 ? prefix : "");
+  }
+
+  // Callback interface.
+  //
+  void XMLCALL parser::
+  handler_start_element_ (void* v,
+                          const XML_Char* name,
+                          const XML_Char** atts)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    if (p.handler_error_)
+      return;
+
+    try
+    {
+      p.dispatch_start_element (name, atts);
+    }
+    catch (...)
+    {
+      p.dispatch_failed ();
+    }
+  }
+
+  void XMLCALL parser::
+  handler_end_element_ (void* v, const XML_Char* name)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    if (p.handler_error_)
+      return;
+
+    try
+    {
+      p.dispatch_end_element (name);
+    }
+    catch (...)
+    {
+      p.dispatch_failed ();
+    }
+  }
+
+  void XMLCALL parser::
+  handler_characters_ (void* v, const XML_Char* s, int n)
+  {
+    parser& p (*static_cast<parser*> (v));
+
+    if (p.handler_error_)
+      return;
+
+    try
+    {
+      p.dispatch_characters (s, n);
+    }
+    catch (...)
+    {
+      p.dispatch_failed ();
+    }
+  }
+
+  void XMLCALL parser::
+  handler_end_namespace_decl_ (void* v, const XML_Char* prefix)
+  {
+    parser& p (*static_cast<parser*> (v));
 
-    // Expat has a (mis)-feature of a possibily calling handlers even
-    // after the non-resumable XML_StopParser call.
+    // Expat reports end namespace declarations right after the end
+    // element they belong to (see dispatch_end_element()).
     //
-    if (ps.parsing == XML_FINISHED)
+    if (!p.end_pending_)
       return;
 
-    // This can be a followup event for empty elements (<foo/>). In this
-    // case the element name is already set.
+    p.end_ns_.push_back (qname_type ());
+    p.end_ns_.back ().prefix () = (prefix != 0 ? prefix : "");
+  }
+
+  void parser::
+  dispatch_failed ()
+  {
+    // Exceptions cannot be propagated through Expat so save it until
+    // XML_Parse*() returns (see fill()). Note that Expat may still call
+    // some handlers (for example, end element for an empty element) so
+    // they should ignore such calls.
     //
-    if (ps.parsing != XML_PARSING)
-      p.queue_ = end_element;
+    handler_error_ = current_exception ();
+    XML_StopParser (p_, false);
+  }
+
+  void parser::
+  dispatch_start_element (const XML_Char* name, const XML_Char** atts)
+  {
+    if (end_pending_)
+      dispatch_end ();
+
+    // Note that in simple content the accumulated characters are not
+    // delivered if followed by an element unless they are returned in
+    // chunks (see next_body()).
+    //
+    if (!text_.empty () && (feature_ & receive_characters_chunked) != 0)
+      dispatch_text (true);
+
+    if (const element_entry* e = get_element ())
+    {
+      switch (e->content)
+      {
+      case content_type::empty:
+      case content_type::simple:
+        {
+          set_location ();
+          throw parsing (*this,
+                         e->content == content_type::empty
+                         ? "element in empty content"
+                         : "element in simple content");
+        }
+      default:
+        break;
+      }
+    }
+
+    if (!text_.empty ())
+      dispatch_text (true);
+
+    set_location ();
+
+    bool raw ((feature_ & string_views) != 0);
+
+    if (raw)
+      qname_.name ().assign (name);
     else
+      split_name (name, qname_);
+
+    qname_id_ = names_ != 0 ? find_name (*names_, name) : 0;
+
+    // Handle attributes (see start_element_() and next_body()).
+    //
+    if (*atts != 0 &&
+        (feature_ & (receive_attributes_map | receive_attributes_event)))
     {
-      split_name (name, p.qname_);
+      if ((feature_ & receive_attributes_map) != 0)
+      {
+        element_state_.push_back (element_entry (depth_ + 1, attr_stack_n_));
+        element_entry& pe (element_state_.back ());
 
-      // If we are accumulating characters, then queue this event.
-      //
-      if (p.accumulate_)
-        p.queue_ = end_element;
+        for (; *atts != 0; atts += 2)
+        {
+          if (attr_stack_n_ == attr_stack_.size ())
+            attr_stack_.push_back (attribute_slot ());
+
+          attribute_slot& s (attr_stack_[attr_stack_n_++]);
+
+          split_name (*atts, s.entry.first);
+          s.entry.second.value = *(atts + 1);
+          s.entry.second.handled = false;
+          s.id = names_ != 0 ? find_name (*names_, *atts) : 0;
+        }
+
+        pe.attr_e = attr_stack_n_;
+        pe.attr_unhandled_ = pe.attr_e - pe.attr_b;
+      }
       else
       {
-        p.event_ = end_element;
+        for (; *atts != 0; atts += 2)
+        {
+          if (attr_n_ == attr_.size ())
+            attr_.push_back (attribute_type ());
+
+          attribute_type& a (attr_[attr_n_++]);
+
+          if (raw)
+            a.qname.name ().assign (*atts);
+          else
+            split_name (*atts, a.qname);
+
+          a.id = names_ != 0 ? find_name (*names_, *atts) : 0;
+          a.value = *(atts + 1);
+        }
+      }
+    }
+
+    depth_++;
+    event_ = start_element;
+    set_qname (&qname_, qname_id_, raw);
+    handler_->start_element (*this);
+
+    // The handler may have skipped this element, along with its namespace
+    // declarations and attributes.
+    //
+    if (skip_depth_ != 0)
+    {
+      queue_ns_.clear ();
+      return;
+    }
+
+    if (!queue_ns_.empty ())
+    {
+      for (size_t i (0); i != queue_ns_.size (); ++i)
+      {
+        event_ = start_namespace_decl;
+        set_qname (&queue_ns_[i], 0, false);
+        handler_->start_namespace_decl (*this);
+      }
 
-        p.line_ = XML_GetCurrentLineNumber (p.p_);
-        p.column_ = XML_GetCurrentColumnNumber (p.p_);
+      queue_ns_.clear ();
+      set_qname (&qname_, qname_id_, raw);
+    }
+
+    if (attr_n_ != 0)
+    {
+      for (size_t i (0); i != attr_n_; ++i)
+      {
+        attribute_type& a (attr_[i]);
+
+        event_ = start_attribute;
+        set_qname (&a.qname, a.id, raw);
+        handler_->start_attribute (*this);
+
+        event_ = characters;
+        pvalue_ = &a.value;
+        handler_->characters (*this);
+
+        event_ = end_attribute;
+        handler_->end_attribute (*this);
       }
 
-      XML_StopParser (p.p_, true);
+      attr_n_ = 0;
+      pvalue_ = &value_;
+      set_qname (&qname_, qname_id_, raw);
     }
   }
 
-  void XMLCALL parser::
-  characters_ (void* v, const XML_Char* s, int n)
+  void parser::
+  dispatch_end_element (const XML_Char* name)
   {
-    parser& p (*static_cast<parser*> (v));
+    if (end_pending_)
+      dispatch_end ();
 
-    XML_ParsingStatus ps;
-    XML_GetParsingStatus (p.p_, &ps);
+    if (!text_.empty ())
+      dispatch_text (true);
 
-    // Expat has a (mis)-feature of a possibily calling handlers even
-    // after the non-resumable XML_StopParser call.
-    //
-    if (ps.parsing == XML_FINISHED)
-      return;
+    set_location ();
 
-    content_type cont (p.content ());
+    if ((feature_ & string_views) != 0)
+      qname_.name ().assign (name);
+    else
+      split_name (name, qname_);
+
+    qname_id_ = names_ != 0 ? find_name (*names_, name) : 0;
 
-    // If this is empty or complex content, see if these are whitespaces.
+    // The end namespace declarations come before the end element but
+    // Expat reports them after. So if we need them, delay the end element
+    // until the next Expat handler call or until XML_Parse*() returns.
     //
+    end_pending_ = true;
+
+    if ((feature_ & receive_namespace_decls) == 0)
+      dispatch_end ();
+  }
+
+  void parser::
+  dispatch_end ()
+  {
+    end_pending_ = false;
+
+    bool raw ((feature_ & string_views) != 0);
+
+    if (!end_ns_.empty ())
+    {
+      for (size_t i (0); i != end_ns_.size (); ++i)
+      {
+        event_ = end_namespace_decl;
+        set_qname (&end_ns_[i], 0, false);
+        handler_->end_namespace_decl (*this);
+      }
+
+      end_ns_.clear ();
+    }
+
+    if (!element_state_.empty () && element_state_.back ().depth == depth_)
+      pop_element ();
+
+    depth_--;
+    event_ = end_element;
+    set_qname (&qname_, qname_id_, raw);
+    handler_->end_element (*this);
+  }
+
+  void parser::
+  dispatch_characters (const XML_Char* s, int n)
+  {
+    if (end_pending_)
+      dispatch_end ();
+
+    content_type cont (content ());
+
     switch (cont)
     {
     case content_type::empty:
@@ -855,82 +2416,105 @@ namespace xml
           if (c == 0x20 || c == 0x0A || c == 0x0D || c == 0x09)
             continue;
 
-          // It would have been easier to throw the exception directly,
-          // however, the Expat code is most likely not exception safe.
-          //
-          p.line_ = XML_GetCurrentLineNumber (p.p_);
-          p.column_ = XML_GetCurrentColumnNumber (p.p_);
-          XML_StopParser (p.p_, false);
-          break;
+          set_location ();
+          throw parsing (*this,
+                         cont == content_type::empty
+                         ? "characters in empty content"
+                         : "characters in complex content");
         }
-        return;
+
+        return; // Ignore whitespaces.
       }
     default:
       break;
     }
 
-    // Append the characters if we are accumulating. This can also be a
-    // followup event for another character event. In this case also
-    // append the data.
+    bool chunked ((feature_ & receive_characters_chunked) != 0);
+
+    // In simple content we need to accumulate all the characters into a
+    // single event. The same is needed to return them in chunks.
     //
-    if (p.accumulate_ || ps.parsing != XML_PARSING)
+    if (cont == content_type::simple || chunked)
     {
-      assert (p.event_ == characters);
-      p.value_.append (s, n);
+      if (text_.empty ())
+        set_location ();
+
+      text_.append (s, static_cast<size_t> (n));
+
+      if (chunked && text_.size () > chars_max_)
+        dispatch_text (false);
     }
     else
     {
-      p.event_ = characters;
-      p.value_.assign (s, n);
-
-      p.line_ = XML_GetCurrentLineNumber (p.p_);
-      p.column_ = XML_GetCurrentColumnNumber (p.p_);
-
-      // In simple content we need to accumulate all the characters
-      // into a single event. To do this we will let the parser run
-      // until we reach the end of the element.
-      //
-      if (cont == content_type::simple)
-        p.accumulate_ = true;
-      else
-        XML_StopParser (p.p_, true);
+      set_location ();
+      value_.assign (s, static_cast<size_t> (n));
+      event_ = characters;
+      chars_last_ = true;
+      handler_->characters (*this);
     }
   }
 
-  void XMLCALL parser::
-  start_namespace_decl_ (void* v, const XML_Char* prefix, const XML_Char* ns)
+  void parser::
+  dispatch_text (bool last)
   {
-    parser& p (*static_cast<parser*> (v));
+    event_ = characters;
 
-    XML_ParsingStatus ps;
-    XML_GetParsingStatus (p.p_, &ps);
+    if ((feature_ & receive_characters_chunked) == 0)
+    {
+      value_.swap (text_);
+      text_.clear ();
+      chars_last_ = true;
+      handler_->characters (*this);
+      return;
+    }
 
-    // Expat has a (mis)-feature of a possibily calling handlers even
-    // after the non-resumable XML_StopParser call.
+    // Return the text in chunks (see next_chunk()). Unless this is the
+    // last portion, leave the remainder (which is never empty) for later
+    // so that we know which chunk is the last one. This way the text never
+    // exceeds one chunk between the dispatch_characters() calls which
+    // means that only the first chunk can start in one of the previous
+    // fragments while the rest (and the remainder) are in the current one.
     //
-    if (ps.parsing == XML_FINISHED)
-      return;
+    size_t p (0), n (text_.size ());
 
-    p.start_ns_.push_back (qname_type ());
-    p.start_ns_.back ().prefix () = (prefix != 0 ? prefix : "");
-    p.start_ns_.back ().namespace_ () = (ns != 0 ? ns : "");
-  }
+    for (;;)
+    {
+      size_t r (n - p); // Remaining.
 
-  void XMLCALL parser::
-  end_namespace_decl_ (void* v, const XML_Char* prefix)
-  {
-    parser& p (*static_cast<parser*> (v));
+      if (p != 0 && r != 0)
+        set_location ();
 
-    XML_ParsingStatus ps;
-    XML_GetParsingStatus (p.p_, &ps);
+      if (r == 0 || (!last && r <= chars_max_))
+        break;
 
-    // Expat has a (mis)-feature of a possibily calling handlers even
-    // after the non-resumable XML_StopParser call.
-    //
-    if (ps.parsing == XML_FINISHED)
-      return;
+      size_t k (r);
 
-    p.end_ns_.push_back (qname_type ());
-    p.end_ns_.back ().prefix () = (prefix != 0 ? prefix : "");
+      if (k > chars_max_)
+      {
+        // Don't split UTF-8 sequences unless the chunk is too small.
+        //
+        size_t m (chars_max_);
+        for (; m != 0 &&
+               (static_cast<unsigned char> (text_[p + m]) & 0xC0) == 0x80;
+             --m) ;
+
+        k = m != 0 ? m : chars_max_;
+      }
+
+      if (chars_buf_ != 0)
+      {
+        text_.copy (chars_buf_, k, p);
+        value_.clear ();
+      }
+      else
+        value_.assign (text_, p, k);
+
+      p += k;
+      chars_size_ = k;
+      chars_last_ = (p == n && last);
+      handler_->characters (*this);
+    }
+
+    text_.erase (0, p);
   }
 }
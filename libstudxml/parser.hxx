@@ -6,14 +6,20 @@
 
 #include <libstudxml/details/pre.hxx>
 
-#include <map>
 #include <vector>
 #include <string>
 #include <iosfwd>
-#include <cstddef> // std::size_t
+#include <utility>     // std::pair
+#include <cstddef>     // std::size_t
+#include <exception>   // std::exception_ptr
+#include <type_traits> // std::enable_if, std::is_base_of
 
 #include <libstudxml/details/config.hxx>
 
+#ifdef LIBSTUDXML_STRING_VIEW
+#  include <string_view>
+#endif
+
 #ifndef LIBSTUDXML_EXTERNAL_EXPAT
 #  include <libstudxml/details/expat/expat.h>
 #else
@@ -29,7 +35,9 @@
 #include <libstudxml/forward.hxx>
 #include <libstudxml/qname.hxx>
 #include <libstudxml/content.hxx>
+#include <libstudxml/name-table.hxx>
 #include <libstudxml/exception.hxx>
+#include <libstudxml/output-sink.hxx>
 
 #include <libstudxml/details/export.hxx>
 
@@ -80,6 +88,8 @@ namespace xml
   public:
     typedef xml::qname qname_type;
     typedef xml::content content_type;
+    typedef xml::name_table name_table_type;
+    typedef name_table_type::id_type name_id_type;
 
     typedef unsigned short feature_type;
 
@@ -92,6 +102,39 @@ namespace xml
     static const feature_type receive_attributes_event = 0x0008;
     static const feature_type receive_namespace_decls = 0x0010;
 
+    // Do not split element and attribute (as events) names into qnames
+    // unless requested with qname(), namespace_(), name(), or prefix().
+    // Use this feature together with the *_view() accessors below to
+    // avoid copying the names.
+    //
+    static const feature_type string_views = 0x0020;
+
+    // When parsing std::istream, parse whatever input is currently
+    // available in the stream buffer (as reported by in_avail()) instead
+    // of waiting for a complete chunk (see chunk_size()). This way events
+    // are returned as soon as they are complete, which is normally what
+    // we want for pipes and sockets.
+    //
+    static const feature_type partial_reads = 0x0040;
+
+    // Do not keep track of the event locations. With this feature line()
+    // and column() return 0 as do the parsing exceptions thrown by the
+    // parser, except for the XML errors detected by Expat. Use it if the
+    // locations are never reported.
+    //
+    static const feature_type no_locations = 0x0080;
+
+    // Deliver element text (in mixed and simple content) as a sequence of
+    // characters events each containing at most characters_chunk() bytes
+    // with characters_last() indicating the last chunk. This way a large
+    // text node can be processed with bounded memory. Note that the
+    // element() helpers that return the whole text should not be used
+    // with this feature. If the document is malformed after a text, then
+    // the text parsed so far is still returned (with characters_last()
+    // being false) before the error is reported.
+    //
+    static const feature_type receive_characters_chunked = 0x0100;
+
     static const feature_type receive_default = receive_elements |
                                                 receive_characters |
                                                 receive_attributes_map;
@@ -103,9 +146,14 @@ namespace xml
     // exception is used to report io errors (badbit and failbit).
     // Otherwise, those are reported as the parsing exception.
     //
+    // If the allocator is specified, then it is used to allocate the
+    // memory for the underlying Expat parser (see allocator.hxx for
+    // details).
+    //
     parser (std::istream&,
             const std::string& input_name,
-            feature_type = receive_default);
+            feature_type = receive_default,
+            allocator* = 0);
 
     // Parse memory buffer that contains the whole document. Input name
     // is used in diagnostics to identify the document being parsed.
@@ -113,13 +161,146 @@ namespace xml
     parser (const void* data,
             std::size_t size,
             const std::string& input_name,
-            feature_type = receive_default);
+            feature_type = receive_default,
+            allocator* = 0);
+
+    // Parse a document that is split into a sequence of memory buffers
+    // (segments), for example, as received from the network. Each segment
+    // is passed to Expat in turn without first concatenating them. Empty
+    // segments are allowed. Input name is used in diagnostics to identify
+    // the document being parsed.
+    //
+    // Note that neither the segments array nor the segment data are
+    // copied and should remain valid for the lifetime of the parser.
+    //
+    struct segment
+    {
+      const void* data;
+      std::size_t size;
+    };
+
+    parser (const segment* segments,
+            std::size_t count,
+            const std::string& input_name,
+            feature_type = receive_default,
+            allocator* = 0);
+
+    // Parse input_source. Input name is used in diagnostics to identify
+    // the document being parsed.
+    //
+    // Errors reported by the input source are propagated as is.
+    //
+    parser (input_source&,
+            const std::string& input_name,
+            feature_type = receive_default,
+            allocator* = 0);
+
+    // Parse input pushed with feed() (push mode). Input name is used in
+    // diagnostics to identify the document being parsed. The push_mode
+    // tag makes sure that this mode is not selected by mistake, for
+    // example, with parser("file.xml").
+    //
+    // In this mode next() and peek() return the need_more_input event
+    // instead of blocking once the input fed so far has been consumed.
+    // Note that next_expect() and other helpers that expect a specific
+    // event will fail in this case so they should only be used on
+    // elements that are known to be completely fed.
+    //
+    struct push_mode_t {};
+    static const push_mode_t push_mode;
+
+    parser (push_mode_t,
+            const std::string& input_name,
+            feature_type = receive_default,
+            allocator* = 0);
+
+    // Feed the next chunk of input in the push mode. The last argument
+    // indicates that this is the last chunk (its size can be 0). The data
+    // is not copied and should remain valid until next() or peek()
+    // returns need_more_input, eof, or throws.
+    //
+    void
+    feed (const void* data, std::size_t size, bool last = false);
 
     const std::string&
     input_name () const {return iname_;}
 
     ~parser ();
 
+    // Reset the parser to parse a new document. The result is equivalent
+    // to constructing a new parser with the same arguments except that the
+    // underlying Expat parser as well as the memory allocated for the
+    // internal state (event queue, attributes, etc) are reused. This makes
+    // parsing a large number of small documents significantly cheaper. See
+    // also parser_pool.
+    //
+    // The parser can be reset at any point, including after an exception.
+    // Note that the allocator cannot be changed and the one passed to the
+    // constructor continues to be used.
+    //
+    void
+    reset (std::istream&,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+    void
+    reset (const void* data,
+           std::size_t size,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+    void
+    reset (const segment* segments,
+           std::size_t count,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+    void
+    reset (input_source&,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+    void
+    reset (push_mode_t,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+    // Input chunk size. When parsing std::istream or input_source, this is
+    // the (maximum) amount of data read at once. When parsing a memory
+    // buffer (including segments and push input), this is the maximum
+    // amount of data passed to Expat at once (which also bounds the number
+    // of events queued by the parser). The default is 4096 bytes.
+    //
+    // If max is greater than size, then for std::istream and input_source
+    // the chunk size is adaptive: starting from size it is doubled, up to
+    // max, for as long as the throughput of reading and parsing the input
+    // keeps improving.
+    //
+    // The chunk size can be changed at any time and takes effect starting
+    // from the next chunk.
+    //
+    void
+    chunk_size (std::size_t size, std::size_t max = 0);
+
+    std::size_t
+    chunk_size () const {return chunk_;}
+
+    // Characters chunk size for the receive_characters_chunked feature.
+    // The default is 65536 bytes. Chunks end at UTF-8 character boundaries
+    // unless the size is less than 4.
+    //
+    // If the buffer is specified, then it should be at least size bytes
+    // long and the chunks are copied into it instead of value() (which
+    // remains empty). In this case use characters_size() to get the chunk
+    // size. Note that attribute values (receive_attributes_event) are not
+    // chunked and are always returned with value().
+    //
+    void
+    characters_chunk (std::size_t size, char* buffer = 0);
+
+    std::size_t
+    characters_chunk () const {return chars_max_;}
+
   private:
     parser (const parser&);
     parser& operator= (const parser&);
@@ -138,7 +319,8 @@ namespace xml
       characters,
       start_namespace_decl,
       end_namespace_decl,
-      eof
+      eof,
+      need_more_input // Push mode only (see feed()).
     };
 
     event_type
@@ -159,9 +341,40 @@ namespace xml
     void
     next_expect (event_type, const std::string& ns, const std::string& name);
 
+    void
+    next_expect (event_type, name_id_type);
+
     event_type
     peek ();
 
+    // Skip the rest of the current element, including its end element.
+    // The last event returned should be start_element (otherwise the
+    // parsing exception is thrown) and after this call the current event
+    // is end_element. The skipped element's attributes are considered
+    // handled.
+    //
+    // Note that the namespace declarations of the skipped element are
+    // discarded as well, both start and end, so that with
+    // receive_namespace_decls the returned declaration events remain
+    // balanced.
+    //
+    // The content of the skipped element is discarded without producing
+    // events (or splitting names, copying characters, etc). Note, however,
+    // that it is still checked for well-formedness by Expat.
+    //
+    // In the push mode, the skipping continues on subsequent calls to
+    // next() (which may return need_more_input) if the element end hasn't
+    // been fed yet.
+    //
+    void
+    skip ();
+
+    // Get the next event, which should be start_element, and skip it (see
+    // skip() for details).
+    //
+    void
+    next_skip ();
+
     // Return the even that was last returned by the call to next() or
     // peek().
     //
@@ -171,18 +384,63 @@ namespace xml
     // Event data.
     //
   public:
-    const qname_type& qname () const {return *pqname_;}
+    const qname_type& qname () const
+    {
+      return praw_ == 0 ? *pqname_ : split_qname ();
+    }
 
-    const std::string& namespace_ () const {return pqname_->namespace_ ();}
-    const std::string& name () const {return pqname_->name ();}
-    const std::string& prefix () const {return pqname_->prefix ();}
+    const std::string& namespace_ () const {return qname ().namespace_ ();}
+    const std::string& name () const {return qname ().name ();}
+    const std::string& prefix () const {return qname ().prefix ();}
 
     std::string& value () {return *pvalue_;}
     const std::string& value () const {return *pvalue_;}
     template <typename T> T value () const;
 
-    unsigned long long line () const {return line_;}
-    unsigned long long column () const {return column_;}
+    // Size of the characters event data, in value() or in the buffer
+    // specified with characters_chunk(), and whether it is the last chunk
+    // of text (always true unless receive_characters_chunked is specified).
+    //
+    std::size_t characters_size () const;
+    bool characters_last () const {return chars_last_;}
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    // Event data as string views that are valid until the next call to
+    // next() or peek(). In the string_views mode these functions return
+    // parts of the unsplit name without copying.
+    //
+    std::string_view namespace_view () const;
+    std::string_view name_view () const;
+    std::string_view prefix_view () const;
+
+    std::string_view value_view () const {return *pvalue_;}
+#endif
+
+    // Name ids. If the name table is specified, then element and attribute
+    // names found in the table are assigned their ids which can then be
+    // compared (or switched on) instead of names. The name id of the
+    // current event is unknown (0) if the name is not in the table or if
+    // there is no name (characters, namespace declarations, etc).
+    //
+    // The table should be specified before the first call to next() and
+    // should outlive the parser. Since the parser does not modify the
+    // table, it can be shared by multiple parsers, including those running
+    // in different threads.
+    //
+    void names (const name_table_type& t) {names_ = &t;}
+    const name_table_type* names () const {return names_;}
+
+    name_id_type name_id () const {return name_id_;}
+
+    // Location of the current event. When parsing a memory buffer or
+    // segments, only the byte offset of each event is recorded and it is
+    // converted to the line and column when requested.
+    //
+    unsigned long long
+    line () const {if (loc_pending_) locate (); return line_;}
+
+    unsigned long long
+    column () const {if (loc_pending_) locate (); return column_;}
 
     // Attribute map lookup. If attribute is not found, then the version
     // without the default value throws an appropriate parsing exception
@@ -233,6 +491,26 @@ namespace xml
     bool
     attribute_present (const qname_type& qname) const;
 
+    // Versions that look up the attribute by its name id. Require the name
+    // table.
+    //
+    const std::string&
+    attribute (name_id_type) const;
+
+    template <typename T>
+    T
+    attribute (name_id_type) const;
+
+    std::string
+    attribute (name_id_type, const std::string& default_value) const;
+
+    template <typename T>
+    T
+    attribute (name_id_type, const T& default_value) const;
+
+    bool
+    attribute_present (name_id_type) const;
+
     // Low-level attribute map access. Note that this API assumes
     // all attributes are handled.
     //
@@ -242,9 +520,101 @@ namespace xml
       mutable bool handled;
     };
 
-    typedef std::map<qname_type, attribute_value_type> attribute_map_type;
+  private:
+    struct attribute_slot
+    {
+      std::pair<qname_type, attribute_value_type> entry;
+      name_id_type id;
+    };
+
+    typedef std::vector<attribute_slot> attribute_slots;
+
+  public:
+    // The attribute map is a lightweight view of the parser's attribute
+    // storage that provides a subset of the std::map interface. Attributes
+    // are stored in the document order in a flat array which is reused
+    // between elements. The map is valid for as long as the attribute
+    // lookup functions above are while its iterators are only valid until
+    // the next call to next() or peek().
+    //
+    class attribute_map_type
+    {
+    public:
+      typedef parser::qname_type key_type;
+      typedef parser::attribute_value_type mapped_type;
+      typedef std::pair<qname_type, attribute_value_type> value_type;
+      typedef std::size_t size_type;
+
+      class const_iterator
+      {
+      public:
+        typedef attribute_map_type::value_type value_type;
+        typedef const value_type& reference;
+        typedef const value_type* pointer;
+
+        const_iterator (): p_ (0) {}
+
+        reference operator* () const {return p_->entry;}
+        pointer operator-> () const {return &p_->entry;}
+
+        // Attribute name id in the parser's name table (see names()) or
+        // unknown if there is none.
+        //
+        name_id_type id () const {return p_->id;}
+
+        const_iterator& operator++ () {++p_; return *this;}
+        const_iterator& operator-- () {--p_; return *this;}
+
+        const_iterator
+        operator++ (int) {const_iterator r (*this); ++p_; return r;}
+
+        const_iterator
+        operator-- (int) {const_iterator r (*this); --p_; return r;}
 
-    const attribute_map_type&
+        friend bool
+        operator== (const_iterator x, const_iterator y) {return x.p_ == y.p_;}
+
+        friend bool
+        operator!= (const_iterator x, const_iterator y) {return x.p_ != y.p_;}
+
+      private:
+        friend class attribute_map_type;
+        explicit const_iterator (const attribute_slot* p): p_ (p) {}
+
+        const attribute_slot* p_;
+      };
+
+      typedef const_iterator iterator;
+
+      attribute_map_type (): slots_ (0), b_ (0), e_ (0) {}
+
+      const_iterator begin () const {return const_iterator (data () + b_);}
+      const_iterator end () const {return const_iterator (data () + e_);}
+
+      size_type size () const {return e_ - b_;}
+      bool empty () const {return e_ == b_;}
+
+      const_iterator
+      find (const key_type&) const;
+
+      size_type
+      count (const key_type& k) const {return find (k) != end () ? 1 : 0;}
+
+    private:
+      friend class parser;
+
+      attribute_map_type (const attribute_slots& s, size_type b, size_type e)
+          : slots_ (&s), b_ (b), e_ (e) {}
+
+      const attribute_slot*
+      data () const {return slots_ != 0 ? slots_->data () : 0;}
+
+      const attribute_slots* slots_;
+      size_type b_;
+      size_type e_;
+    };
+
+    attribute_map_type
     attribute_map () const;
 
     // Optional content processing.
@@ -271,6 +641,9 @@ namespace xml
                  const std::string& ns, const std::string& name,
                  content_type);
 
+    void
+    next_expect (event_type, name_id_type, content_type);
+
     // Helpers for parsing elements with simple content. The first two
     // functions assume that start_element has already been parsed. The
     // rest parse the complete element, from start to end.
@@ -314,6 +687,34 @@ namespace xml
     T
     element (const qname_type& qname, const T& default_value);
 
+    // Parse the content of the current element (similar to element()) as
+    // base64 or hex-encoded binary data and write the decoded data to the
+    // sink or the output iterator (the latter version returns the iterator
+    // past the last byte written). The text is decoded as it is parsed
+    // (see receive_characters_chunked) so that neither it nor the decoded
+    // data are kept in memory as a whole. Whitespaces in the text are
+    // ignored.
+    //
+    // In the push mode, the input up to and including the element end
+    // should have been fed before calling these functions since they
+    // cannot return need_more_input. If they run out of input, the
+    // parsing exception is thrown (and the data decoded so far has already
+    // been written).
+    //
+    void
+    element_base64 (output_sink&);
+
+    template <typename O>
+    typename std::enable_if<!std::is_base_of<output_sink, O>::value, O>::type
+    element_base64 (O);
+
+    void
+    element_hex (output_sink&);
+
+    template <typename O>
+    typename std::enable_if<!std::is_base_of<output_sink, O>::value, O>::type
+    element_hex (O);
+
     // C++11 range-based for support. Generally, the iterator interface
     // doesn't make much sense for the parser so for now we have an
     // implementation that is just enough to the range-based for.
@@ -340,16 +741,98 @@ namespace xml
     iterator begin () {return iterator (this, next ());}
     iterator end () {return iterator (this, eof);}
 
+    // Callback (SAX-like) interface. Instead of pulling events with next(),
+    // parse() delivers them by calling the corresponding handler functions
+    // until eof or, in the push mode, until more input is needed (the
+    // return value indicates which). The same content model, whitespace,
+    // and attribute processing apply and the handler functions can query
+    // the current event data (qname(), value(), attribute(), etc) as well
+    // as set the content model with content(). Exceptions thrown by the
+    // handler functions are propagated to the caller of parse() after
+    // which the parser can only be reset.
+    //
+    // The handler functions are called directly from the Expat handlers,
+    // bypassing the event queue, which makes this interface faster than
+    // next(). As a result, they should not call next(), peek(), or the
+    // helpers that call them, such as element() (the parsing exception is
+    // thrown if they do), though start_element() can call skip(). Note
+    // also that end_element() is called after the end namespace
+    // declarations are reported by Expat which happens after the end of
+    // the current input chunk at the latest.
+    //
+    // Events that have been peeked at or queued by next() before the call
+    // are delivered first.
+    //
+  public:
+    class LIBSTUDXML_EXPORT handler
+    {
+    public:
+      virtual
+      ~handler ();
+
+      virtual void
+      start_element (parser&) {}
+
+      virtual void
+      end_element (parser&) {}
+
+      // Only called if the receive_attributes_event feature is specified.
+      //
+      virtual void
+      start_attribute (parser&) {}
+
+      virtual void
+      end_attribute (parser&) {}
+
+      // Element or attribute characters.
+      //
+      virtual void
+      characters (parser&) {}
+
+      // Only called if the receive_namespace_decls feature is specified.
+      //
+      virtual void
+      start_namespace_decl (parser&) {}
+
+      virtual void
+      end_namespace_decl (parser&) {}
+    };
+
+    event_type
+    parse (handler&);
+
   private:
     static void XMLCALL
     start_element_ (void*, const XML_Char*, const XML_Char**);
 
+    // Handlers that are used by parse().
+    //
+    static void XMLCALL
+    handler_start_element_ (void*, const XML_Char*, const XML_Char**);
+
+    static void XMLCALL
+    handler_end_element_ (void*, const XML_Char*);
+
+    static void XMLCALL
+    handler_characters_ (void*, const XML_Char*, int);
+
+    static void XMLCALL
+    handler_end_namespace_decl_ (void*, const XML_Char*);
+
     static void XMLCALL
     end_element_ (void*, const XML_Char*);
 
     static void XMLCALL
     characters_ (void*, const XML_Char*, int);
 
+    // Handlers that are used while skipping elements (see skip()).
+    //
+    static void XMLCALL
+    skip_start_element_ (void*, const XML_Char*, const XML_Char**);
+
+    static void XMLCALL
+    skip_end_element_ (void*, const XML_Char*);
+
     static void XMLCALL
     start_namespace_decl_ (void*, const XML_Char*, const XML_Char*);
 
@@ -360,35 +843,89 @@ namespace xml
     void
     init ();
 
+    void
+    set_handlers ();
+
     event_type
     next_ (bool peek);
 
     event_type
     next_body ();
 
+    bool
+    fill ();
+
+    void
+    adapt_chunk (std::size_t bytes, unsigned long long ns);
+
     void
     handle_error ();
 
+    // Set the current name and its id. If raw is true, then the name is
+    // stored unsplit in qname.name() (see the string_views feature).
+    //
+    void
+    set_qname (const qname_type*, name_id_type, bool raw);
+
+    const qname_type&
+    split_qname () const;
+
+    bool
+    qname_equal (const std::string& ns, const std::string& name) const;
+
   private:
-    // If size_ is 0, then data is std::istream. Otherwise, it is a buffer.
+    // For the buffer, segments, and push inputs data is the current buffer
+    // and last_ indicates whether it is the last one (always true for the
+    // buffer input).
     //
+    enum input_type
+    {
+      input_stream,
+      input_buffer,
+      input_segments,
+      input_push,
+      input_src
+    } input_;
+
+    const segment* segs_;
+    std::size_t segs_n_;
+    std::size_t segs_i_; // Index of the next segment.
+
     union
     {
       std::istream* is;
       const void* buf;
+      xml::input_source* src;
     } data_;
 
     std::size_t size_;
+    std::size_t pos_; // Position of the next chunk in the buffer.
+    bool last_;
+    bool need_input_; // Push input has been consumed (see fill()).
+
+    // Input chunk size. If chunk_max_ is greater than chunk_, then we are
+    // adapting the chunk size (see adapt_chunk() for details).
+    //
+    std::size_t chunk_;
+    std::size_t chunk_max_;
+    std::size_t chunk_prev_;        // Size before the last doubling.
+    std::size_t chunk_reads_;       // Chunks measured with the current size.
+    unsigned long long chunk_time_; // Time (in ns) taken by these chunks.
+    double chunk_rate_;             // Throughput with the previous size.
 
-    const std::string iname_;
+    std::size_t chunk_cur_;             // Chunk being measured, if not 0.
+    unsigned long long chunk_cur_time_; // Time taken by it so far.
+
+    std::string iname_;
     feature_type feature_;
+    allocator* alloc_;
 
     XML_Parser p_;
     std::size_t depth_;
-    bool accumulate_; // Whether we are accumulating character content.
+    std::size_t skip_depth_; // Depth of the element being skipped, if any.
+    bool error_; // Whether Expat has failed (error is reported lazily).
     enum {state_next, state_peek} state_;
     event_type event_;
-    event_type queue_;
 
     qname_type qname_;
     std::string value_;
@@ -396,23 +933,65 @@ namespace xml
     // These are used to avoid copying when we are handling attributes
     // and namespace decls.
     //
-    const qname_type* pqname_;
+    mutable const qname_type* pqname_;
     std::string* pvalue_;
 
-    unsigned long long line_;
-    unsigned long long column_;
+    // Unsplit name in the "<namespace> <name> <prefix>" Expat form and the
+    // positions of the separators in it (npos if absent). If praw_ is not
+    // NULL, then pqname_ is not valid and the name is split into qsplit_
+    // on demand.
+    //
+    mutable const std::string* praw_;
+    std::size_t raw_ns_;
+    std::size_t raw_name_;
+    mutable qname_type qsplit_;
+
+    const name_table_type* names_;
+    name_id_type name_id_;  // Current name id.
+    name_id_type qname_id_; // Id of qname_.
+
+    // Location of the current event. If loc_pending_ is true, then only
+    // its byte offset (loc_byte_) is known and line_ and column_ are
+    // calculated on demand (see locate()).
+    //
+    enum {location_none, location_eager, location_lazy} location_;
+
+    mutable unsigned long long line_;
+    mutable unsigned long long column_;
+    unsigned long long loc_byte_;
+    mutable bool loc_pending_;
+
+    // Forward-only cursor over the input (segment index, position in the
+    // segment, byte offset, line, and column) used to calculate the
+    // locations in the lazy mode. The buffer input is treated as a single
+    // segment.
+    //
+    mutable std::size_t cur_seg_;
+    mutable std::size_t cur_pos_;
+    mutable unsigned long long cur_byte_;
+    mutable unsigned long long cur_line_;
+    mutable unsigned long long cur_column_;
+    mutable bool cur_cr_; // Last scanned byte was CR.
+
+    void
+    locate () const;
 
     // Attributes as events.
     //
     struct attribute_type
     {
       qname_type qname;
+      name_id_type id;
       std::string value;
     };
 
     typedef std::vector<attribute_type> attributes;
 
+    // Note that only the first attr_n_ entries are valid (the rest are
+    // kept in order to reuse memory).
+    //
     attributes attr_;
+    attributes::size_type attr_n_;
     attributes::size_type attr_i_; // Index of the current attribute.
 
     // Namespace declarations.
@@ -425,25 +1004,148 @@ namespace xml
     namespace_decls end_ns_;
     namespace_decls::size_type end_ns_i_; // Index of the current decl.
 
+    // Event queue. Instead of suspending Expat after every event, the
+    // handlers append events to this queue and we let Expat run until
+    // the end of the current chunk (or until the queue reaches a certain
+    // size). The next_body() function then takes events off the queue.
+    //
+    // The queue is a ring buffer. The entries (including their strings)
+    // are reused in order to avoid allocations in the steady state.
+    //
+    struct event_entry
+    {
+      event_type event; // start/end_element or characters.
+      qname_type qname;
+      name_id_type id;
+      std::string value;
+      unsigned long long line;   // In the eager location mode.
+      unsigned long long column;
+      unsigned long long byte;   // In the lazy location mode.
+
+      // Attributes for start_element. Note that only the first attr_n
+      // entries are valid (the rest are kept in order to reuse memory).
+      //
+      attributes attr;
+      attributes::size_type attr_n;
+
+      namespace_decls ns; // Start/end namespace decls for start/end_element.
+    };
+
+    typedef std::vector<event_entry> event_queue;
+
+    event_queue queue_;
+    event_queue::size_type queue_b_; // Index of the first entry.
+    event_queue::size_type queue_n_; // Number of entries.
+
+    // Start namespace declarations are reported by Expat before the start
+    // element they belong to.
+    //
+    namespace_decls queue_ns_;
+
+    event_entry&
+    push_event (event_type);
+
+    event_entry&
+    front_event () {return queue_[queue_b_];}
+
+    void
+    set_location (const event_entry&);
+
+    // Set the location of the current event from Expat.
+    //
+    void
+    set_location ();
+
+    // Characters chunking (see receive_characters_chunked).
+    //
+    std::size_t chars_max_;
+    char* chars_buf_;
+    std::size_t chars_size_; // Size of the current chunk in chars_buf_.
+    std::size_t chars_pos_;  // Consumed part of the front event value.
+    bool chars_last_;
+
+    event_type
+    next_chunk ();
+
+    // Callback interface state (see parse()). While handler_ is not NULL,
+    // the handler_*_() Expat handlers call the dispatch_*() functions
+    // which in turn call the handler functions.
+    //
+    handler* handler_;
+    std::exception_ptr handler_error_; // Exception thrown inside Expat.
+    std::string text_; // Text accumulated in simple content or for chunking.
+    bool end_pending_; // End element waits for its end namespace decls.
+    bool filling_;     // Inside fill().
+
+    void
+    dispatch_start_element (const XML_Char*, const XML_Char**);
+
+    void
+    dispatch_end_element (const XML_Char*);
+
+    void
+    dispatch_characters (const XML_Char*, int);
+
+    // Deliver the accumulated text. Unless last is true, only deliver
+    // full chunks leaving the rest for later.
+    //
+    void
+    dispatch_text (bool last);
+
+    // Deliver the pending end element preceded by its end namespace
+    // declarations.
+    //
+    void
+    dispatch_end ();
+
+    // Save the current exception and abort Expat.
+    //
+    void
+    dispatch_failed ();
+
+    void
+    element_binary (output_sink&, bool base64);
+
+    void
+    pop_event ();
+
     // Element state consisting of the content model and attribute map.
+    // The element's attributes are stored in attr_stack_ in the [attr_b,
+    // attr_e) range.
     //
     struct element_entry
     {
-      element_entry (std::size_t d, content_type c = content_type::mixed)
-          : depth (d), content (c), attr_unhandled_ (0) {}
+      element_entry (std::size_t d,
+                     std::size_t a,
+                     content_type c = content_type::mixed)
+          : depth (d), content (c), attr_b (a), attr_e (a),
+            attr_unhandled_ (0) {}
 
       std::size_t depth;
       content_type content;
-      attribute_map_type attr_map_;
-      mutable attribute_map_type::size_type attr_unhandled_;
+      std::size_t attr_b;
+      std::size_t attr_e;
+      mutable std::size_t attr_unhandled_;
     };
 
     typedef std::vector<element_entry> element_state;
     std::vector<element_entry> element_state_;
 
-    // Empty attribute map to return when an element has no attributes.
+    // Attribute maps of all the elements in element_state_. Since elements
+    // are nested, this is a stack. The entries past attr_stack_n_ are kept
+    // in order to reuse their memory.
     //
-    const attribute_map_type empty_attr_map_;
+    attribute_slots attr_stack_;
+    attribute_slots::size_type attr_stack_n_;
+
+    // Find the attribute of the current element marking it as handled.
+    // Return NULL if not found.
+    //
+    const attribute_value_type*
+    find_attribute (const qname_type&) const;
+
+    const attribute_value_type*
+    find_attribute (name_id_type) const;
 
     // Return the element entry corresponding to the current depth, if
     // exists, and NULL otherwise.
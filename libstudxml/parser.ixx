@@ -32,8 +32,17 @@ namespace xml
   // parser
   //
   inline parser::
-  parser (std::istream& is, const std::string& iname, feature_type f)
-      : size_ (0), iname_ (iname), feature_ (f)
+  parser (std::istream& is,
+          const std::string& iname,
+          feature_type f,
+          allocator* a)
+      : input_ (input_stream),
+        size_ (0),
+        last_ (false),
+        iname_ (iname),
+        feature_ (f),
+        alloc_ (a),
+        p_ (0)
   {
     data_.is = &is;
     init ();
@@ -43,12 +52,146 @@ namespace xml
   parser (const void* data,
           std::size_t size,
           const std::string& iname,
-          feature_type f)
-      : size_ (size), iname_ (iname), feature_ (f)
+          feature_type f,
+          allocator* a)
+      : input_ (input_buffer),
+        size_ (size),
+        last_ (true),
+        iname_ (iname),
+        feature_ (f),
+        alloc_ (a),
+        p_ (0)
+  {
+    assert (data != 0 && size != 0);
+
+    data_.buf = data;
+    init ();
+  }
+
+  inline parser::
+  parser (const segment* segs,
+          std::size_t n,
+          const std::string& iname,
+          feature_type f,
+          allocator* a)
+      : input_ (input_segments),
+        segs_ (segs),
+        segs_n_ (n),
+        segs_i_ (0),
+        size_ (0),
+        last_ (false),
+        iname_ (iname),
+        feature_ (f),
+        alloc_ (a),
+        p_ (0)
+  {
+    assert (segs != 0 && n != 0);
+
+    data_.buf = 0;
+    init ();
+  }
+
+  inline parser::
+  parser (input_source& src,
+          const std::string& iname,
+          feature_type f,
+          allocator* a)
+      : input_ (input_src),
+        size_ (0),
+        last_ (false),
+        iname_ (iname),
+        feature_ (f),
+        alloc_ (a),
+        p_ (0)
+  {
+    data_.src = &src;
+    init ();
+  }
+
+  inline parser::
+  parser (push_mode_t, const std::string& iname, feature_type f, allocator* a)
+      : input_ (input_push),
+        size_ (0),
+        last_ (false),
+        iname_ (iname),
+        feature_ (f),
+        alloc_ (a),
+        p_ (0)
+  {
+    data_.buf = 0;
+    init ();
+  }
+
+  inline void parser::
+  reset (std::istream& is, const std::string& iname, feature_type f)
+  {
+    input_ = input_stream;
+    data_.is = &is;
+    size_ = 0;
+    last_ = false;
+    iname_ = iname;
+    feature_ = f;
+    init ();
+  }
+
+  inline void parser::
+  reset (const void* data,
+         std::size_t size,
+         const std::string& iname,
+         feature_type f)
   {
     assert (data != 0 && size != 0);
 
+    input_ = input_buffer;
     data_.buf = data;
+    size_ = size;
+    last_ = true;
+    iname_ = iname;
+    feature_ = f;
+    init ();
+  }
+
+  inline void parser::
+  reset (const segment* segs,
+         std::size_t n,
+         const std::string& iname,
+         feature_type f)
+  {
+    assert (segs != 0 && n != 0);
+
+    input_ = input_segments;
+    segs_ = segs;
+    segs_n_ = n;
+    segs_i_ = 0;
+    data_.buf = 0;
+    size_ = 0;
+    last_ = false;
+    iname_ = iname;
+    feature_ = f;
+    init ();
+  }
+
+  inline void parser::
+  reset (input_source& src, const std::string& iname, feature_type f)
+  {
+    input_ = input_src;
+    data_.src = &src;
+    size_ = 0;
+    last_ = false;
+    iname_ = iname;
+    feature_ = f;
+    init ();
+  }
+
+  inline void parser::
+  reset (push_mode_t, const std::string& iname, feature_type f)
+  {
+    input_ = input_push;
+    data_.buf = 0;
+    size_ = 0;
+    last_ = false;
+    iname_ = iname;
+    feature_ = f;
     init ();
   }
 
@@ -65,6 +208,66 @@ namespace xml
     }
   }
 
+#ifdef LIBSTUDXML_STRING_VIEW
+  inline std::string_view parser::
+  namespace_view () const
+  {
+    if (praw_ == 0)
+      return pqname_->namespace_ ();
+
+    return raw_ns_ == std::string::npos
+      ? std::string_view ()
+      : std::string_view (praw_->data (), raw_ns_);
+  }
+
+  inline std::string_view parser::
+  name_view () const
+  {
+    if (praw_ == 0)
+      return pqname_->name ();
+
+    std::string_view r (*praw_);
+
+    if (raw_ns_ != std::string::npos)
+      r = raw_name_ == std::string::npos
+        ? r.substr (raw_ns_ + 1)
+        : r.substr (raw_ns_ + 1, raw_name_ - raw_ns_ - 1);
+
+    return r;
+  }
+
+  inline std::string_view parser::
+  prefix_view () const
+  {
+    if (praw_ == 0)
+      return pqname_->prefix ();
+
+    return raw_name_ == std::string::npos
+      ? std::string_view ()
+      : std::string_view (*praw_).substr (raw_name_ + 1);
+  }
+#endif
+
+  inline void parser::
+  element_base64 (output_sink& s)
+  {
+    element_binary (s, true);
+  }
+
+  inline void parser::
+  element_hex (output_sink& s)
+  {
+    element_binary (s, false);
+  }
+
+  inline std::size_t parser::
+  characters_size () const
+  {
+    return chars_buf_ != 0 && pvalue_ == &value_
+      ? chars_size_
+      : pvalue_->size ();
+  }
+
   template <typename T>
   inline T parser::
   value () const
@@ -111,22 +314,55 @@ namespace xml
     return value_traits<T>::parse (attribute (qn), *this);
   }
 
+  template <typename T>
+  inline T parser::
+  attribute (name_id_type id) const
+  {
+    return value_traits<T>::parse (attribute (id), *this);
+  }
+
   inline bool parser::
   attribute_present (const std::string& n) const
   {
     return attribute_present (qname_type (n));
   }
 
-  inline const parser::attribute_map_type& parser::
+  inline std::string parser::
+  attribute (const qname_type& qn, const std::string& dv) const
+  {
+    const attribute_value_type* v (find_attribute (qn));
+    return v != 0 ? v->value : dv;
+  }
+
+  inline bool parser::
+  attribute_present (const qname_type& qn) const
+  {
+    return find_attribute (qn) != 0;
+  }
+
+  inline std::string parser::
+  attribute (name_id_type id, const std::string& dv) const
+  {
+    const attribute_value_type* v (find_attribute (id));
+    return v != 0 ? v->value : dv;
+  }
+
+  inline bool parser::
+  attribute_present (name_id_type id) const
+  {
+    return find_attribute (id) != 0;
+  }
+
+  inline parser::attribute_map_type parser::
   attribute_map () const
   {
     if (const element_entry* e = get_element ())
     {
       e->attr_unhandled_ = 0; // Assume all handled.
-      return e->attr_map_;
+      return attribute_map_type (attr_stack_, e->attr_b, e->attr_e);
     }
 
-    return empty_attr_map_;
+    return attribute_map_type ();
   }
 
   inline void parser::
@@ -197,7 +433,7 @@ namespace xml
     if (!element_state_.empty () && element_state_.back ().depth == depth_)
       element_state_.back ().content = c;
     else
-      element_state_.push_back (element_entry (depth_, c));
+      element_state_.push_back (element_entry (depth_, attr_stack_n_, c));
   }
 
   inline parser::content_type parser::
@@ -236,4 +472,12 @@ namespace xml
     next_expect (e, ns, n);
     content (c);
   }
+
+  inline void parser::
+  next_expect (event_type e, name_id_type id, content_type c)
+  {
+    assert (e == start_element);
+    next_expect (e, id);
+    content (c);
+  }
 }
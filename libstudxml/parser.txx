@@ -1,37 +1,66 @@
 // file      : libstudxml/parser.txx
 // license   : MIT; see accompanying LICENSE file
 
+#include <algorithm> // std::copy
+
 #include <libstudxml/value-traits.hxx>
 
 namespace xml
 {
+  template <typename O>
+  typename std::enable_if<!std::is_base_of<output_sink, O>::value, O>::type
+  parser::
+  element_base64 (O o)
+  {
+    callback_output_sink s (
+      [&o] (const void* d, std::size_t n)
+      {
+        const unsigned char* p (static_cast<const unsigned char*> (d));
+        o = std::copy (p, p + n, o);
+      });
+
+    element_binary (s, true);
+    return o;
+  }
+
+  template <typename O>
+  typename std::enable_if<!std::is_base_of<output_sink, O>::value, O>::type
+  parser::
+  element_hex (O o)
+  {
+    callback_output_sink s (
+      [&o] (const void* d, std::size_t n)
+      {
+        const unsigned char* p (static_cast<const unsigned char*> (d));
+        o = std::copy (p, p + n, o);
+      });
+
+    element_binary (s, false);
+    return o;
+  }
+
   template <typename T>
   T parser::
   attribute (const qname_type& qn, const T& dv) const
   {
-    if (const element_entry* e = get_element ())
-    {
-      attribute_map_type::const_iterator i (e->attr_map_.find (qn));
-
-      if (i != e->attr_map_.end ())
-      {
-        if (!i->second.handled)
-        {
-          i->second.handled = true;
-          e->attr_unhandled_--;
-        }
-        return value_traits<T>::parse (i->second.value, *this);
-      }
-    }
+    const attribute_value_type* v (find_attribute (qn));
+    return v != 0 ? value_traits<T>::parse (v->value, *this) : dv;
+  }
 
-    return dv;
+  template <typename T>
+  T parser::
+  attribute (name_id_type id, const T& dv) const
+  {
+    const attribute_value_type* v (find_attribute (id));
+    return v != 0 ? value_traits<T>::parse (v->value, *this) : dv;
   }
 
   template <typename T>
   T parser::
   element (const qname_type& qn, const T& dv)
   {
-    if (peek () == start_element && qname () == qn)
+    if (peek () == start_element &&
+        qname_equal (qn.namespace_ (), qn.name ()))
     {
       next ();
       return element<T> ();
@@ -0,0 +1,458 @@
+// file      : libstudxml/path-engine.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <cassert>
+
+#include <libstudxml/path-engine.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  // invalid_path
+  //
+  invalid_path::
+  invalid_path (const string& p, const string& d)
+      : path_ (p), description_ (d)
+  {
+    what_ = "invalid path '" + path_ + "': " + description_;
+  }
+
+  // path_engine
+  //
+  void path_engine::
+  add_namespace (const string& prefix, const string& ns)
+  {
+    for (auto& p: namespaces_)
+    {
+      if (p.first == prefix)
+      {
+        p.second = ns;
+        return;
+      }
+    }
+
+    namespaces_.push_back (make_pair (prefix, ns));
+  }
+
+  size_t path_engine::
+  add (const string& path, callback_type c)
+  {
+    query q;
+    q.callback = move (c);
+
+    size_t n (path.size ()), i (0);
+
+    // Parse a name (or '*' if allowed) returning false if it is '*'.
+    //
+    auto parse_name = [&path, n, &i, this] (bool any, string& ns, string& nm)
+      -> bool
+    {
+      if (any && i != n && path[i] == '*')
+      {
+        ++i;
+        return false;
+      }
+
+      if (i != n && path[i] == '{')
+      {
+        size_t e (path.find ('}', i + 1));
+
+        if (e == string::npos)
+          throw invalid_path (path, "missing '}'");
+
+        ns.assign (path, i + 1, e - i - 1);
+        i = e + 1;
+      }
+      else
+        ns.clear ();
+
+      size_t b (i);
+      for (; i != n; ++i)
+      {
+        char c (path[i]);
+        if (c == '/' || c == '[' || c == ']' || c == '=' || c == '@' ||
+            c == '*' || c == '{' || c == '}')
+          break;
+      }
+
+      nm.assign (path, b, i - b);
+
+      size_t p (nm.find (':'));
+      if (p != string::npos)
+      {
+        if (b != 0 && path[b - 1] == '}')
+          throw invalid_path (path, "prefix in a qualified name");
+
+        string pfx (nm, 0, p);
+        nm.erase (0, p + 1);
+
+        auto j (namespaces_.begin ());
+        for (; j != namespaces_.end () && j->first != pfx; ++j) ;
+
+        if (j == namespaces_.end ())
+          throw invalid_path (path, "unknown prefix '" + pfx + "'");
+
+        ns = j->second;
+      }
+
+      if (nm.empty () || nm.find (':') != string::npos)
+        throw invalid_path (path, "invalid name");
+
+      return true;
+    };
+
+    if (n == 0 || path[0] != '/')
+      throw invalid_path (path, "path should be absolute");
+
+    string ns, nm;
+    while (i != n)
+    {
+      step s;
+      s.pred_name = name_table_type::unknown;
+      s.pred_value_set = false;
+
+      if (path[i] != '/')
+        throw invalid_path (path, "expected '/'");
+
+      s.descendant = ++i != n && path[i] == '/';
+      if (s.descendant)
+        ++i;
+
+      if (!q.steps.empty () && q.steps.back ().attribute)
+        throw invalid_path (path, "attribute step should be last");
+
+      s.attribute = i != n && path[i] == '@';
+      if (s.attribute)
+        ++i;
+
+      s.any = !parse_name (true, ns, nm);
+      s.name = s.any ? name_table_type::unknown : names_.insert (ns, nm);
+
+      if (i != n && path[i] == '[')
+      {
+        if (s.attribute)
+          throw invalid_path (path, "predicate in attribute step");
+
+        if (++i == n || path[i] != '@')
+          throw invalid_path (path, "expected '@' in predicate");
+
+        ++i;
+        parse_name (false, ns, nm);
+        s.pred_name = names_.insert (ns, nm);
+
+        if (i != n && path[i] == '=')
+        {
+          char d (++i != n ? path[i] : '\0');
+
+          if (d != '\'' && d != '"')
+            throw invalid_path (path, "expected quoted predicate value");
+
+          size_t e (path.find (d, ++i));
+
+          if (e == string::npos)
+            throw invalid_path (path, "unterminated predicate value");
+
+          s.pred_value.assign (path, i, e - i);
+          s.pred_value_set = true;
+          i = e + 1;
+        }
+
+        if (i == n || path[i] != ']')
+          throw invalid_path (path, "expected ']'");
+
+        ++i;
+      }
+
+      q.steps.push_back (move (s));
+    }
+
+    queries_.push_back (move (q));
+    return queries_.size () - 1;
+  }
+
+  parser::event_type path_engine::
+  evaluate (parser& p)
+  {
+    try
+    {
+      // Start with the document frame that has the initial state of every
+      // query unless we are resuming (push mode).
+      //
+      if (frames_.empty ())
+      {
+        for (size_t q (0); q != queries_.size (); ++q)
+          add_state (0, q, 0);
+
+        push_frame (0);
+      }
+
+      for (parser::event_type e (p.next ());; e = p.next ())
+      {
+        switch (e)
+        {
+        case parser::start_element:
+          {
+            start_element (p);
+            break;
+          }
+        case parser::end_element:
+          {
+            end_element ();
+            break;
+          }
+        case parser::characters:
+          {
+            for (collector& c: collectors_)
+              c.text += p.value ();
+            break;
+          }
+        case parser::eof:
+          {
+            clear ();
+            return e;
+          }
+        case parser::need_more_input:
+          return e;
+        default:
+          break;
+        }
+      }
+    }
+    catch (...)
+    {
+      clear ();
+      throw;
+    }
+  }
+
+  void path_engine::
+  start_element (parser& p)
+  {
+    // Mark the attributes as handled (we may not look at all of them).
+    //
+    parser::attribute_map_type am (p.attribute_map ());
+
+    bool shared (p.names () == &names_);
+    const frame& f (frames_.back ());
+
+    // Only look the name up if there are steps that test it. If it is not
+    // one of the names in the queries, then only '*' can match.
+    //
+    name_id_type id (
+      !f.names ? name_table_type::unknown :
+      shared   ? p.name_id () :
+      names_.find (p.qname ()));
+
+    bool matchable (f.any || id != name_table_type::unknown);
+
+    size_t pb (f.begin), pe (states_.size ());
+    size_t depth (frames_.size ()); // Depth of this element.
+    size_t cn (collectors_.size ());
+
+    // Advance the parent element's states and add the resulting ones to
+    // this element's frame (without duplicates).
+    //
+    for (size_t i (pb); i != pe; ++i)
+    {
+      state s (states_[i]);
+      const query& q (queries_[s.q]);
+      const step& st (q.steps[s.k]);
+
+      if (st.attribute)
+      {
+        // Attribute step that was already evaluated for the parent element
+        // (child axis) or that also applies to this element's attributes
+        // (descendant axis).
+        //
+        if (st.descendant)
+          add_state (pe, s.q, s.k);
+
+        continue;
+      }
+
+      if (st.descendant)
+        add_state (pe, s.q, s.k);
+
+      if (!matchable || !test (st, id, am, shared))
+        continue;
+
+      if (s.k + 1 != q.steps.size ())
+      {
+        add_state (pe, s.q, s.k + 1);
+        continue;
+      }
+
+      // Element match. Note that the same match can be produced via several
+      // states of the query (for example, //a//b).
+      //
+      size_t j (cn);
+      for (; j != collectors_.size () && collectors_[j].q != s.q; ++j) ;
+
+      if (j == collectors_.size ())
+      {
+        collector c;
+        c.q = s.q;
+        c.depth = depth;
+        c.name = p.qname ();
+        collectors_.push_back (move (c));
+      }
+    }
+
+    // Evaluate the attribute steps only keeping the descendant axis states
+    // (compacting the rest in place).
+    //
+    size_t j (pe);
+    for (size_t i (pe), n (states_.size ()); i != n; ++i)
+    {
+      state s (states_[i]);
+      const query& q (queries_[s.q]);
+      const step& st (q.steps[s.k]);
+
+      if (st.attribute)
+      {
+        if (st.any)
+        {
+          for (const auto& a: am)
+          {
+            match m {s.q, a.first, a.second.value};
+            q.callback (m);
+          }
+        }
+        else if (!am.empty ())
+        {
+          parser::attribute_map_type::const_iterator a (
+            find_attribute (am, st.name, shared));
+
+          if (a != am.end ())
+          {
+            match m {s.q, a->first, a->second.value};
+            q.callback (m);
+          }
+        }
+
+        if (!st.descendant)
+          continue;
+      }
+
+      if (i != j)
+        states_[j] = s;
+
+      ++j;
+    }
+
+    states_.resize (j);
+
+    // If there is nothing to match or collect in this subtree, then skip
+    // it. Otherwise, open the frame.
+    //
+    if (states_.size () == pe && collectors_.empty ())
+      p.skip ();
+    else
+      push_frame (pe);
+  }
+
+  void path_engine::
+  end_element ()
+  {
+    size_t depth (frames_.size () - 1);
+
+    assert (depth != 0);
+
+    states_.resize (frames_.back ().begin);
+    frames_.pop_back ();
+
+    // Deliver the element matches. They are at the end of the collector
+    // stack in the order they were started.
+    //
+    size_t n (collectors_.size ()), b (n);
+    for (; b != 0 && collectors_[b - 1].depth == depth; --b) ;
+
+    for (size_t i (b); i != n; ++i)
+    {
+      const collector& c (collectors_[i]);
+      match m {c.q, c.name, c.text};
+      queries_[c.q].callback (m);
+    }
+
+    collectors_.resize (b);
+  }
+
+  bool path_engine::
+  test (const step& s,
+        name_id_type id,
+        const parser::attribute_map_type& am,
+        bool shared) const
+  {
+    if (!s.any && s.name != id)
+      return false;
+
+    if (s.pred_name != name_table_type::unknown)
+    {
+      parser::attribute_map_type::const_iterator i (
+        find_attribute (am, s.pred_name, shared));
+
+      if (i == am.end ())
+        return false;
+
+      if (s.pred_value_set && i->second.value != s.pred_value)
+        return false;
+    }
+
+    return true;
+  }
+
+  parser::attribute_map_type::const_iterator path_engine::
+  find_attribute (const parser::attribute_map_type& am,
+                  name_id_type id,
+                  bool shared) const
+  {
+    if (!shared)
+      return am.find (names_.name (id));
+
+    parser::attribute_map_type::const_iterator i (am.begin ()), e (am.end ());
+    for (; i != e && i.id () != id; ++i) ;
+    return i;
+  }
+
+  void path_engine::
+  add_state (size_t b, size_t q, size_t k)
+  {
+    for (size_t i (b); i != states_.size (); ++i)
+    {
+      if (states_[i].q == q && states_[i].k == k)
+        return;
+    }
+
+    states_.push_back (state {q, k});
+  }
+
+  void path_engine::
+  push_frame (size_t b)
+  {
+    frame f {b, false, false};
+
+    for (size_t i (b); i != states_.size (); ++i)
+    {
+      const step& st (queries_[states_[i].q].steps[states_[i].k]);
+
+      if (!st.attribute)
+      {
+        if (st.any)
+          f.any = true;
+        else
+          f.names = true;
+      }
+    }
+
+    frames_.push_back (f);
+  }
+
+  void path_engine::
+  clear ()
+  {
+    states_.clear ();
+    frames_.clear ();
+    collectors_.clear ();
+  }
+}
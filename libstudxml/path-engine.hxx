@@ -0,0 +1,245 @@
+// file      : libstudxml/path-engine.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_PATH_ENGINE_HXX
+#define LIBSTUDXML_PATH_ENGINE_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <string>
+#include <vector>
+#include <cstddef> // std::size_t
+#include <functional>
+
+#include <libstudxml/forward.hxx>
+#include <libstudxml/qname.hxx>
+#include <libstudxml/parser.hxx>
+#include <libstudxml/name-table.hxx>
+#include <libstudxml/exception.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  class invalid_path: public exception
+  {
+  public:
+    virtual
+    ~invalid_path () noexcept {}
+
+    invalid_path (const std::string& path, const std::string& description);
+
+    const std::string&
+    path () const {return path_;}
+
+    const std::string&
+    description () const {return description_;}
+
+    virtual const char*
+    what () const noexcept {return what_.c_str ();}
+
+  private:
+    std::string path_;
+    std::string description_;
+    std::string what_;
+  };
+
+  // Engine that evaluates multiple path queries in a single pass over the
+  // parser events. The supported path syntax is the following XPath-like
+  // subset:
+  //
+  // path      := step+ ['/' '@' name-test | '//' '@' name-test]
+  // step      := ('/' | '//') name-test [predicate]
+  // name-test := '*' | name | prefix ':' name | '{' namespace '}' name
+  // predicate := '[' '@' name [ '=' ('\'' value '\'' | '"' value '"') ] ']'
+  //
+  // Where '/' selects child elements, '//' -- descendant elements, and the
+  // predicate requires the attribute to be present (and to have the
+  // specified value). The paths are always absolute and an unprefixed name
+  // has no namespace (as in XPath). Prefixes are mapped to namespaces with
+  // add_namespace(). For example:
+  //
+  // /root/record/name
+  // //choice1
+  // /root/record/@orange
+  // //x:item[@type='book']/x:title
+  //
+  // For an element match, the callback receives the element name and its
+  // text (all the character data inside the element, including that of
+  // nested elements) after the element end. For an attribute match, the
+  // callback receives the attribute name and value once the element start
+  // is seen. Matches of different queries are delivered in the document
+  // order of their ends (element) or starts (attribute).
+  //
+  // Queries are compiled into automata over the name ids in the engine's
+  // name table and evaluated simultaneously (that is, as a set of active
+  // states per open element). Subtrees that cannot produce a match for any
+  // query are skipped without producing events (see parser::skip()). For
+  // the best performance, use the engine's name table with the parser
+  // (see parser::names()). For example:
+  //
+  // xml::path_engine e;
+  // e.add ("/root/record/name", [] (const xml::path_engine::match& m)
+  //        {
+  //          cerr << m.value << endl;
+  //        });
+  //
+  // xml::parser p (ifs, argv[1]);
+  // p.names (e.names ());
+  // e.evaluate (p);
+  //
+  // The parser should be positioned at the beginning of the document and
+  // use the attribute map (that is, not receive attributes as events).
+  // Evaluation consumes the events (and attributes are considered handled)
+  // so the parser should not be used for anything else until evaluate()
+  // returns. The engine can be reused for multiple documents but not
+  // concurrently.
+  //
+  class LIBSTUDXML_EXPORT path_engine
+  {
+  public:
+    typedef xml::qname qname_type;
+    typedef xml::name_table name_table_type;
+
+    struct match
+    {
+      std::size_t query;  // Query index as returned by add().
+      const qname_type& name;  // Element or attribute name.
+      const std::string& value; // Element text or attribute value.
+    };
+
+    typedef std::function<void (const match&)> callback_type;
+
+    path_engine () {}
+
+    // Map the prefix to the namespace for the subsequently added queries.
+    //
+    void
+    add_namespace (const std::string& prefix, const std::string& ns);
+
+    // Compile and register the query returning its index. Throw
+    // invalid_path if the path is malformed or uses an unknown prefix.
+    // Queries should not be added during evaluation.
+    //
+    std::size_t
+    add (const std::string& path, callback_type);
+
+    std::size_t
+    size () const {return queries_.size ();}
+
+    // Names used in the queries.
+    //
+    const name_table_type&
+    names () const {return names_;}
+
+    // Evaluate the queries until eof or, in the push mode, until more input
+    // is needed (the return value indicates which). In the latter case call
+    // evaluate() again after feeding more input. Exceptions thrown by the
+    // callbacks or the parser are propagated after the evaluation state is
+    // cleared.
+    //
+    parser::event_type
+    evaluate (parser&);
+
+  private:
+    path_engine (const path_engine&);
+    path_engine& operator= (const path_engine&);
+
+  private:
+    typedef name_table_type::id_type name_id_type;
+
+    struct step
+    {
+      bool descendant;
+      bool attribute;
+      bool any;              // Name test is '*'.
+      name_id_type name;
+
+      name_id_type pred_name; // Predicate attribute or unknown if none.
+      bool pred_value_set;
+      std::string pred_value;
+    };
+
+    struct query
+    {
+      std::vector<step> steps;
+      callback_type callback;
+    };
+
+    // Active state: query that matched the first k steps.
+    //
+    struct state
+    {
+      std::size_t q;
+      std::size_t k;
+    };
+
+    // States of an open element (see states_ below) and what they need to
+    // be advanced by its child elements.
+    //
+    struct frame
+    {
+      std::size_t begin;
+      bool names; // Some element step tests the name (need name id).
+      bool any;   // Some element step is '*'.
+    };
+
+    // Element text being collected for a query match.
+    //
+    struct collector
+    {
+      std::size_t q;
+      std::size_t depth;
+      qname_type name;
+      std::string text;
+    };
+
+    void
+    start_element (parser&);
+
+    void
+    end_element ();
+
+    bool
+    test (const step&,
+          name_id_type,
+          const parser::attribute_map_type&,
+          bool shared) const;
+
+    // Find the attribute by its name id in the engine's name table. If
+    // shared is true, then this table is also used by the parser.
+    //
+    parser::attribute_map_type::const_iterator
+    find_attribute (const parser::attribute_map_type&,
+                    name_id_type,
+                    bool shared) const;
+
+    void
+    add_state (std::size_t begin, std::size_t q, std::size_t k);
+
+    // Push the frame for the states starting from begin.
+    //
+    void
+    push_frame (std::size_t begin);
+
+    void
+    clear ();
+
+  private:
+    name_table_type names_;
+    std::vector<std::pair<std::string, std::string>> namespaces_;
+    std::vector<query> queries_;
+
+    // Evaluation state. States of all the open elements are kept in a
+    // single stack with frames_ containing the beginning of each element's
+    // states (the first frame is for the document).
+    //
+    std::vector<state> states_;
+    std::vector<frame> frames_;
+    std::vector<collector> collectors_;
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_PATH_ENGINE_HXX
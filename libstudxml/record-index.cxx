@@ -0,0 +1,875 @@
+// file      : libstudxml/record-index.cxx
+// license   : MIT; see accompanying LICENSE file
+
+#include <new>       // std::bad_alloc
+#include <cassert>
+#include <cstring>   // std::strchr, std::memcpy
+#include <cctype>    // std::toupper
+#include <istream>
+#include <ostream>
+#include <algorithm> // std::upper_bound
+
+#include <libstudxml/record-index.hxx>
+
+using namespace std;
+
+namespace xml
+{
+  namespace
+  {
+    // Disable the failbit exception while reading the stream and clear
+    // the failbit once done if it was caused by eof (see the parser's
+    // stream_exception_controller).
+    //
+    struct stream_guard
+    {
+      explicit
+      stream_guard (istream& is)
+          : is_ (is), old_state_ (is.exceptions ())
+      {
+        is_.exceptions (old_state_ & ~istream::failbit);
+      }
+
+      ~stream_guard ()
+      {
+        istream::iostate s (is_.rdstate () & ~istream::failbit);
+
+        // Restoring the exception state would throw if it intersects with
+        // the error state (sans failbit), which means the exception is
+        // already active.
+        //
+        if (!(old_state_ & s))
+        {
+          if (is_.fail () && is_.eof ())
+            is_.clear (s);
+
+          is_.exceptions (old_state_);
+        }
+      }
+
+    private:
+      stream_guard (const stream_guard&);
+      stream_guard& operator= (const stream_guard&);
+
+    private:
+      istream& is_;
+      istream::iostate old_state_;
+    };
+
+    // Return true if the stream is in the error state that is not caused
+    // by eof.
+    //
+    inline bool
+    stream_failed (const istream& is)
+    {
+      return is.bad () || (is.fail () && !is.eof ());
+    }
+  }
+
+  // record_index::builder
+  //
+  struct record_index::builder
+  {
+    builder (record_index& x,
+             const string& name,
+             size_t depth,
+             unsigned long long base = 0)
+        : x_ (x), name_ (name), depth_ (depth), base_ (base), first_ (true),
+          pending_ (0), changed_ (true)
+    {
+      assert (depth >= 2);
+
+      x.depth_ = depth;
+      x.size_ = 0;
+      x.encoding_.clear ();
+      x.records_.clear ();
+      x.contexts_.clear ();
+
+      if ((p_ = XML_ParserCreateNS (0, XML_Char (' '))) == 0)
+        throw bad_alloc ();
+
+      XML_SetReturnNSTriplet (p_, true);
+      XML_SetUserData (p_, this);
+      XML_SetElementHandler (p_, &start_element, &end_element);
+      XML_SetStartNamespaceDeclHandler (p_, &start_namespace_decl);
+      XML_SetXmlDeclHandler (p_, &xml_decl);
+    }
+
+    ~builder ()
+    {
+      XML_ParserFree (p_);
+    }
+
+    // Parse the next chunk of the document, either directly or from the
+    // Expat buffer (see XML_GetBuffer()).
+    //
+    void
+    parse (const char* p, size_t n, bool last)
+    {
+      start (p, n);
+      check (XML_Parse (p_, p, static_cast<int> (n), last));
+      x_.size_ += n;
+    }
+
+    void
+    parse_buffer (const char* p, size_t n, bool last)
+    {
+      start (p, n);
+      check (XML_ParseBuffer (p_, static_cast<int> (n), last));
+      x_.size_ += n;
+    }
+
+    void
+    start (const char* p, size_t n)
+    {
+      if (first_)
+      {
+        detect (p, n);
+        first_ = false;
+      }
+    }
+
+    // Detect UTF-16 from the byte order mark or the first character (which
+    // should be '<') the same way as Expat does since the document may
+    // not have the XML declaration or it may not specify the byte order.
+    //
+    void
+    detect (const char* p, size_t n)
+    {
+      if (n < 2)
+        return;
+
+      unsigned char c0 (static_cast<unsigned char> (p[0]));
+      unsigned char c1 (static_cast<unsigned char> (p[1]));
+
+      if ((c0 == 0xFF && c1 == 0xFE) || (c0 == '<' && c1 == 0))
+        x_.encoding_ = "UTF-16LE";
+      else if ((c0 == 0xFE && c1 == 0xFF) || (c0 == 0 && c1 == '<'))
+        x_.encoding_ = "UTF-16BE";
+    }
+
+    void
+    check (XML_Status s)
+    {
+      if (s == XML_STATUS_ERROR)
+        throw parsing (name_,
+                       XML_GetCurrentLineNumber (p_),
+                       XML_GetCurrentColumnNumber (p_),
+                       XML_ErrorString (XML_GetErrorCode (p_)));
+    }
+
+    static void XMLCALL
+    start_element (void*, const XML_Char*, const XML_Char**);
+
+    static void XMLCALL
+    end_element (void*, const XML_Char*);
+
+    static void XMLCALL
+    start_namespace_decl (void*, const XML_Char*, const XML_Char*);
+
+    static void XMLCALL
+    xml_decl (void*, const XML_Char*, const XML_Char*, int);
+
+    record_index& x_;
+    const string& name_;
+    size_t depth_;
+    unsigned long long base_; // Document position in the stream.
+    bool first_;              // Nothing has been parsed yet.
+    XML_Parser p_;
+
+    // Namespace declarations of the current element and its ancestors.
+    // Each frame is the number of declarations before the element's own.
+    //
+    vector<pair<string, string>> decls_;
+    vector<size_t> frames_;
+    size_t pending_; // Number of declarations before the next element's.
+
+    string parent_; // Parent name of the records.
+    bool changed_;  // Ancestors have changed since the last record.
+  };
+
+  void XMLCALL record_index::builder::
+  start_element (void* v, const XML_Char* name, const XML_Char**)
+  {
+    builder& b (*static_cast<builder*> (v));
+
+    b.frames_.push_back (b.pending_);
+    b.pending_ = b.decls_.size ();
+
+    size_t d (b.frames_.size ());
+
+    if (d < b.depth_)
+    {
+      b.changed_ = true;
+
+      if (d == b.depth_ - 1)
+      {
+        // Convert the "<namespace> <name> <prefix>" triplet into the name
+        // as written in the document.
+        //
+        const char* n (strchr (name, ' '));
+        n = n != 0 ? n + 1 : name;
+
+        const char* p (strchr (n, ' '));
+
+        if (p != 0)
+          b.parent_.assign (p + 1).append (1, ':').append (n, p - n);
+        else
+          b.parent_.assign (n);
+      }
+    }
+    else if (d == b.depth_)
+    {
+      record_index& x (b.x_);
+
+      if (b.changed_)
+      {
+        // Flatten the declarations in scope for this element (excluding
+        // its own) with the inner ones overriding the outer.
+        //
+        x.contexts_.push_back (context ());
+        context& c (x.contexts_.back ());
+
+        c.parent = b.parent_;
+        c.first = x.records_.size ();
+
+        for (size_t i (0), n (b.frames_.back ()); i != n; ++i)
+        {
+          const pair<string, string>& p (b.decls_[i]);
+
+          size_t j (0);
+          for (; j != c.namespaces.size (); ++j)
+          {
+            if (c.namespaces[j].first == p.first)
+            {
+              c.namespaces[j].second = p.second;
+              break;
+            }
+          }
+
+          if (j == c.namespaces.size ())
+            c.namespaces.push_back (p);
+        }
+
+        b.changed_ = false;
+      }
+
+      record r = {
+        b.base_ +
+        static_cast<unsigned long long> (XML_GetCurrentByteIndex (b.p_)),
+        0};
+
+      x.records_.push_back (r);
+    }
+  }
+
+  void XMLCALL record_index::builder::
+  end_element (void* v, const XML_Char*)
+  {
+    builder& b (*static_cast<builder*> (v));
+
+    size_t d (b.frames_.size ());
+
+    if (d < b.depth_)
+      b.changed_ = true;
+    else if (d == b.depth_)
+    {
+      // The end tag (which for an empty element is the whole tag) is the
+      // current event.
+      //
+      record& r (b.x_.records_.back ());
+      r.size = b.base_ + static_cast<unsigned long long> (
+        XML_GetCurrentByteIndex (b.p_) + XML_GetCurrentByteCount (b.p_)) -
+        r.offset;
+    }
+
+    b.decls_.resize (b.frames_.back ());
+    b.pending_ = b.decls_.size ();
+    b.frames_.pop_back ();
+  }
+
+  void XMLCALL record_index::builder::
+  start_namespace_decl (void* v, const XML_Char* prefix, const XML_Char* ns)
+  {
+    builder& b (*static_cast<builder*> (v));
+
+    b.decls_.push_back (
+      pair<string, string> (prefix != 0 ? prefix : "", ns != 0 ? ns : ""));
+  }
+
+  void XMLCALL record_index::builder::
+  xml_decl (void* v, const XML_Char*, const XML_Char* enc, int)
+  {
+    builder& b (*static_cast<builder*> (v));
+
+    // The detected UTF-16 byte order takes precedence.
+    //
+    if (enc != 0 && b.x_.encoding_.empty ())
+      b.x_.encoding_ = enc;
+  }
+
+  // record_index
+  //
+  void record_index::
+  build (const void* data, size_t size, const string& name, size_t depth)
+  {
+    builder b (*this, name, depth);
+
+    // Parse directly from the buffer in chunks that are within the int
+    // range that Expat works with.
+    //
+    const size_t cap (1 << 20);
+    const char* p (static_cast<const char*> (data));
+
+    do
+    {
+      size_t n (size < cap ? size : cap);
+      size -= n;
+
+      b.parse (p, n, size == 0);
+      p += n;
+    } while (size != 0);
+  }
+
+  void record_index::
+  build (istream& is, const string& name, size_t depth)
+  {
+    // Record offsets are stream positions so that the document doesn't
+    // have to start at the beginning of the stream (tellg() fails if the
+    // stream is not seekable in which case assume it does).
+    //
+    streamoff base (is.tellg ());
+    builder b (*this,
+               name,
+               depth,
+               base > 0 ? static_cast<unsigned long long> (base) : 0);
+
+    const size_t cap (1 << 16);
+
+    for (bool last (false); !last; )
+    {
+      char* p (static_cast<char*> (XML_GetBuffer (b.p_, cap)));
+      if (p == 0)
+        throw bad_alloc ();
+
+      size_t n;
+      {
+        stream_guard g (is);
+        is.read (p, static_cast<streamsize> (cap));
+        n = static_cast<size_t> (is.gcount ());
+        last = is.eof ();
+      }
+
+      // If the caller hasn't configured the stream to use exceptions, then
+      // use the parsing exception to report an error.
+      //
+      if (stream_failed (is))
+        throw parsing (name, 0, 0, "io failure");
+
+      b.parse_buffer (p, n, last);
+    }
+  }
+
+  const record_index::context& record_index::
+  record_context (size_t i) const
+  {
+    assert (i < records_.size ());
+
+    // Find the last context that starts at or before this record.
+    //
+    vector<context>::const_iterator c (
+      upper_bound (contexts_.begin (), contexts_.end (), i,
+                   [] (size_t i, const context& c) {return i < c.first;}));
+
+    return *--c;
+  }
+
+  // Index format: the magic followed by the depth, document size, encoding,
+  // contexts, and records with all the numbers being 64-bit little-endian
+  // and strings prefixed with their size.
+  //
+  static const char index_magic[8] = {'X', 'M', 'L', 'R', 'I', 'D', 'X', 2};
+
+  namespace
+  {
+    struct index_writer
+    {
+      explicit
+      index_writer (ostream& os): os_ (os) {buf_.reserve (1 << 16);}
+
+      void
+      write (unsigned long long v)
+      {
+        char b[8];
+        for (size_t i (0); i != 8; ++i, v >>= 8)
+          b[i] = static_cast<char> (v & 0xFF);
+
+        write (b, 8);
+      }
+
+      void
+      write (const string& s)
+      {
+        write (s.size ());
+        write (s.data (), s.size ());
+      }
+
+      void
+      write (const char* p, size_t n)
+      {
+        buf_.append (p, n);
+
+        if (buf_.size () >= (1 << 16))
+          flush ();
+      }
+
+      void
+      flush ()
+      {
+        os_.write (buf_.data (), static_cast<streamsize> (buf_.size ()));
+        buf_.clear ();
+      }
+
+    private:
+      ostream& os_;
+      string buf_;
+    };
+
+    struct index_reader
+    {
+      index_reader (istream& is, const string& name)
+          : is_ (is), name_ (name) {}
+
+      unsigned long long
+      read ()
+      {
+        unsigned char b[8];
+        read (reinterpret_cast<char*> (b), 8);
+
+        unsigned long long v (0);
+        for (size_t i (8); i != 0; --i)
+          v = (v << 8) | b[i - 1];
+
+        return v;
+      }
+
+      void
+      read (string& s)
+      {
+        unsigned long long n (read ());
+
+        // Guard against allocating huge amounts of memory for an invalid
+        // index.
+        //
+        if (n > (1 << 20))
+          fail ();
+
+        s.resize (static_cast<size_t> (n));
+        if (n != 0)
+          read (&s[0], s.size ());
+      }
+
+      void
+      read (char* p, size_t n)
+      {
+        size_t r;
+        {
+          stream_guard g (is_);
+          is_.read (p, static_cast<streamsize> (n));
+          r = static_cast<size_t> (is_.gcount ());
+        }
+
+        if (stream_failed (is_))
+          throw parsing (name_, 0, 0, "io failure");
+
+        if (r != n)
+          fail ();
+      }
+
+      void
+      fail ()
+      {
+        throw parsing (name_, 0, 0, "invalid record index");
+      }
+
+    private:
+      istream& is_;
+      const string& name_;
+    };
+  }
+
+  void record_index::
+  save (ostream& os) const
+  {
+    index_writer w (os);
+
+    w.write (index_magic, sizeof (index_magic));
+    w.write (depth_);
+    w.write (size_);
+    w.write (encoding_);
+
+    w.write (contexts_.size ());
+    for (const context& c: contexts_)
+    {
+      w.write (c.parent);
+      w.write (c.first);
+
+      w.write (c.namespaces.size ());
+      for (const pair<string, string>& n: c.namespaces)
+      {
+        w.write (n.first);
+        w.write (n.second);
+      }
+    }
+
+    w.write (records_.size ());
+    for (const record& r: records_)
+    {
+      w.write (r.offset);
+      w.write (r.size);
+    }
+
+    w.flush ();
+  }
+
+  void record_index::
+  load (istream& is, const string& name)
+  {
+    index_reader r (is, name);
+
+    char m[sizeof (index_magic)];
+    r.read (m, sizeof (m));
+
+    if (memcmp (m, index_magic, sizeof (m)) != 0)
+      r.fail ();
+
+    depth_ = static_cast<size_t> (r.read ());
+    size_ = r.read ();
+    r.read (encoding_);
+
+    // Read the contexts and records one by one (rather than trusting the
+    // counts to preallocate).
+    //
+    contexts_.clear ();
+    for (unsigned long long n (r.read ()); n != 0; --n)
+    {
+      contexts_.push_back (context ());
+      context& c (contexts_.back ());
+
+      r.read (c.parent);
+      c.first = static_cast<size_t> (r.read ());
+
+      for (unsigned long long k (r.read ()); k != 0; --k)
+      {
+        c.namespaces.push_back (pair<string, string> ());
+        r.read (c.namespaces.back ().first);
+        r.read (c.namespaces.back ().second);
+      }
+    }
+
+    records_.clear ();
+    for (unsigned long long n (r.read ()); n != 0; --n)
+    {
+      record x;
+      x.offset = r.read ();
+      x.size = r.read ();
+      records_.push_back (x);
+    }
+
+    // Make sure the contexts are consistent with the records.
+    //
+    bool v (depth_ >= 2 && (contexts_.empty () == records_.empty ()));
+    for (size_t i (0); v && i != contexts_.size (); ++i)
+    {
+      v = contexts_[i].first < records_.size () &&
+        (i == 0
+         ? contexts_[i].first == 0
+         : contexts_[i].first > contexts_[i - 1].first);
+    }
+
+    if (!v)
+      r.fail ();
+  }
+
+  namespace details
+  {
+    // record_input
+    //
+    static void
+    escape (string& r, const string& s)
+    {
+      for (char c: s)
+      {
+        switch (c)
+        {
+        case '&': r += "&amp;";  break;
+        case '<': r += "&lt;";   break;
+        case '"': r += "&quot;"; break;
+        default:  r += c;        break;
+        }
+      }
+    }
+
+    // Encodings that Expat supports without an unknown encoding handler.
+    //
+    enum encoding_type {enc_utf8, enc_latin1, enc_ascii, enc_utf16le,
+                        enc_utf16be};
+
+    static encoding_type
+    encoding_of (const string& n)
+    {
+      string u (n);
+      for (char& c: u)
+        c = static_cast<char> (toupper (static_cast<unsigned char> (c)));
+
+      return u == "ISO-8859-1" ? enc_latin1 :
+        u == "US-ASCII" ? enc_ascii :
+        u == "UTF-16LE" ? enc_utf16le :
+        u == "UTF-16BE" || u == "UTF-16" ? enc_utf16be :
+        enc_utf8;
+    }
+
+    // Append the UTF-8 string to the result in the specified encoding,
+    // writing the characters that cannot be represented as character
+    // references. The strings are the markup with the names that come from
+    // the document itself so only the namespace values (which could have
+    // been written as character references in the document) may need them.
+    //
+    static void
+    transcode (string& r, const string& s, encoding_type e)
+    {
+      if (e == enc_utf8)
+      {
+        r += s;
+        return;
+      }
+
+      for (size_t i (0), n (s.size ()); i != n; )
+      {
+        // Decode the next character (Expat only gives us valid UTF-8).
+        //
+        unsigned char c (static_cast<unsigned char> (s[i++]));
+        unsigned long v (c);
+
+        if (c >= 0x80)
+        {
+          size_t k (c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1);
+          v = c & (0x3F >> k);
+
+          for (; k != 0 && i != n; --k)
+            v = (v << 6) | (static_cast<unsigned char> (s[i++]) & 0x3F);
+        }
+
+        switch (e)
+        {
+        case enc_latin1:
+        case enc_ascii:
+          {
+            if (v < (e == enc_latin1 ? 0x100UL : 0x80UL))
+              r += static_cast<char> (v);
+            else
+            {
+              char b[8];
+              size_t k (sizeof (b));
+
+              for (; v != 0; v >>= 4)
+                b[--k] = "0123456789ABCDEF"[v & 0xF];
+
+              r += "&#x";
+              r.append (b + k, sizeof (b) - k);
+              r += ';';
+            }
+            break;
+          }
+        case enc_utf16le:
+        case enc_utf16be:
+          {
+            unsigned long u[2];
+            size_t m (1);
+
+            if (v < 0x10000)
+              u[0] = v;
+            else
+            {
+              v -= 0x10000;
+              u[0] = 0xD800 | (v >> 10);
+              u[1] = 0xDC00 | (v & 0x3FF);
+              m = 2;
+            }
+
+            for (size_t j (0); j != m; ++j)
+            {
+              char lo (static_cast<char> (u[j] & 0xFF));
+              char hi (static_cast<char> (u[j] >> 8));
+
+              if (e == enc_utf16le)
+              {
+                r += lo;
+                r += hi;
+              }
+              else
+              {
+                r += hi;
+                r += lo;
+              }
+            }
+            break;
+          }
+        case enc_utf8:
+          break;
+        }
+      }
+    }
+
+    void record_input::
+    assign (const record_index& x, size_t i, const void* data)
+    {
+      init (x, i, static_cast<const char*> (data) + x[i].offset);
+    }
+
+    void record_input::
+    assign (const record_index& x, size_t i, istream& is, const string& name)
+    {
+      const record_index::record& r (x[i]);
+
+      record_data_.resize (static_cast<size_t> (r.size));
+      streamsize n (static_cast<streamsize> (record_data_.size ()));
+
+      bool seek;
+      {
+        stream_guard g (is);
+
+        // Note that seekg() clears eofbit (for example, after building the
+        // index from the same stream).
+        //
+        seek = !is.seekg (static_cast<streamoff> (r.offset)).fail ();
+
+        if (seek)
+          is.read (&record_data_[0], n);
+      }
+
+      if (!seek)
+        throw parsing (name, 0, 0, "unable to seek to record");
+
+      // A short read means the document has changed since the index was
+      // built.
+      //
+      if (stream_failed (is) || is.gcount () != n)
+        throw parsing (name, 0, 0, "io failure");
+
+      init (x, i, record_data_.data ());
+    }
+
+    void record_input::
+    init (const record_index& x, size_t i, const void* data)
+    {
+      const record_index::context& c (x.record_context (i));
+
+      // Build the parent tags in UTF-8 and then transcode them to the
+      // document encoding in which the record data is. Without the XML
+      // declaration Expat would assume UTF-8 for the record.
+      //
+      string b;
+
+      if (!x.encoding ().empty ())
+        b = "<?xml version=\"1.0\" encoding=\"" + x.encoding () + "\"?>";
+
+      b += '<';
+      b += c.parent;
+
+      for (const pair<string, string>& n: c.namespaces)
+      {
+        b += " xmlns";
+
+        if (!n.first.empty ())
+        {
+          b += ':';
+          b += n.first;
+        }
+
+        b += "=\"";
+        escape (b, n.second);
+        b += '"';
+      }
+      b += '>';
+
+      encoding_type e (encoding_of (x.encoding ()));
+
+      record_begin_.clear ();
+      transcode (record_begin_, b, e);
+
+      record_end_.clear ();
+      transcode (record_end_, "</" + c.parent + '>', e);
+
+      record_segs_[0].data = record_begin_.data ();
+      record_segs_[0].size = record_begin_.size ();
+      record_segs_[1].data = data;
+      record_segs_[1].size = static_cast<size_t> (x[i].size);
+      record_segs_[2].data = record_end_.data ();
+      record_segs_[2].size = record_end_.size ();
+    }
+  }
+
+  // record_parser
+  //
+  record_parser::
+  record_parser (const record_index& x,
+                 size_t i,
+                 const void* data,
+                 const string& name,
+                 feature_type f,
+                 allocator* a)
+      : details::record_input (x, i, data),
+        parser (record_segs_, 3, name, f, a)
+  {
+    init ();
+  }
+
+  record_parser::
+  record_parser (const record_index& x,
+                 size_t i,
+                 istream& is,
+                 const string& name,
+                 feature_type f,
+                 allocator* a)
+      : details::record_input (x, i, is, name),
+        parser (record_segs_, 3, name, f, a)
+  {
+    init ();
+  }
+
+  void record_parser::
+  reset (const record_index& x,
+         size_t i,
+         const void* data,
+         const string& name,
+         feature_type f)
+  {
+    assign (x, i, data);
+    parser::reset (record_segs_, 3, name, f);
+    init ();
+  }
+
+  void record_parser::
+  reset (const record_index& x,
+         size_t i,
+         istream& is,
+         const string& name,
+         feature_type f)
+  {
+    assign (x, i, is, name);
+    parser::reset (record_segs_, 3, name, f);
+    init ();
+  }
+
+  void record_parser::
+  init ()
+  {
+    // Skip the parent start element and its namespace declarations.
+    //
+    next_expect (start_element);
+
+    while (peek () == start_namespace_decl)
+      next ();
+  }
+}
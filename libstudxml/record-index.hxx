@@ -0,0 +1,223 @@
+// file      : libstudxml/record-index.hxx -*- C++ -*-
+// license   : MIT; see accompanying LICENSE file
+
+#ifndef LIBSTUDXML_RECORD_INDEX_HXX
+#define LIBSTUDXML_RECORD_INDEX_HXX
+
+#include <libstudxml/details/pre.hxx>
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <utility> // std::pair
+#include <cstddef> // std::size_t
+
+#include <libstudxml/forward.hxx>
+#include <libstudxml/parser.hxx>
+
+#include <libstudxml/details/export.hxx>
+
+namespace xml
+{
+  // Index of the byte ranges of elements (records) at the specified depth
+  // in a document, for example, children of the root element in a large
+  // document, that allows parsing individual records without parsing the
+  // document from the beginning (see record_parser below).
+  //
+  // The index is built with a single pass over the document that does
+  // nothing but track the element depth and namespace declarations. It can
+  // be saved and later loaded, for example, to/from a sidecar file.
+  //
+  // Errors in the document are reported by throwing the parsing exception.
+  //
+  // When the index is built from a stream, the record offsets are the
+  // stream positions (that is, they include the position at which the
+  // document starts in the stream) so that the same stream can be passed
+  // to record_parser. Stream errors are reported with the parsing exception
+  // unless the stream is configured to throw.
+  //
+  class LIBSTUDXML_EXPORT record_index
+  {
+  public:
+    struct record
+    {
+      unsigned long long offset; // Offset of the start tag.
+      unsigned long long size;   // Size up to and including the end tag.
+    };
+
+    // Namespace declarations in scope (prefix and namespace with empty
+    // prefix for the default namespace) and the parent element name (as
+    // written in the document) of a sequence of records.
+    //
+    struct context
+    {
+      std::string parent;
+      std::vector<std::pair<std::string, std::string>> namespaces;
+      std::size_t first; // Index of the first record.
+    };
+
+    record_index (): depth_ (0), size_ (0) {}
+
+    // Build the index of elements at the specified depth with the root
+    // element being at depth 1 (so the default is the root's children).
+    // Input name is used in diagnostics to identify the document.
+    //
+    void
+    build (const void* data,
+           std::size_t size,
+           const std::string& input_name,
+           std::size_t depth = 2);
+
+    void
+    build (std::istream&,
+           const std::string& input_name,
+           std::size_t depth = 2);
+
+    std::size_t
+    size () const {return records_.size ();}
+
+    bool
+    empty () const {return records_.empty ();}
+
+    const record&
+    operator[] (std::size_t i) const {return records_[i];}
+
+    const context&
+    record_context (std::size_t i) const;
+
+    std::size_t
+    depth () const {return depth_;}
+
+    // Size of the indexed document which can be used to detect a stale
+    // index.
+    //
+    unsigned long long
+    document_size () const {return size_;}
+
+    // Document encoding as specified in the XML declaration or, for UTF-16,
+    // as detected from the byte order (UTF-16LE or UTF-16BE). Empty if the
+    // document has no XML declaration or it doesn't specify the encoding.
+    // Record parsers use it to decode the record data.
+    //
+    const std::string&
+    encoding () const {return encoding_;}
+
+    // Save and load the index in a binary format (so the streams should be
+    // opened in the binary mode). Invalid index data is reported with the
+    // parsing exception. Input name is used in diagnostics to identify the
+    // index.
+    //
+    void
+    save (std::ostream&) const;
+
+    void
+    load (std::istream&, const std::string& input_name);
+
+  private:
+    struct builder;
+
+    std::size_t depth_;
+    unsigned long long size_;
+    std::string encoding_;
+    std::vector<record> records_;
+    std::vector<context> contexts_; // In the record order.
+  };
+
+  namespace details
+  {
+    // Input of record_parser that needs to be initialized before the
+    // parser base.
+    //
+    struct LIBSTUDXML_EXPORT record_input
+    {
+      record_input (const record_index& x, std::size_t i, const void* data)
+      {
+        assign (x, i, data);
+      }
+
+      record_input (const record_index& x,
+                    std::size_t i,
+                    std::istream& is,
+                    const std::string& input_name)
+      {
+        assign (x, i, is, input_name);
+      }
+
+      void
+      assign (const record_index&, std::size_t, const void* data);
+
+      void
+      assign (const record_index&,
+              std::size_t,
+              std::istream&,
+              const std::string& input_name);
+
+      std::string record_begin_;
+      std::string record_end_;
+      std::string record_data_; // Record data read from the stream.
+      parser::segment record_segs_[3];
+
+    private:
+      void
+      init (const record_index&, std::size_t, const void*);
+    };
+  }
+
+  // Parser for a single record that is parsed as the only child of its
+  // parent element with the namespace declarations that are in scope for
+  // the record. The parent start element (but not the namespace
+  // declarations) has already been consumed so the first event is the
+  // record's start_element. Its end_element followed by eof come after the
+  // record. Note that the location is relative to the record (with the
+  // parent start tag, preceded by the XML declaration if the document
+  // encoding is known, being on the first line).
+  //
+  // The document data should be the same as what the index was built for.
+  // The stream version seeks to the record offset and reads the record.
+  // Stream errors are reported with the parsing exception unless the
+  // stream is configured to throw.
+  //
+  // The parser can be reset to parse another record (see parser::reset()
+  // for details). See also parser_pool.
+  //
+  class LIBSTUDXML_EXPORT record_parser: private details::record_input,
+                                         public parser
+  {
+  public:
+    record_parser (const record_index&,
+                   std::size_t record,
+                   const void* data,
+                   const std::string& input_name,
+                   feature_type = receive_default,
+                   allocator* = 0);
+
+    record_parser (const record_index&,
+                   std::size_t record,
+                   std::istream&,
+                   const std::string& input_name,
+                   feature_type = receive_default,
+                   allocator* = 0);
+
+    void
+    reset (const record_index&,
+           std::size_t record,
+           const void* data,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+    void
+    reset (const record_index&,
+           std::size_t record,
+           std::istream&,
+           const std::string& input_name,
+           feature_type = receive_default);
+
+  private:
+    void
+    init ();
+  };
+}
+
+#include <libstudxml/details/post.hxx>
+
+#endif // LIBSTUDXML_RECORD_INDEX_HXX
@@ -1,10 +1,15 @@
 // file      : libstudxml/serializer.cxx
 // license   : MIT; see accompanying LICENSE file
 
-#include <new>     // std::bad_alloc
-#include <cstring> // std::strlen
+#include <new>       // std::bad_alloc
+#include <cstring>   // std::strlen, std::memcpy
+#include <istream>
+#include <utility>   // std::move
+#include <algorithm> // std::min
 
 #include <libstudxml/serializer.hxx>
+#include <libstudxml/output-sink.hxx>
+#include <libstudxml/details/allocator.hxx>
 
 using namespace std;
 
@@ -27,34 +32,146 @@ namespace xml
 
   // serializer
   //
-  extern "C" genxStatus
-  genx_write (void* p, constUtf8 us)
+  static const size_t default_buffer_size = 16 * 1024;
+
+  // Genx emits output in small pieces (angle brackets, prefixes, names,
+  // indentation spaces, etc) so we accumulate them in the buffer instead
+  // of writing each directly to the stream or sink.
+  //
+  inline bool serializer::
+  write (const char* s, size_t n)
+  {
+    // Detect the stream errors as early as if the output were not buffered
+    // (the stream state is also checked after each block write).
+    //
+    if (os_ != 0 && !os_->good ())
+      return false;
+
+    if (n <= buf_.size () - buf_n_)
+    {
+      memcpy (buf_.data () + buf_n_, s, n);
+      buf_n_ += n;
+      return true;
+    }
+
+    if (flush_ == flush_explicit)
+    {
+      size_t c (buf_.size () * 2);
+      buf_.resize (c >= buf_n_ + n ? c : buf_n_ + n);
+      memcpy (buf_.data () + buf_n_, s, n);
+      buf_n_ += n;
+      return true;
+    }
+
+    if (!write_buffer ())
+      return false;
+
+    // Write large pieces directly.
+    //
+    if (n >= buf_.size ())
+      return write_sink (s, n);
+
+    memcpy (buf_.data (), s, n);
+    buf_n_ = n;
+    return true;
+  }
+
+  bool serializer::
+  write_buffer ()
   {
-    // It would have been easier to throw the exception directly,
-    // however, the Genx code is most likely not exception safe.
+    if (buf_n_ == 0)
+      return true;
+
+    size_t n (buf_n_);
+    buf_n_ = 0;
+    return write_sink (buf_.data (), n);
+  }
+
+  bool serializer::
+  write_sink (const char* s, size_t n)
+  {
+    // It would have been easier to throw the exception directly, however,
+    // this is called from Genx which is most likely not exception safe.
     //
-    ostream* os (static_cast<ostream*> (p));
+    if (os_ != 0)
+    {
+      os_->write (s, static_cast<streamsize> (n));
+      return os_->good ();
+    }
+
+    try
+    {
+      sink_->write (s, n);
+      return true;
+    }
+    catch (...)
+    {
+      sink_error_ = current_exception ();
+      return false;
+    }
+  }
+
+  bool serializer::
+  flush_sink ()
+  {
+    if (!write_buffer ())
+      return false;
+
+    if (os_ != 0)
+    {
+      os_->flush ();
+      return os_->good ();
+    }
+
+    try
+    {
+      sink_->flush ();
+      return true;
+    }
+    catch (...)
+    {
+      sink_error_ = current_exception ();
+      return false;
+    }
+  }
+
+  genxStatus serializer::
+  genx_write (void* p, constUtf8 us)
+  {
     const char* s (reinterpret_cast<const char*> (us));
-    os->write (s, static_cast<streamsize> (strlen (s)));
-    return os->good () ? GENX_SUCCESS : GENX_IO_ERROR;
+    return static_cast<serializer*> (p)->write (s, strlen (s))
+      ? GENX_SUCCESS
+      : GENX_IO_ERROR;
   }
 
-  extern "C" genxStatus
+  genxStatus serializer::
   genx_write_bound (void* p, constUtf8 start, constUtf8 end)
   {
-    ostream* os (static_cast<ostream*> (p));
     const char* s (reinterpret_cast<const char*> (start));
-    streamsize n (static_cast<streamsize> (end - start));
-    os->write (s, n);
-    return os->good () ? GENX_SUCCESS : GENX_IO_ERROR;
+    return static_cast<serializer*> (p)->write (
+      s, static_cast<size_t> (end - start))
+      ? GENX_SUCCESS
+      : GENX_IO_ERROR;
   }
 
-  extern "C" genxStatus
+  genxStatus serializer::
   genx_flush (void* p)
   {
-    ostream* os (static_cast<ostream*> (p));
-    os->flush ();
-    return os->good () ? GENX_SUCCESS : GENX_IO_ERROR;
+    return static_cast<serializer*> (p)->flush_sink ()
+      ? GENX_SUCCESS
+      : GENX_IO_ERROR;
+  }
+
+  void* serializer::
+  genx_alloc (void* p, size_t n)
+  {
+    return details::c_malloc (*static_cast<serializer*> (p)->alloc_, n);
+  }
+
+  void serializer::
+  genx_dealloc (void*, void* p)
+  {
+    details::c_free (p);
   }
 
   serializer::
@@ -65,23 +182,58 @@ namespace xml
   }
 
   serializer::
-  serializer (ostream& os, const string& oname, unsigned short ind)
-      : os_ (os), os_state_ (os.exceptions ()), oname_ (oname), depth_ (0)
+  serializer (ostream& os,
+              const string& oname,
+              unsigned short ind,
+              allocator* a)
+      : os_ (&os),
+        os_state_ (os.exceptions ()),
+        sink_ (0),
+        oname_ (oname),
+        alloc_ (a),
+        buf_ (default_buffer_size),
+        buf_n_ (0),
+        flush_ (flush_size),
+        depth_ (0)
   {
     // Temporarily disable exceptions on the stream.
     //
-    os_.exceptions (ostream::goodbit);
+    os.exceptions (ostream::goodbit);
 
+    init (ind);
+  }
+
+  serializer::
+  serializer (output_sink& sink,
+              const string& oname,
+              unsigned short ind,
+              allocator* a)
+      : os_ (0),
+        os_state_ (ostream::goodbit),
+        sink_ (&sink),
+        oname_ (oname),
+        alloc_ (a),
+        buf_ (default_buffer_size),
+        buf_n_ (0),
+        flush_ (flush_size),
+        depth_ (0)
+  {
+    init (ind);
+  }
+
+  void serializer::
+  init (unsigned short ind)
+  {
     // Allocate the serializer. Make sure nothing else can throw after
     // this call since otherwise we will leak it.
     //
-    s_ = genxNew (0, 0, 0);
+    s_ = alloc_ != 0
+      ? genxNew (&genx_alloc, &genx_dealloc, this)
+      : genxNew (0, 0, this);
 
     if (s_ == 0)
       throw bad_alloc ();
 
-    genxSetUserData (s_, &os_);
-
     if (ind != 0)
       genxSetPrettyPrint (s_, ind);
 
@@ -93,10 +245,27 @@ namespace xml
     {
       string m (genxGetErrorMessage (s_, e));
       genxDispose (s_);
-      throw serialization (oname, m);
+      s_ = 0;
+      throw serialization (oname_, m);
     }
   }
 
+  void serializer::
+  buffer_size (size_t n)
+  {
+    if (n < buf_n_ && !write_buffer ())
+      handle_error (GENX_IO_ERROR);
+
+    buf_.resize (n);
+  }
+
+  void serializer::
+  flush ()
+  {
+    if (!flush_sink ())
+      handle_error (GENX_IO_ERROR);
+  }
+
   void serializer::
   handle_error (genxStatus e) const
   {
@@ -105,12 +274,23 @@ namespace xml
     case GENX_ALLOC_FAILED:
       throw bad_alloc ();
     case GENX_IO_ERROR:
+      // Propagate the exception thrown by the sink, if any, clearing it
+      // so that it is not rethrown again by a subsequent call.
+      //
+      if (sink_error_ != nullptr)
+      {
+        exception_ptr x (move (sink_error_));
+        sink_error_ = nullptr;
+        rethrow_exception (x);
+      }
+
       // Restoring the original exception state should trigger the
       // exception. If it doesn't (e.g., because the user didn't
       // configure the stream to throw), then fall back to the
       // serialiation exception.
       //
-      os_.exceptions (os_state_);
+      if (os_ != 0)
+        os_->exceptions (os_state_);
       // Fall through.
     default:
       throw serialization (oname_, genxGetErrorMessage (s_, e));
@@ -144,8 +324,11 @@ namespace xml
 
       // Also restore the original exception state on the stream.
       //
-      os_.exceptions (os_state_);
+      if (os_ != 0)
+        os_->exceptions (os_state_);
     }
+    else if (depth_ == 1 && flush_ == flush_record)
+      flush ();
   }
 
   void serializer::
@@ -215,6 +398,91 @@ namespace xml
       handle_error (e);
   }
 
+  genxNamespace serializer::
+  declare_namespace (const string& ns)
+  {
+    if (ns.empty ())
+      return 0;
+
+    // Note that similar to the *Literal() functions we don't specify the
+    // prefix so an existing mapping is used or one is generated.
+    //
+    genxStatus e;
+    genxNamespace r (
+      genxDeclareNamespace (
+        s_, reinterpret_cast<constUtf8> (ns.c_str ()), 0, &e));
+
+    if (e != GENX_SUCCESS)
+      handle_error (e);
+
+    return r;
+  }
+
+  serializer::element_handle serializer::
+  declare_element (const string& ns, const string& name)
+  {
+    genxNamespace gns (declare_namespace (ns));
+
+    genxStatus e;
+    genxElement r (
+      genxDeclareElement (
+        s_, gns, reinterpret_cast<constUtf8> (name.c_str ()), &e));
+
+    if (e != GENX_SUCCESS)
+      handle_error (e);
+
+    return element_handle (r, this);
+  }
+
+  serializer::attribute_handle serializer::
+  declare_attribute (const string& ns, const string& name)
+  {
+    genxNamespace gns (declare_namespace (ns));
+
+    genxStatus e;
+    genxAttribute r (
+      genxDeclareAttribute (
+        s_, gns, reinterpret_cast<constUtf8> (name.c_str ()), &e));
+
+    if (e != GENX_SUCCESS)
+      handle_error (e);
+
+    return attribute_handle (r, this);
+  }
+
+  void serializer::
+  start_element (const element_handle& h)
+  {
+    if (h.s_ != this)
+      throw serialization (oname_, "invalid element handle");
+
+    if (genxStatus e = genxStartElement (h.e_))
+      handle_error (e);
+
+    depth_++;
+  }
+
+  void serializer::
+  start_attribute (const attribute_handle& h)
+  {
+    if (h.s_ != this)
+      throw serialization (oname_, "invalid attribute handle");
+
+    if (genxStatus e = genxStartAttribute (h.a_))
+      handle_error (e);
+  }
+
+  void serializer::
+  attribute (const attribute_handle& h, const string& value)
+  {
+    if (h.s_ != this)
+      throw serialization (oname_, "invalid attribute handle");
+
+    if (genxStatus e = genxAddAttribute (
+          h.a_, reinterpret_cast<constUtf8> (value.c_str ())))
+      handle_error (e);
+  }
+
   void serializer::
   characters (const string& value)
   {
@@ -224,6 +492,103 @@ namespace xml
       handle_error (e);
   }
 
+  void serializer::
+  characters_binary (const void* data, size_t n, base64_encoder* en, bool last)
+  {
+    // Encode in blocks that result in at most 4096 characters (plus base64
+    // leftover and padding).
+    //
+    const char* p (static_cast<const char*> (data));
+    char b[4096 + 8];
+
+    for (;;)
+    {
+      size_t k (min (n, size_t (en != 0 ? 3072 : 2048)));
+      size_t m (en != 0
+                ? en->encode (p, k, b)
+                : hex_encoder ().encode (p, k, b));
+
+      p += k;
+      n -= k;
+
+      if (n == 0 && last && en != 0)
+        m += en->finish (b + m);
+
+      if (m != 0)
+      {
+        if (genxStatus e = genxAddCountedText (
+              s_, reinterpret_cast<constUtf8> (b), m))
+          handle_error (e);
+      }
+
+      if (n == 0)
+        break;
+    }
+  }
+
+  void serializer::
+  characters_binary (istream& is, base64_encoder* en)
+  {
+    // Reaching eof also sets failbit so temporarily unset the failbit
+    // exception and clear the failbit once done if it was caused by eof
+    // (see the parser's stream_exception_controller).
+    //
+    struct exception_guard
+    {
+      exception_guard (istream& is)
+          : is_ (is), old_state_ (is.exceptions ())
+      {
+        is_.exceptions (old_state_ & ~istream::failbit);
+      }
+
+      ~exception_guard ()
+      {
+        istream::iostate s (is_.rdstate () & ~istream::failbit);
+
+        // Restoring the exception state would throw if it intersects with
+        // the error state (sans failbit), which means the exception is
+        // already active.
+        //
+        if (!(old_state_ & s))
+        {
+          if (is_.fail () && is_.eof ())
+            is_.clear (s);
+
+          is_.exceptions (old_state_);
+        }
+      }
+
+      istream& is_;
+      istream::iostate old_state_;
+    };
+
+    char b[3072];
+
+    for (;;)
+    {
+      size_t n;
+      bool last;
+      {
+        exception_guard g (is);
+        is.read (b, sizeof (b));
+        n = static_cast<size_t> (is.gcount ());
+        last = is.eof ();
+      }
+
+      // If the caller hasn't configured the stream to use exceptions, then
+      // use the serialization exception to report an error (this includes
+      // the stream without a buffer).
+      //
+      if (is.bad () || (is.fail () && !is.eof ()))
+        throw serialization (oname_, "io failure");
+
+      characters_binary (b, n, en, last);
+
+      if (last)
+        break;
+    }
+  }
+
   void serializer::
   namespace_decl (const string& ns, const string& p)
   {
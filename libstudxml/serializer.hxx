@@ -7,13 +7,16 @@
 #include <libstudxml/details/pre.hxx>
 
 #include <string>
+#include <vector>
 #include <ostream>
-#include <cstddef> // std::size_t
+#include <cstddef>   // std::size_t
+#include <exception> // std::exception_ptr
 
 #include <libstudxml/details/genx/genx.h>
 
 #include <libstudxml/forward.hxx>
 #include <libstudxml/qname.hxx>
+#include <libstudxml/binary.hxx>
 #include <libstudxml/exception.hxx>
 
 #include <libstudxml/details/config.hxx>
@@ -63,13 +66,37 @@ namespace xml
     // exception is used to report io errors (badbit and failbit).
     // Otherwise, those are reported as the serialization exception.
     //
+    // Note that the output is buffered (see flush_policy() below) so if
+    // you write to the stream directly between the serializer calls (for
+    // example, to embed pre-serialized XML), then call flush() first.
+    // Otherwise, the buffered output will end up after what you wrote.
+    //
+    // If the allocator is specified, then it is used to allocate the
+    // memory for the underlying Genx writer (see allocator.hxx for
+    // details).
+    //
     serializer (std::ostream&,
                 const std::string& output_name,
-                unsigned short indentation = 2);
+                unsigned short indentation = 2,
+                allocator* = 0);
+
+    // Serialize to output_sink (see output-sink.hxx for details). The
+    // rest of the arguments have the same semantics as above. Exceptions
+    // thrown by the sink are propagated to the caller of the serializer
+    // function that triggered the write.
+    //
+    serializer (output_sink&,
+                const std::string& output_name,
+                unsigned short indentation = 2,
+                allocator* = 0);
 
     const std::string&
     output_name () const {return oname_;}
 
+    // Note that the destructor does not write the buffered output. If the
+    // document has not been completed (see end_element()), call flush() to
+    // write what has been serialized so far.
+    //
     ~serializer ();
 
   private:
@@ -195,8 +222,85 @@ namespace xml
                const std::string& name,
                const T& value);
 
+    // Pre-declared elements and attributes.
+    //
+    // The above functions look up (and, the first time, validate) the
+    // namespace and name on each call. If the same names are serialized
+    // many times, then it is more efficient to declare them once and then
+    // use the returned handles. A handle is only valid for the serializer
+    // instance that returned it and remains valid until this instance is
+    // destroyed. Passing a default-constructed handle or a handle returned
+    // by another serializer is reported with the serialization exception.
+    //
+  public:
+    class element_handle
+    {
+    public:
+      element_handle (): e_ (0), s_ (0) {}
+
+    private:
+      friend class serializer;
+      element_handle (genxElement e, const serializer* s): e_ (e), s_ (s) {}
+
+      genxElement e_;
+      const serializer* s_; // Serializer that declared the element.
+    };
+
+    class attribute_handle
+    {
+    public:
+      attribute_handle (): a_ (0), s_ (0) {}
+
+    private:
+      friend class serializer;
+      attribute_handle (genxAttribute a, const serializer* s)
+          : a_ (a), s_ (s) {}
+
+      genxAttribute a_;
+      const serializer* s_; // Serializer that declared the attribute.
+    };
+
+    element_handle
+    declare_element (const qname_type& qname);
+
+    element_handle
+    declare_element (const std::string& name);
+
+    element_handle
+    declare_element (const std::string& ns, const std::string& name);
+
+    attribute_handle
+    declare_attribute (const qname_type& qname);
+
+    attribute_handle
+    declare_attribute (const std::string& name);
+
+    attribute_handle
+    declare_attribute (const std::string& ns, const std::string& name);
+
+    void
+    start_element (const element_handle&);
+
+    void
+    element (const element_handle&, const std::string& value);
+
+    template <typename T>
+    void
+    element (const element_handle&, const T& value);
+
+    void
+    start_attribute (const attribute_handle&);
+
+    void
+    attribute (const attribute_handle&, const std::string& value);
+
+    template <typename T>
+    void
+    attribute (const attribute_handle&, const T& value);
+
     // Characters.
     //
+  public:
     void
     characters (const std::string& value);
 
@@ -204,6 +308,33 @@ namespace xml
     void
     characters (const T& value);
 
+    // Binary data as base64 or hex-encoded characters. The data is encoded
+    // and written in blocks so that it is never kept in memory in the
+    // encoded form as a whole. The stream version reads the stream until
+    // eof and throws serialization if it fails (unless the stream is
+    // configured to throw). Note that each call encodes (and, for base64,
+    // pads) the data independently.
+    //
+    void
+    characters_base64 (const void* data, std::size_t size);
+
+    void
+    characters_base64 (std::istream&);
+
+    template <typename I>
+    void
+    characters_base64 (I begin, I end);
+
+    void
+    characters_hex (const void* data, std::size_t size);
+
+    void
+    characters_hex (std::istream&);
+
+    template <typename I>
+    void
+    characters_hex (I begin, I end);
+
     // Namespaces declaration. If prefix is empty, then the default
     // namespace is declared. If both prefix and namespace are empty,
     // then the default namespace declaration is cleared (xmlns="").
@@ -275,14 +406,112 @@ namespace xml
     std::size_t
     indentation_suspended () const;
 
+    // Output buffering.
+    //
+  public:
+    // The output is accumulated in the buffer and written to the stream or
+    // sink in blocks according to the flush policy:
+    //
+    // flush_size     -- write the buffer when it is full (default)
+    // flush_record   -- also write the buffer and flush the stream or sink
+    //                   after each record, that is, each element that is a
+    //                   direct child of the root element
+    // flush_explicit -- only write the buffer on flush() (the buffer grows
+    //                   as necessary)
+    //
+    // In all cases the buffer is written and the stream or sink flushed at
+    // the end of the document (after the root element end).
+    //
+    // Note that since the output is buffered, the sink errors may be
+    // reported by a subsequent serializer function call. The stream state,
+    // however, is checked on every write so its errors are reported as if
+    // the output were not buffered.
+    //
+    enum flush_type {flush_size, flush_record, flush_explicit};
+
+    void
+    flush_policy (flush_type f) {flush_ = f;}
+
+    flush_type
+    flush_policy () const {return flush_;}
+
+    // Buffer size. The default is 16KB. If 0 is specified, then the output
+    // is not buffered (unless the flush policy is explicit).
+    //
+    void
+    buffer_size (std::size_t);
+
+    std::size_t
+    buffer_size () const {return buf_.size ();}
+
+    // Write the buffered output and flush the stream or sink.
+    //
+    void
+    flush ();
+
   private:
+    void
+    init (unsigned short indentation);
+
+    genxNamespace
+    declare_namespace (const std::string&);
+
     void
     handle_error (genxStatus) const;
 
+    // Encode and write binary data as characters. If the base64 encoder
+    // is NULL, then use hex.
+    //
+    void
+    characters_binary (const void*, std::size_t, base64_encoder*, bool last);
+
+    void
+    characters_binary (std::istream&, base64_encoder*);
+
+    template <typename I>
+    void
+    characters_binary (I begin, I end, base64_encoder*);
+
+    bool
+    write (const char*, std::size_t);
+
+    bool
+    write_buffer ();
+
+    bool
+    write_sink (const char*, std::size_t);
+
+    bool
+    flush_sink ();
+
+    // Genx callbacks. The user data is the serializer.
+    //
+    static genxStatus
+    genx_write (void*, constUtf8);
+
+    static genxStatus
+    genx_write_bound (void*, constUtf8 start, constUtf8 end);
+
+    static genxStatus
+    genx_flush (void*);
+
+    static void*
+    genx_alloc (void*, std::size_t);
+
+    static void
+    genx_dealloc (void*, void*);
+
   private:
-    std::ostream& os_;
+    std::ostream* os_;
     std::ostream::iostate os_state_; // Original exception state.
+    output_sink* sink_;
+    mutable std::exception_ptr sink_error_; // Exception thrown by the sink.
     const std::string oname_;
+    allocator* alloc_;
+
+    std::vector<char> buf_;
+    std::size_t buf_n_; // Buffered output size.
+    flush_type flush_;
 
     genxWriter s_;
     genxSender sender_;
@@ -23,6 +23,65 @@ namespace xml
 
   // serializer
   //
+  inline void serializer::
+  characters_base64 (const void* data, std::size_t size)
+  {
+    base64_encoder e;
+    characters_binary (data, size, &e, true);
+  }
+
+  inline void serializer::
+  characters_base64 (std::istream& is)
+  {
+    base64_encoder e;
+    characters_binary (is, &e);
+  }
+
+  template <typename I>
+  inline void serializer::
+  characters_base64 (I b, I e)
+  {
+    base64_encoder en;
+    characters_binary (b, e, &en);
+  }
+
+  inline void serializer::
+  characters_hex (const void* data, std::size_t size)
+  {
+    characters_binary (data, size, 0, true);
+  }
+
+  inline void serializer::
+  characters_hex (std::istream& is)
+  {
+    characters_binary (is, 0);
+  }
+
+  template <typename I>
+  inline void serializer::
+  characters_hex (I b, I e)
+  {
+    characters_binary (b, e, 0);
+  }
+
+  template <typename I>
+  void serializer::
+  characters_binary (I b, I e, base64_encoder* en)
+  {
+    // Copy the data into a buffer and encode it in blocks.
+    //
+    unsigned char buf[3072];
+
+    do
+    {
+      std::size_t n (0);
+      for (; n != sizeof (buf) && b != e; ++b)
+        buf[n++] = static_cast<unsigned char> (*b);
+
+      characters_binary (buf, n, en, b == e);
+    } while (b != e);
+  }
+
   inline void serializer::
   start_element (const qname_type& qname)
   {
@@ -153,6 +212,51 @@ namespace xml
     attribute (ns, name, value_traits<T>::serialize (value, *this));
   }
 
+  inline serializer::element_handle serializer::
+  declare_element (const qname_type& qname)
+  {
+    return declare_element (qname.namespace_ (), qname.name ());
+  }
+
+  inline serializer::element_handle serializer::
+  declare_element (const std::string& name)
+  {
+    return declare_element (std::string (), name);
+  }
+
+  inline serializer::attribute_handle serializer::
+  declare_attribute (const qname_type& qname)
+  {
+    return declare_attribute (qname.namespace_ (), qname.name ());
+  }
+
+  inline serializer::attribute_handle serializer::
+  declare_attribute (const std::string& name)
+  {
+    return declare_attribute (std::string (), name);
+  }
+
+  inline void serializer::
+  element (const element_handle& h, const std::string& v)
+  {
+    start_element (h);
+    element (v);
+  }
+
+  template <typename T>
+  inline void serializer::
+  element (const element_handle& h, const T& v)
+  {
+    element (h, value_traits<T>::serialize (v, *this));
+  }
+
+  template <typename T>
+  inline void serializer::
+  attribute (const attribute_handle& h, const T& value)
+  {
+    attribute (h, value_traits<T>::serialize (value, *this));
+  }
+
   template <typename T>
   inline void serializer::
   characters (const T& value)
@@ -3,12 +3,28 @@
 
 #include <libstudxml/parser.hxx>
 
+#include <limits>
+#include <sstream>
+
+// Use std::from_chars()/std::to_chars() if available. Note that some
+// implementations only support the integral types.
+//
+#if defined(LIBSTUDXML_STRING_VIEW) && defined(__has_include)
+#  if __has_include(<charconv>)
+#    include <charconv>
+#    define LIBSTUDXML_CHARCONV_INTEGRAL 1
+#    ifdef __cpp_lib_to_chars
+#      define LIBSTUDXML_CHARCONV_FLOATING 1
+#    endif
+#  endif
+#endif
+
 using namespace std;
 
 namespace xml
 {
   bool default_value_traits<bool>::
-  parse (string s, const parser& p)
+  parse (const string& s, const parser& p)
   {
     if (s == "true" || s == "1" || s == "True" || s == "TRUE")
       return true;
@@ -17,4 +33,368 @@ namespace xml
     else
       throw parsing (p, "invalid bool value '" + s + "'");
   }
+
+  namespace details
+  {
+    // Skip the leading whitespaces and the plus sign (the same as what
+    // std::istream would do) and return false if what follows cannot be
+    // the beginning of a number (in particular, this rejects negative
+    // values for unsigned types as well as inf and nan).
+    //
+    static bool
+    parse_prefix (const char*& b, const char* e, bool sign, bool point)
+    {
+      for (; b != e; ++b)
+      {
+        char c (*b);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r' &&
+            c != '\v' && c != '\f')
+          break;
+      }
+
+      const char* p (b);
+
+      if (p != e && (*p == '+' || (*p == '-' && sign)))
+      {
+        if (*p++ == '+')
+          b = p; // std::from_chars() does not recognize the plus sign.
+      }
+
+      return p != e && ((*p >= '0' && *p <= '9') || (point && *p == '.'));
+    }
+
+    template <typename T>
+    static bool
+    parse_integer (const char* b, size_t n, T& r)
+    {
+      const char* e (b + n);
+
+      if (!parse_prefix (b, e, numeric_limits<T>::is_signed, false))
+        return false;
+
+#ifdef LIBSTUDXML_CHARCONV_INTEGRAL
+      from_chars_result x (from_chars (b, e, r));
+      return x.ec == errc () && x.ptr == e;
+#else
+      typedef unsigned long long value_type;
+
+      bool neg (*b == '-');
+      if (neg)
+        ++b;
+
+      // Maximum absolute value.
+      //
+      value_type m (
+        neg
+        ? static_cast<value_type> (-(numeric_limits<T>::min () + 1)) + 1
+        : static_cast<value_type> (numeric_limits<T>::max ()));
+
+      value_type v (0);
+      for (; b != e; ++b)
+      {
+        unsigned int d (static_cast<unsigned char> (*b) - '0');
+
+        if (d > 9 || v > (m - d) / 10)
+          return false;
+
+        v = v * 10 + d;
+      }
+
+      // Negate without overflowing on the minimum value.
+      //
+      r = neg && v != 0
+        ? static_cast<T> (-static_cast<long long> (v - 1) - 1)
+        : static_cast<T> (v);
+
+      return true;
+#endif
+    }
+
+#ifdef LIBSTUDXML_CHARCONV_FLOATING
+    // Return true if the magnitude of the floating point number (that has
+    // been accepted by std::from_chars()) is less than one.
+    //
+    static bool
+    parse_underflow (const char* b, const char* e)
+    {
+      if (*b == '-')
+        ++b;
+
+      // Decimal exponent of the first significant digit in the mantissa.
+      //
+      long long m (-1);
+      bool point (false), sig (false);
+
+      for (; b != e && *b != 'e' && *b != 'E'; ++b)
+      {
+        if (*b == '.')
+          point = true;
+        else if (!point)
+        {
+          if (sig || *b != '0')
+          {
+            sig = true;
+            ++m;
+          }
+        }
+        else if (!sig)
+        {
+          if (*b != '0')
+            sig = true;
+          else
+            --m;
+        }
+      }
+
+      // Add the exponent (saturated since we only care about the sign of
+      // the result).
+      //
+      long long x (0);
+
+      if (b != e)
+      {
+        bool neg (*++b == '-');
+        if (*b == '-' || *b == '+')
+          ++b;
+
+        for (; b != e; ++b)
+        {
+          if (x < 1000000)
+            x = x * 10 + (*b - '0');
+        }
+
+        if (neg)
+          x = -x;
+      }
+
+      return m + x < 0;
+    }
+#endif
+
+    template <typename T>
+    static bool
+    parse_floating (const char* b, size_t n, T& r)
+    {
+#ifdef LIBSTUDXML_CHARCONV_FLOATING
+      const char* e (b + n);
+
+      if (!parse_prefix (b, e, true, true))
+        return false;
+
+      from_chars_result x (from_chars (b, e, r));
+
+      if (x.ptr != e)
+        return false;
+
+      // Out of range is either overflow, which is invalid, or underflow, in
+      // which case return zero the same as std::istream (std::from_chars()
+      // leaves the value unchanged).
+      //
+      if (x.ec == errc::result_out_of_range && parse_underflow (b, e))
+      {
+        r = *b == '-' ? -T (0) : T (0);
+        return true;
+      }
+
+      return x.ec == errc ();
+#else
+      istringstream is (string (b, n));
+      return is >> r && is.eof ();
+#endif
+    }
+
+    template <typename T>
+    static size_t
+    serialize_integer (char* b, size_t n, T v)
+    {
+#ifdef LIBSTUDXML_CHARCONV_INTEGRAL
+      to_chars_result x (to_chars (b, b + n, v));
+      return x.ec == errc () ? static_cast<size_t> (x.ptr - b) : 0;
+#else
+      typedef unsigned long long value_type;
+
+      // Write the digits backwards into the temporary buffer.
+      //
+      char t[numeric_limits<value_type>::digits10 + 2];
+      char* p (t + sizeof (t));
+
+      bool neg (v < 0);
+      value_type u (
+        neg
+        ? static_cast<value_type> (-(v + 1)) + 1
+        : static_cast<value_type> (v));
+
+      do
+      {
+        *--p = static_cast<char> ('0' + u % 10);
+        u /= 10;
+      } while (u != 0);
+
+      if (neg)
+        *--p = '-';
+
+      size_t r (static_cast<size_t> (t + sizeof (t) - p));
+      if (r > n)
+        return 0;
+
+      char_traits<char>::copy (b, p, r);
+      return r;
+#endif
+    }
+
+    template <typename T>
+    static size_t
+    serialize_floating (char* b, size_t n, T v)
+    {
+#ifdef LIBSTUDXML_CHARCONV_FLOATING
+      // Same as std::ostream with the default precision (%g).
+      //
+      to_chars_result x (to_chars (b, b + n, v, chars_format::general, 6));
+      return x.ec == errc () ? static_cast<size_t> (x.ptr - b) : 0;
+#else
+      ostringstream os;
+      if (!(os << v))
+        return 0;
+
+      const string& s (os.str ());
+      if (s.size () > n)
+        return 0;
+
+      char_traits<char>::copy (b, s.c_str (), s.size ());
+      return s.size ();
+#endif
+    }
+
+    bool
+    parse_number (const char* b, size_t n, short& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, unsigned short& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, int& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, unsigned int& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, long& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, unsigned long& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, long long& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, unsigned long long& r)
+    {
+      return parse_integer (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, float& r)
+    {
+      return parse_floating (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, double& r)
+    {
+      return parse_floating (b, n, r);
+    }
+
+    bool
+    parse_number (const char* b, size_t n, long double& r)
+    {
+      return parse_floating (b, n, r);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, short v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, unsigned short v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, int v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, unsigned int v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, long v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, unsigned long v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, long long v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, unsigned long long v)
+    {
+      return serialize_integer (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, float v)
+    {
+      return serialize_floating (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, double v)
+    {
+      return serialize_floating (b, n, v);
+    }
+
+    size_t
+    serialize_number (char* b, size_t n, long double v)
+    {
+      return serialize_floating (b, n, v);
+    }
+  }
 }
@@ -9,6 +9,12 @@
 #include <string>
 #include <cstddef> // std::size_t
 
+#include <libstudxml/details/config.hxx> // LIBSTUDXML_STRING_VIEW
+
+#ifdef LIBSTUDXML_STRING_VIEW
+#  include <string_view>
+#endif
+
 #include <libstudxml/forward.hxx>
 
 #include <libstudxml/details/export.hxx>
@@ -19,7 +25,7 @@ namespace xml
   struct default_value_traits
   {
     static T
-    parse (std::string, const parser&);
+    parse (const std::string&, const parser&);
 
     static std::string
     serialize (const T&, const serializer&);
@@ -29,7 +35,7 @@ namespace xml
   struct LIBSTUDXML_EXPORT default_value_traits<bool>
   {
     static bool
-    parse (std::string, const parser&);
+    parse (const std::string&, const parser&);
 
     static std::string
     serialize (bool v, const serializer&)
@@ -54,6 +60,161 @@ namespace xml
     }
   };
 
+  // Integral (other than the character types) and floating point types are
+  // parsed and serialized without iostream and without allocations (other
+  // than for the returned string) using std::from_chars()/to_chars(), if
+  // available.
+  //
+  // Leading whitespaces and a sign are allowed but otherwise the whole value
+  // must be a number that fits the type (in particular, a negative value,
+  // including -0, for an unsigned type is invalid). A floating point value
+  // that is too small in magnitude for the type is parsed as zero, the same
+  // as with std::istream. The serialization output is the same as with
+  // std::ostream (floating point values are written with 6 significant
+  // digits). In the C++17 mode there is also the std::string_view-based
+  // parse() overload.
+  //
+  namespace details
+  {
+    // Return false if the value is invalid.
+    //
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, short&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, unsigned short&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, int&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, unsigned int&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, long&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, unsigned long&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, long long&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, unsigned long long&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, float&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, double&);
+
+    LIBSTUDXML_EXPORT bool
+    parse_number (const char*, std::size_t, long double&);
+
+    // Write the value into the buffer returning its size or 0 if the
+    // buffer is too small.
+    //
+    const std::size_t number_buffer_size = 64;
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, short);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, unsigned short);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, int);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, unsigned int);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, long);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, unsigned long);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, long long);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, unsigned long long);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, float);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, double);
+
+    LIBSTUDXML_EXPORT std::size_t
+    serialize_number (char*, std::size_t, long double);
+
+    template <typename T>
+    struct number_value_traits
+    {
+      static T
+      parse (const std::string&, const parser&);
+
+#ifdef LIBSTUDXML_STRING_VIEW
+      static T
+      parse (std::string_view, const parser&);
+
+      static T
+      parse (const char* s, const parser& p)
+      {
+        return parse (std::string_view (s), p);
+      }
+#endif
+
+      static std::string
+      serialize (T, const serializer&);
+    };
+  }
+
+  template <>
+  struct default_value_traits<short>:
+    details::number_value_traits<short> {};
+
+  template <>
+  struct default_value_traits<unsigned short>:
+    details::number_value_traits<unsigned short> {};
+
+  template <>
+  struct default_value_traits<int>:
+    details::number_value_traits<int> {};
+
+  template <>
+  struct default_value_traits<unsigned int>:
+    details::number_value_traits<unsigned int> {};
+
+  template <>
+  struct default_value_traits<long>:
+    details::number_value_traits<long> {};
+
+  template <>
+  struct default_value_traits<unsigned long>:
+    details::number_value_traits<unsigned long> {};
+
+  template <>
+  struct default_value_traits<long long>:
+    details::number_value_traits<long long> {};
+
+  template <>
+  struct default_value_traits<unsigned long long>:
+    details::number_value_traits<unsigned long long> {};
+
+  template <>
+  struct default_value_traits<float>:
+    details::number_value_traits<float> {};
+
+  template <>
+  struct default_value_traits<double>:
+    details::number_value_traits<double> {};
+
+  template <>
+  struct default_value_traits<long double>:
+    details::number_value_traits<long double> {};
+
   template <typename T>
   struct value_traits: default_value_traits<T> {};
 
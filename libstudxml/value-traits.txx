@@ -10,7 +10,7 @@ namespace xml
 {
   template <typename T>
   T default_value_traits<T>::
-  parse (std::string s, const parser& p)
+  parse (const std::string& s, const parser& p)
   {
     T r;
     std::istringstream is (s);
@@ -28,4 +28,40 @@ namespace xml
       throw serialization (s, "invalid value");
     return os.str ();
   }
+
+  namespace details
+  {
+    template <typename T>
+    T number_value_traits<T>::
+    parse (const std::string& s, const parser& p)
+    {
+      T r;
+      if (!parse_number (s.c_str (), s.size (), r))
+        throw parsing (p, "invalid value '" + s + "'");
+      return r;
+    }
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    template <typename T>
+    T number_value_traits<T>::
+    parse (std::string_view s, const parser& p)
+    {
+      T r;
+      if (!parse_number (s.data (), s.size (), r))
+        throw parsing (p, "invalid value '" + std::string (s) + "'");
+      return r;
+    }
+#endif
+
+    template <typename T>
+    std::string number_value_traits<T>::
+    serialize (T v, const serializer& s)
+    {
+      char b[number_buffer_size];
+      std::size_t n (serialize_number (b, sizeof (b), v));
+      if (n == 0)
+        throw serialization (s, "invalid value");
+      return std::string (b, n);
+    }
+  }
 }
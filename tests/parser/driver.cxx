@@ -3,10 +3,24 @@
 
 #include <string>
 #include <vector>
+#include <memory>       // std::unique_ptr
+#include <iterator>     // std::back_inserter()
+#include <algorithm>    // std::min(), std::replace()
+#include <fstream>
 #include <iostream>
 #include <sstream>
+#include <cstdio>       // std::remove(), std::tmpfile()
+#include <cstring>      // std::strlen()
+#include <system_error>
 
+#include <libstudxml/binary.hxx>
 #include <libstudxml/parser.hxx>
+#include <libstudxml/allocator.hxx>
+#include <libstudxml/parser-pool.hxx>
+#include <libstudxml/path-engine.hxx>
+#include <libstudxml/mapped-file.hxx>
+#include <libstudxml/input-source.hxx>
+#include <libstudxml/record-index.hxx>
 
 #undef NDEBUG
 #include <cassert>
@@ -110,6 +124,1694 @@ main ()
     p.next_expect (parser::end_element);
   }
 
+  {
+    // End namespace declarations should precede the end element event
+    // regardless of whether the element is empty.
+    //
+    istringstream is ("<root xmlns:a='a'><n xmlns:b='b'>X</n></root>");
+    parser p (is,
+              "test",
+              parser::receive_default |
+              parser::receive_namespace_decls);
+
+    p.next_expect (parser::start_element, "root");
+    p.next_expect (parser::start_namespace_decl);
+    p.next_expect (parser::start_element, "n");
+    p.next_expect (parser::start_namespace_decl);
+    p.next_expect (parser::characters);
+    p.next_expect (parser::end_namespace_decl);
+    p.next_expect (parser::end_element, "n");
+    p.next_expect (parser::end_namespace_decl);
+    p.next_expect (parser::end_element, "root");
+    p.next_expect (parser::eof);
+  }
+
+  // Test event queueing with documents that produce more events than
+  // fit into the queue at once.
+  //
+  {
+    string s ("<root>");
+    for (size_t i (0); i != 1000; ++i)
+      s += "<n a='" + to_string (i) + "'>" + to_string (i) + "</n>";
+    s += "</root>";
+
+    // Also test small, large, and adaptive chunk sizes.
+    //
+    for (size_t t (0); t != 5; ++t)
+    {
+      istringstream is (s);
+      parser ps (is, "queue");
+      parser pb (s.data (), s.size (), "queue");
+      parser& p (t % 2 == 0 ? ps : pb);
+
+      switch (t)
+      {
+      case 2: ps.chunk_size (7); break;
+      case 3: pb.chunk_size (65536); break;
+      case 4: ps.chunk_size (64, 65536); break;
+      }
+
+      p.next_expect (parser::start_element, "root", content::complex);
+
+      for (size_t i (0); i != 1000; ++i)
+      {
+        p.next_expect (parser::start_element, "n", content::simple);
+        assert (p.attribute<size_t> ("a") == i);
+        p.next_expect (parser::characters);
+        assert (p.value<size_t> () == i);
+        p.next_expect (parser::end_element);
+      }
+
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+
+      if (t == 4)
+        assert (p.chunk_size () >= 64 && p.chunk_size () <= 65536);
+    }
+
+    // The adaptive chunk size should only settle on the sizes that were
+    // tried, including when the doubling is capped by the maximum.
+    //
+    {
+      istringstream is (s);
+      parser p (is, "queue", parser::receive_elements);
+      p.chunk_size (64, 100);
+
+      for (parser::event_type e (p.next ()); e != parser::eof; e = p.next ())
+        ;
+
+      assert (p.chunk_size () == 64 || p.chunk_size () == 100);
+    }
+  }
+
+  try
+  {
+    // Events preceding an Expat error should be returned before the
+    // error is reported.
+    //
+    string s ("<root>");
+    for (size_t i (0); i != 1000; ++i)
+      s += "<n/>";
+    s += "</rot>";
+
+    parser p (s.data (), s.size (), "queue");
+
+    p.next_expect (parser::start_element, "root");
+
+    for (size_t i (0); i != 1000; ++i)
+    {
+      p.next_expect (parser::start_element, "n");
+      p.next_expect (parser::end_element);
+    }
+
+    p.next ();
+    assert (false);
+  }
+  catch (const xml::exception&)
+  {
+    // cerr << e.what () << endl;
+  }
+
+  // Test the string_views mode.
+  //
+  {
+    istringstream is ("<t:root xmlns:t='test' a='a' t:b='b'>"
+                      "<nested>X</nested></t:root>");
+    parser p (is,
+              "views",
+              parser::receive_default |
+              parser::receive_attributes_event |
+              parser::string_views);
+
+    p.next_expect (parser::start_element, "test", "root");
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    assert (p.namespace_view () == "test");
+    assert (p.name_view () == "root");
+    assert (p.prefix_view () == "t");
+#endif
+
+    assert (p.qname () == qname ("test", "root") && p.prefix () == "t");
+
+    p.next_expect (parser::start_attribute, "a");
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    assert (p.namespace_view ().empty ());
+    assert (p.name_view () == "a");
+    assert (p.prefix_view ().empty ());
+#endif
+
+    p.next_expect (parser::characters);
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    assert (p.value_view () == "a");
+#endif
+
+    p.next_expect (parser::end_attribute);
+    p.next_expect (parser::start_attribute);
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    assert (p.namespace_view () == "test");
+    assert (p.name_view () == "b");
+#endif
+
+    assert (p.qname () == qname ("test", "b"));
+
+    p.next_expect (parser::characters);
+    p.next_expect (parser::end_attribute);
+
+    assert (p.element ("nested") == "X");
+
+    p.next_expect (parser::end_element, "test", "root");
+    p.next_expect (parser::eof);
+  }
+
+  // Test name ids.
+  //
+  {
+    enum {root = 1, nested, a, b};
+
+    name_table t;
+    assert (t.insert ("root") == root);
+    assert (t.insert (qname ("test", "nested")) == nested);
+    assert (t.insert ("a") == a);
+    assert (t.insert ("test", "b") == b);
+    assert (t.insert ("root") == root);
+    assert (t.find ("test", "nested") == nested);
+    assert (t.find (qname ("nested")) == name_table::unknown);
+    assert (t.find ("test", "neste") == name_table::unknown);
+    assert (t.find ("tes", "nested") == name_table::unknown);
+    assert (t.find ("", "a") == a);
+    assert (t.name (b) == qname ("test", "b"));
+
+    for (size_t i (0); i != 2; ++i)
+    {
+      istringstream is ("<root xmlns:t='test' a='1' t:b='2' c='3'>"
+                        "<t:nested/><nested/></root>");
+      parser p (is,
+                "ids",
+                parser::receive_default |
+                (i == 0 ? 0 : parser::string_views));
+      p.names (t);
+
+      p.next_expect (parser::start_element, root, content::complex);
+      assert (p.name_id () == root);
+      assert (p.attribute<int> (a) == 1);
+      assert (p.attribute (b) == "2");
+      assert (p.attribute_present (qname ("c")));
+      assert (p.attribute (b, "x") == "2");
+
+      {
+        parser::attribute_map_type m (p.attribute_map ());
+        parser::attribute_map_type::const_iterator i (m.begin ());
+        assert (i.id () == a && (++i).id () == b);
+        assert ((++i).id () == name_table::unknown);
+      }
+
+      assert (p.peek () == parser::start_element && p.name_id () == nested);
+      p.next_expect (parser::start_element, nested);
+      p.next_expect (parser::end_element, nested);
+
+      p.next_expect (parser::start_element);
+      assert (p.name_id () == name_table::unknown && p.name () == "nested");
+      p.next_expect (parser::end_element);
+
+      p.next_expect (parser::end_element, root);
+      p.next_expect (parser::eof);
+    }
+  }
+
+  // Test the push mode.
+  //
+  {
+    const string s ("<t:root xmlns:t='test' a='1'>"
+                    "<n b='2'>one two</n><x>three</x>"
+                    "</t:root>");
+
+    for (size_t c: {size_t (1), size_t (3), size_t (7), s.size ()})
+    {
+      parser p (parser::push_mode,
+                "push",
+                parser::receive_default | parser::receive_namespace_decls);
+
+      size_t pos (0), needs (0);
+      vector<string> es;
+
+      for (;;)
+      {
+        p.peek (); // Peek followed by next should work as next.
+        parser::event_type e (p.next ());
+
+        if (e == parser::need_more_input)
+        {
+          size_t n (min (c, s.size () - pos));
+          p.feed (s.data () + pos, n, pos + n == s.size ());
+          pos += n;
+          needs++;
+          continue;
+        }
+
+        if (e == parser::eof)
+          break;
+
+        ostringstream os;
+        os << e;
+
+        switch (e)
+        {
+        case parser::start_element:
+          {
+            os << ' ' << p.name ();
+
+            if (p.name () == "root")
+            {
+              p.content (content::complex);
+              os << ' ' << p.attribute ("a");
+            }
+            else
+            {
+              p.content (content::simple);
+
+              if (p.name () == "n")
+                os << ' ' << p.attribute ("b");
+            }
+
+            break;
+          }
+        case parser::characters:
+          {
+            os << ' ' << p.value ();
+            break;
+          }
+        default:
+          break;
+        }
+
+        es.push_back (os.str ());
+      }
+
+      assert (needs >= (s.size () + c - 1) / c);
+
+      vector<string> r {"start element root 1",
+                        "start namespace declaration",
+                        "start element n 2",
+                        "characters one two",
+                        "end element",
+                        "start element x",
+                        "characters three",
+                        "end element",
+                        "end namespace declaration",
+                        "end element"};
+      assert (es == r);
+    }
+
+    try
+    {
+      parser p (parser::push_mode, "push");
+      assert (p.next () == parser::need_more_input);
+      p.feed ("<root>", 6);
+      p.next_expect (parser::start_element, "root");
+      assert (p.next () == parser::need_more_input);
+      p.feed ("</rot>", 6, true);
+      p.next ();
+      assert (false);
+    }
+    catch (const xml::exception&)
+    {
+    }
+  }
+
+  // Test partial reads. The stream buffer returns one piece at a time as
+  // a pipe or socket would.
+  //
+  {
+    struct piecewise_buf: streambuf
+    {
+      vector<string> pieces;
+      size_t n = 0; // Pieces returned so far.
+
+      virtual int_type
+      underflow ()
+      {
+        if (n == pieces.size ())
+          return traits_type::eof ();
+
+        string& p (pieces[n++]);
+        setg (&p[0], &p[0], &p[0] + p.size ());
+        return traits_type::to_int_type (p[0]);
+      }
+    } b;
+
+    b.pieces = {"<root>", "<a>X</a>", "<b/>", "</root>"};
+
+    istream is (&b);
+    parser p (is,
+              "partial",
+              parser::receive_default | parser::partial_reads);
+
+    p.next_expect (parser::start_element, "root");
+    assert (b.n == 1);
+    p.next_expect (parser::start_element, "a");
+    assert (b.n == 2);
+    p.next_expect (parser::characters);
+    p.next_expect (parser::end_element);
+    p.next_expect (parser::start_element, "b");
+    assert (b.n == 3);
+    p.next_expect (parser::end_element);
+    p.next_expect (parser::end_element);
+    p.next_expect (parser::eof);
+  }
+
+  // Test event locations (calculated lazily for buffers and segments).
+  //
+  {
+    const string d ("\xEF\xBB\xBF<root>\r\n"
+                    "  <a x='1'>\xC3\xA9t\xC3\xA9</a>\r"
+                    "  <b/>\n"
+                    "  <c>\xE2\x82\xAC</d>\n"
+                    "</root>");
+
+    const parser::segment segs[] = {
+      {d.data (), 10}, {0, 0}, {d.data () + 10, d.size () - 10}};
+
+    for (size_t t (0); t != 5; ++t)
+    {
+      istringstream is (d);
+
+      parser::feature_type f (parser::receive_default |
+                              parser::receive_attributes_event |
+                              (t == 3 ? parser::no_locations : 0));
+
+      unique_ptr<parser> pp (
+        t == 0 ? new parser (is, "test", f) :
+        t == 1 ? new parser (segs, 3, "test", f) :
+        new parser (d.data (), d.size (), "test", f));
+
+      parser& p (*pp);
+
+      if (t == 4)
+        p.chunk_size (3);
+
+      bool l (t != 3);
+
+      p.next_expect (parser::start_element, "root", content::complex);
+      assert (p.line () == (l ? 1 : 0) && p.column () == (l ? 1 : 0));
+
+      p.next_expect (parser::start_element, "a", content::simple);
+      assert (p.line () == (l ? 2 : 0) && p.column () == (l ? 2 : 0));
+
+      p.next_expect (parser::start_attribute, "x");
+      assert (p.line () == (l ? 2 : 0) && p.column () == (l ? 2 : 0));
+      p.next_expect (parser::characters);
+      p.next_expect (parser::end_attribute);
+
+      p.next_expect (parser::characters);
+      assert (p.line () == (l ? 2 : 0) && p.column () == (l ? 11 : 0));
+      p.next_expect (parser::end_element);
+      assert (p.line () == (l ? 2 : 0) && p.column () == (l ? 14 : 0));
+
+      p.next_expect (parser::start_element, "b");
+      assert (p.line () == (l ? 3 : 0) && p.column () == (l ? 2 : 0));
+      p.next_expect (parser::end_element);
+
+      p.next_expect (parser::start_element, "c");
+      assert (p.line () == (l ? 4 : 0) && p.column () == (l ? 2 : 0));
+
+      // Our own and Expat's errors.
+      //
+      try
+      {
+        p.next_expect (parser::end_element);
+        assert (false);
+      }
+      catch (const parsing& e)
+      {
+        assert (e.line () == (l ? 4 : 0) && e.column () == (l ? 5 : 0));
+      }
+
+      try
+      {
+        p.next ();
+        assert (false);
+      }
+      catch (const parsing& e)
+      {
+        assert (e.line () == 4 && e.column () == 8);
+      }
+    }
+
+    // Non-UTF-8 encoding.
+    //
+    const string e ("<?xml version='1.0' encoding='ISO-8859-1'?>\n"
+                    "<root>\xA9t\xA9<a/></root>");
+
+    parser p (e.data (), e.size (), "test");
+    p.next_expect (parser::start_element, "root");
+    p.next_expect (parser::characters);
+    p.next_expect (parser::start_element, "a");
+    assert (p.line () == 2 && p.column () == 9);
+  }
+
+  // Test receiving characters in chunks.
+  //
+  {
+    string t, x; // Escaped and expected text.
+    for (size_t i (0); i != 20000; ++i)
+    {
+      const char* s (
+        i % 3 == 0 ? "\xC3\xA9" : i % 100 == 0 ? "&amp;\n" : "abc");
+
+      t += s;
+      x += i % 3 != 0 && i % 100 == 0 ? "&\n" : s;
+    }
+
+    const string d ("<root><a>" + t + "</a><b>x<c/>yz</b></root>");
+
+    parser::feature_type f (parser::receive_default |
+                            parser::receive_characters_chunked);
+
+    for (size_t m (0); m != 4; ++m)
+    {
+      // Parse memory buffer with/without our own buffer and push input.
+      //
+      size_t cs (m == 3 ? 1 : 1000);
+      vector<char> buf (cs);
+
+      unique_ptr<parser> pp (
+        m < 2
+        ? new parser (d.data (), d.size (), "test", f)
+        : new parser (parser::push_mode, "test", f));
+
+      parser& p (*pp);
+      p.characters_chunk (cs, m == 1 ? buf.data () : 0);
+
+      size_t fed (0);
+      auto next = [&p, &d, &fed] ()
+      {
+        parser::event_type e;
+        while ((e = p.next ()) == parser::need_more_input)
+        {
+          size_t n (min (d.size () - fed, size_t (333)));
+          p.feed (d.data () + fed, n, fed + n == d.size ());
+          fed += n;
+        }
+        return e;
+      };
+
+      assert (next () == parser::start_element);
+      p.content (content::complex);
+
+      assert (next () == parser::start_element);
+      p.content (content::simple);
+
+      string r;
+      for (parser::event_type e (next ());
+           e == parser::characters;
+           e = next ())
+      {
+        size_t n (p.characters_size ());
+        assert (n != 0 && n <= cs);
+
+        if (m == 1)
+        {
+          assert (p.value ().empty ());
+          r.append (buf.data (), n);
+        }
+        else
+        {
+          assert (n == p.value ().size ());
+
+          // Chunks start at character boundaries.
+          //
+          assert (cs < 4 || (p.value ()[0] & 0xC0) != 0x80);
+          r += p.value ();
+        }
+
+        if (p.characters_last ())
+        {
+          assert (p.peek () == parser::end_element);
+          break;
+        }
+      }
+      assert (r == x);
+
+      assert (next () == parser::end_element);
+
+      // Mixed content.
+      //
+      assert (next () == parser::start_element);
+      assert (next () == parser::characters && p.characters_last ());
+      assert (next () == parser::start_element);
+      assert (next () == parser::end_element);
+
+      r.clear ();
+      for (;;)
+      {
+        assert (next () == parser::characters);
+        r.append (m == 1 ? string (buf.data (), p.characters_size ())
+                  : p.value ());
+        if (p.characters_last ())
+          break;
+      }
+      assert (r == "yz");
+
+      assert (next () == parser::end_element);
+      assert (next () == parser::end_element);
+      assert (next () == parser::eof);
+    }
+
+    // The text preceding an Expat error is returned before the error,
+    // whether the error is detected together with the text or later.
+    //
+    const string ed ("<d>abcdefgh\x01</d>");
+
+    for (size_t m (0); m != 2; ++m)
+    {
+      istringstream is (ed);
+      unique_ptr<parser> pp (
+        m == 0
+        ? new parser (ed.data (), ed.size (), "test", f)
+        : new parser (is, "test", f));
+
+      parser& p (*pp);
+      p.characters_chunk (100);
+
+      if (m == 1)
+        p.chunk_size (4);
+
+      p.next_expect (parser::start_element, "d");
+
+      string r;
+      try
+      {
+        for (;;)
+        {
+          p.next_expect (parser::characters);
+          assert (!p.characters_last ());
+          r += p.value ();
+        }
+      }
+      catch (const parsing& e)
+      {
+        assert (e.description () == "not well-formed (invalid token)");
+      }
+
+      assert (r == "abcdefgh");
+    }
+  }
+
+  // Test decoding binary element content.
+  //
+  {
+    string d;
+    for (size_t i (0); i != 1000; ++i)
+      d += static_cast<char> (i * 7 + i / 256);
+
+    // "Hello, World!" plus the data encoded with the serializer's
+    // encoder (base64 with line breaks).
+    //
+    string b64, hex;
+    {
+      base64_encoder e;
+      vector<char> t (base64_encoder::encode_size (d.size ()) + 4);
+      size_t n (e.encode (d.data (), d.size (), t.data ()));
+      n += e.finish (t.data () + n);
+
+      for (size_t i (0); i < n; i += 76)
+        b64 += "\n    " + string (t.data () + i, min (n - i, size_t (76)));
+      b64 += "\n  ";
+
+      hex_encoder h;
+      t.resize (hex_encoder::encode_size (d.size ()));
+      hex.assign (t.data (), h.encode (d.data (), d.size (), t.data ()));
+    }
+
+    const string x ("<root>"
+                    "<a>SGVsbG8sIFdvcmxkIQ==</a>"
+                    "<b>" + b64 + "</b>"
+                    "<c>" + hex + "</c>"
+                    "<d/>"
+                    "<e>SGVsbG8*</e>"
+                    "<f>4</f>"
+                    "</root>");
+
+    for (size_t t (0); t != 2; ++t)
+    {
+      parser p (x.data (), x.size (), "test");
+
+      if (t == 1)
+        p.characters_chunk (7);
+
+      p.next_expect (parser::start_element, "root", content::complex);
+
+      p.next_expect (parser::start_element, "a");
+      string r;
+      p.element_base64 (back_inserter (r));
+      assert (r == "Hello, World!");
+
+      p.next_expect (parser::start_element, "b");
+      vector<char> v;
+      vector_output_sink vs (v);
+      p.element_base64 (vs);
+      assert (string (v.begin (), v.end ()) == d);
+
+      p.next_expect (parser::start_element, "c");
+      r.clear ();
+      p.element_hex (back_inserter (r));
+      assert (r == d);
+
+      p.next_expect (parser::start_element, "d");
+      r.clear ();
+      p.element_base64 (back_inserter (r));
+      assert (r.empty ());
+
+      p.next_expect (parser::start_element, "e");
+      try
+      {
+        p.element_base64 (back_inserter (r));
+        assert (false);
+      }
+      catch (const parsing& e)
+      {
+        assert (e.description () == "invalid base64 data");
+      }
+      p.next_expect (parser::end_element);
+
+      p.next_expect (parser::start_element, "f");
+      try
+      {
+        p.element_hex (back_inserter (r));
+        assert (false);
+      }
+      catch (const parsing& e)
+      {
+        assert (e.description () == "invalid hex data");
+      }
+
+      p.next_expect (parser::end_element); // root
+      p.next_expect (parser::eof);
+    }
+
+    // Push mode: the element should be fed completely.
+    //
+    {
+      parser p (parser::push_mode, "test");
+      p.feed ("<a>SGVs", 7);
+      p.next_expect (parser::start_element, "a");
+
+      string r;
+      try
+      {
+        p.element_base64 (back_inserter (r));
+        assert (false);
+      }
+      catch (const parsing& e)
+      {
+        assert (e.description () == "incomplete base64 data in push mode");
+      }
+    }
+
+    {
+      parser p (parser::push_mode, "test");
+      p.feed ("<b>6869</b>", 11, true);
+      p.next_expect (parser::start_element, "b");
+
+      string r;
+      p.element_hex (back_inserter (r));
+      assert (r == "hi");
+      p.next_expect (parser::eof);
+    }
+  }
+
+  // Test skipping elements.
+  //
+  {
+    string s ("<root xmlns:t='test'>");
+    for (size_t i (0); i != 100; ++i)
+    {
+      s += "<skip a='1'>";
+      for (size_t j (0); j != i; ++j)
+        s += "<n xmlns:x='x'><x:m>text</x:m>text</n>";
+      s += "</skip>";
+      s += "<keep a='" + to_string (i) + "'/>";
+    }
+    s += "</root>";
+
+    for (size_t t (0); t != 3; ++t)
+    {
+      istringstream is (s);
+      parser pi (is,
+                 "skip",
+                 parser::receive_default | parser::receive_namespace_decls);
+      parser pp (parser::push_mode,
+                 "skip",
+                 parser::receive_default | parser::receive_namespace_decls);
+      parser& p (t == 0 ? pi : pp);
+
+      if (t != 0)
+        p.feed (s.data (), s.size (), true);
+
+      if (t == 2)
+        p.chunk_size (64);
+
+      p.next_expect (parser::start_element, "root", content::complex);
+      p.next_expect (parser::start_namespace_decl);
+
+      for (size_t i (0); i != 100; ++i)
+      {
+        if (i % 2 == 0)
+          p.next_skip ();
+        else
+        {
+          assert (p.peek () == parser::start_element);
+          p.skip ();
+        }
+
+        assert (p.event () == parser::end_element && p.name () == "skip");
+
+        p.next_expect (parser::start_element, "keep", content::empty);
+        assert (p.attribute<size_t> ("a") == i);
+        p.next_expect (parser::end_element);
+      }
+
+      p.next_expect (parser::end_namespace_decl);
+      p.next_expect (parser::end_element, "root");
+      p.next_expect (parser::eof);
+    }
+
+    // Skipping in the push mode across chunks.
+    //
+    {
+      parser p (parser::push_mode, "skip");
+      p.feed ("<root><skip><a>", 15);
+      p.next_expect (parser::start_element, "root");
+      p.next_expect (parser::start_element, "skip");
+      p.skip ();
+      assert (p.next () == parser::need_more_input);
+      p.feed ("</a><b/></skip><keep/>", 22);
+      p.next_expect (parser::start_element, "keep");
+      p.next_expect (parser::end_element);
+      assert (p.next () == parser::need_more_input);
+      p.feed ("</root>", 7, true);
+      p.next_expect (parser::end_element, "root");
+      p.next_expect (parser::eof);
+    }
+
+    // The skipped element's namespace declarations are discarded, whether
+    // or not its end has been parsed.
+    //
+    {
+      parser p (parser::push_mode,
+                "skip",
+                parser::receive_default | parser::receive_namespace_decls);
+      p.feed ("<root><s xmlns:a='a'/><s xmlns:b='b'><a>", 40);
+      p.next_expect (parser::start_element, "root");
+      p.next_skip ();
+      p.next_skip ();
+      assert (p.next () == parser::need_more_input);
+      p.feed ("</a></s></root>", 15, true);
+      p.next_expect (parser::end_element, "root");
+      p.next_expect (parser::eof);
+    }
+
+    try
+    {
+      parser p ("<root>X</root>", 14, "skip", parser::receive_elements);
+      p.next_expect (parser::start_element, "root");
+      p.next_expect (parser::end_element, "root");
+      p.skip ();
+      assert (false);
+    }
+    catch (const parsing& e)
+    {
+      assert (e.description () ==
+              "skip() called after end element instead of start element");
+    }
+  }
+
+  // Test the callback interface.
+  //
+  {
+    struct handler: parser::handler
+    {
+      string r;
+
+      virtual void
+      start_element (parser& p)
+      {
+        r += "<" + p.name ();
+
+        if (p.name () == "root")
+          p.content (content::complex);
+        else
+        {
+          p.content (content::simple);
+          r += " a=" + p.attribute ("a", string ());
+        }
+
+        r += ">";
+      }
+
+      virtual void
+      end_element (parser& p) {r += "</" + p.name () + ">";}
+
+      virtual void
+      characters (parser& p) {r += p.value ();}
+
+      virtual void
+      start_namespace_decl (parser& p) {r += "[" + p.namespace_ () + "]";}
+    };
+
+    {
+      const char b[] = "<root xmlns:t='test'>\n"
+                       "  <n a='1'>X<!--c-->Y</n>\n"
+                       "  <t:n>Z</t:n>\n"
+                       "</root>";
+
+      handler h;
+      parser p (b,
+                sizeof (b) - 1,
+                "parse",
+                parser::receive_default | parser::receive_namespace_decls);
+
+      assert (p.parse (h) == parser::eof);
+      assert (h.r == "<root>[test]<n a=1>XY</n><n a=>Z</n></root>");
+    }
+
+    {
+      handler h;
+      parser p (parser::push_mode, "parse");
+
+      assert (p.parse (h) == parser::need_more_input);
+      p.feed ("<root><n>X", 10);
+      assert (p.parse (h) == parser::need_more_input);
+      p.feed ("Y</n></root>", 12, true);
+      assert (p.parse (h) == parser::eof);
+      assert (h.r == "<root><n a=>XY</n></root>");
+    }
+
+    try
+    {
+      handler h;
+      parser p ("<root>X</root>", 14, "parse");
+      p.parse (h);
+      assert (false);
+    }
+    catch (const parsing& e)
+    {
+      assert (e.description () == "characters in complex content");
+    }
+
+    struct skip_handler: handler
+    {
+      virtual void
+      start_element (parser& p)
+      {
+        handler::start_element (p);
+
+        if (p.name () == "s")
+          p.skip ();
+        else if (p.name () == "x")
+          p.next ();
+      }
+
+      virtual void
+      end_namespace_decl (parser& p) {r += "[/" + p.prefix () + "]";}
+    };
+
+    {
+      const char b[] = "<root xmlns:t='test'>"
+                       "<n>X</n><s xmlns:u='u'><n>Y</n></s><t:n>Z</t:n>"
+                       "</root>";
+
+      skip_handler h;
+      parser p (b,
+                sizeof (b) - 1,
+                "parse",
+                parser::receive_default | parser::receive_namespace_decls);
+
+      assert (p.peek () == parser::start_element);
+      assert (p.parse (h) == parser::eof);
+      assert (h.r == "<root>[test]<n a=>X</n><s a=><n a=>Z</n>[/t]"
+                     "</root>");
+    }
+
+    // Including when the element's attribute or namespace declaration
+    // events are still to be dispatched.
+    //
+    const char* xs[] = {"<root><x/></root>",
+                        "<root><x a='1'/></root>",
+                        "<root><x xmlns:u='u'/></root>"};
+
+    for (const char* x: xs)
+    {
+      try
+      {
+        skip_handler h;
+        parser p (x,
+                  strlen (x),
+                  "parse",
+                  parser::receive_default |
+                  parser::receive_attributes_event |
+                  parser::receive_namespace_decls);
+        p.parse (h);
+        assert (false);
+      }
+      catch (const parsing& e)
+      {
+        assert (e.description () == "next() or peek() called from parse() "
+                                     "handler");
+      }
+    }
+  }
+
+  // Test parsing segments.
+  //
+  {
+    string s ("<root>");
+    for (size_t i (0); i != 1000; ++i)
+      s += "<n a='" + to_string (i) + "'>" + to_string (i) + "</n>";
+    s += "</root>";
+
+    // Split into segments of various sizes (cutting through tokens) with
+    // an empty segment in between.
+    //
+    vector<parser::segment> segs;
+    for (size_t i (0), n (1); i < s.size (); i += n, n = n * 3 % 5000 + 1)
+    {
+      segs.push_back (parser::segment {s.data () + i,
+                                       min (n, s.size () - i)});
+
+      if (segs.size () == 3)
+        segs.push_back (parser::segment {0, 0});
+    }
+
+    parser p (segs.data (), segs.size (), "segments");
+    p.next_expect (parser::start_element, "root", content::complex);
+
+    for (size_t i (0); i != 1000; ++i)
+    {
+      p.next_expect (parser::start_element, "n", content::simple);
+      assert (p.attribute<size_t> ("a") == i);
+      assert (p.element<size_t> () == i);
+    }
+
+    p.next_expect (parser::end_element);
+    p.next_expect (parser::eof);
+  }
+
+  // Test input sources.
+  //
+  {
+    string s ("<root>");
+    for (size_t i (0); i != 1000; ++i)
+      s += "<n>" + to_string (i) + "</n>";
+    s += "</root>";
+
+    auto test = [] (parser& p)
+    {
+      p.next_expect (parser::start_element, "root", content::complex);
+
+      for (size_t i (0); i != 1000; ++i)
+        assert (p.element<size_t> ("n") == i);
+
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    };
+
+    // Callback returning short reads.
+    //
+    {
+      size_t pos (0);
+      callback_input_source is (
+        [&s, &pos] (void* b, size_t n) -> size_t
+        {
+          n = min (min (n, s.size () - pos), size_t (100));
+          s.copy (static_cast<char*> (b), n, pos);
+          pos += n;
+          return n;
+        });
+
+      parser p (is, "callback");
+      test (p);
+    }
+
+    FILE* f (tmpfile ());
+    assert (f != 0);
+    assert (fwrite (s.data (), 1, s.size (), f) == s.size () &&
+            fflush (f) == 0);
+    rewind (f);
+
+    {
+      file_input_source is (f);
+      parser p (is, "file");
+      p.chunk_size (64, 1024);
+      test (p);
+    }
+
+#ifndef _WIN32
+    rewind (f);
+
+    {
+      fd_input_source is (fileno (f));
+      parser p (is, "fd");
+      test (p);
+    }
+#endif
+
+    fclose (f);
+
+    try
+    {
+      callback_input_source is (
+        [] (void*, size_t) -> size_t
+        {
+          throw system_error (make_error_code (errc::io_error));
+        });
+
+      parser p (is, "error");
+      p.next ();
+      assert (false);
+    }
+    catch (const system_error&)
+    {
+    }
+  }
+
+  // Test parser reset and pooling.
+  //
+  {
+    istringstream is ("<root a='1'><n>X</n></root>");
+    parser p (is, "reset");
+
+    // Reset in the middle of a document and after an error.
+    //
+    p.next_expect (parser::start_element, "root", content::complex);
+
+    const char b[] = "<t:root xmlns:t='test'><n/></t:rot>";
+    p.reset (b, sizeof (b) - 1, "reset2", parser::receive_default |
+                                          parser::receive_namespace_decls);
+    assert (p.input_name () == "reset2");
+    p.next_expect (parser::start_element, "test", "root");
+    p.next_expect (parser::start_namespace_decl);
+    p.next_expect (parser::start_element, "n");
+    p.next_expect (parser::end_element);
+
+    try
+    {
+      p.next ();
+      assert (false);
+    }
+    catch (const xml::exception&) {}
+
+    for (size_t i (0); i != 3; ++i)
+    {
+      istringstream is ("<root a='1'><n>X</n></root>");
+      p.reset (is, "reset");
+      p.next_expect (parser::start_element, "root", content::complex);
+      assert (p.attribute<int> ("a") == 1);
+      assert (p.element ("n") == "X");
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    parser_pool pool (1);
+    {
+      parser_pool::handle h1 (pool.acquire (is, "pool"));
+      parser_pool::handle h2 (pool.acquire (b, sizeof (b) - 1, "pool"));
+      parser* p1 (h1.get ());
+
+      h1.release ();
+      assert (h1.get () == 0 && pool.size () == 1);
+
+      parser_pool::handle h3 (pool.acquire (b, sizeof (b) - 1, "pool"));
+      assert (h3.get () == p1 && pool.size () == 0);
+
+      h3->next_expect (parser::start_element, "test", "root");
+      h3 = std::move (h1);
+      assert (pool.size () == 1);
+    }
+    assert (pool.size () == 1);
+
+    parser_pool::handle h (parser_pool::local ().acquire ("<x/>", 4, "l"));
+    h->next_expect (parser::start_element, "x");
+    h->next_expect (parser::end_element);
+    h->next_expect (parser::eof);
+
+    // Test pooling with the other inputs.
+    //
+    {
+      const char d[] = "<root><r/><s/></root>";
+      const size_t n (sizeof (d) - 1);
+
+      auto check = [] (parser& p)
+      {
+        p.next_expect (parser::start_element, "root", content::complex);
+        p.next_expect (parser::start_element, "r", content::empty);
+        p.next_expect (parser::end_element);
+        p.next_expect (parser::start_element, "s", content::empty);
+        p.next_expect (parser::end_element);
+        p.next_expect (parser::end_element);
+        p.next_expect (parser::eof);
+      };
+
+      parser_pool pool (2);
+      parser* p;
+      {
+        parser::segment segs[] = {{d, 3}, {d + 3, n - 3}};
+        parser_pool::handle h (pool.acquire (segs, 2, "pool"));
+        p = h.get ();
+        check (*h);
+      }
+
+      {
+        size_t pos (0);
+        callback_input_source src (
+          [&d, n, &pos] (void* b, size_t m) -> size_t
+          {
+            m = min (m, n - pos);
+            memcpy (b, d + pos, m);
+            pos += m;
+            return m;
+          });
+
+        parser_pool::handle h (pool.acquire (src, "pool"));
+        assert (h.get () == p);
+        check (*h);
+      }
+
+      {
+        parser_pool::handle h (pool.acquire (parser::push_mode, "pool"));
+        assert (h.get () == p);
+        assert (h->peek () == parser::need_more_input);
+        h->feed (d, n, true);
+        check (*h);
+      }
+
+      record_index x;
+      x.build (d, n, "pool");
+
+      parser* r;
+      {
+        parser_pool::handle h (pool.acquire (x, 0, d, "pool"));
+        r = h.get ();
+        assert (r != p && pool.size () == 1);
+        h->next_expect (parser::start_element, "r");
+        h->next_expect (parser::end_element);
+        h->next_expect (parser::end_element);
+        h->next_expect (parser::eof);
+      }
+      assert (pool.size () == 2);
+
+      {
+        istringstream is (d);
+        parser_pool::handle h (pool.acquire (x, 1, is, "pool"));
+        assert (h.get () == r);
+        h->next_expect (parser::start_element, "s");
+        h->next_expect (parser::end_element);
+        h->next_expect (parser::end_element);
+        h->next_expect (parser::eof);
+      }
+      assert (pool.size () == 2);
+    }
+  }
+
+  // Test custom allocator.
+  //
+  {
+    struct counting_allocator: monotonic_allocator
+    {
+      counting_allocator (): monotonic_allocator (1024), n (0) {}
+
+      virtual void*
+      allocate (size_t size, size_t alignment)
+      {
+        n++;
+        return monotonic_allocator::allocate (size, alignment);
+      }
+
+      size_t n;
+    } a;
+
+    string s ("<root>");
+    for (size_t i (0); i != 1000; ++i)
+      s += "<n a='" + to_string (i) + "'>" + to_string (i) + "</n>";
+    s += "</root>";
+
+    parser_pool pool (1, &a);
+
+    for (size_t i (0); i != 2; ++i)
+    {
+      istringstream is (s);
+      parser_pool::handle h (pool.acquire (is, "alloc"));
+      parser& p (*h);
+
+      p.next_expect (parser::start_element, "root", content::complex);
+
+      for (size_t i (0); i != 1000; ++i)
+      {
+        p.next_expect (parser::start_element, "n", content::simple);
+        assert (p.attribute<size_t> ("a") == i);
+        assert (p.element<size_t> () == i);
+      }
+
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    assert (a.n != 0);
+  }
+
+#ifdef LIBSTUDXML_MEMORY_RESOURCE
+  {
+    std::pmr::monotonic_buffer_resource r;
+    memory_resource_allocator a (&r);
+
+    parser p ("<root/>", 7, "pmr", parser::receive_default, &a);
+    p.next_expect (parser::start_element, "root", content::empty);
+    p.next_expect (parser::end_element);
+    p.next_expect (parser::eof);
+  }
+#endif
+
+  // Test parsing memory-mapped files.
+  //
+  {
+    const char* f ("mapped.xml");
+    {
+      ofstream ofs (f);
+      ofs << "<root>";
+      for (size_t i (0); i != 1000; ++i)
+        ofs << "<n a='" << i << "'/>";
+      ofs << "</root>";
+    }
+
+    {
+      mapped_file m (f);
+      parser p (m.data (), m.size (), m.path ());
+
+      p.next_expect (parser::start_element, "root", content::complex);
+
+      for (size_t i (0); i != 1000; ++i)
+      {
+        p.next_expect (parser::start_element, "n");
+        assert (p.attribute<size_t> ("a") == i);
+        p.next_expect (parser::end_element);
+      }
+
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    remove (f);
+
+    try
+    {
+      mapped_file m (f);
+      assert (false);
+    }
+    catch (const system_error&)
+    {
+    }
+  }
+
+  // Test record index.
+  //
+  {
+    const string doc (
+      "<a:root xmlns:a='urn:a' xmlns='urn:d'>\n"
+      " <g n='1' xmlns:b='urn:b'>\n"
+      "  <b:r i='0'/>\n"
+      "  <r i='1'><b:x/></r>\n"
+      " </g>\n"
+      " <g n='2' xmlns='urn:e&amp;'>\n"
+      "  <r i='2' xmlns:b='urn:c'><b:x/></r>\n"
+      " </g>\n"
+      "</a:root>");
+
+    const char* rs[] = {
+      "<b:r i='0'/>",
+      "<r i='1'><b:x/></r>",
+      "<r i='2' xmlns:b='urn:c'><b:x/></r>"};
+
+    record_index x;
+    x.build (doc.data (), doc.size (), "test", 3);
+
+    auto check = [&doc, &rs] (const record_index& x)
+    {
+      assert (x.size () == 3 && x.depth () == 3);
+      assert (x.document_size () == doc.size ());
+
+      for (size_t i (0); i != 3; ++i)
+        assert (doc.compare (x[i].offset, x[i].size, rs[i]) == 0);
+
+      const record_index::context& c1 (x.record_context (1));
+      assert (&x.record_context (0) == &c1);
+      assert (c1.parent == "g" && c1.namespaces.size () == 3);
+      assert (c1.namespaces[1].first == "" &&
+              c1.namespaces[1].second == "urn:d");
+
+      const record_index::context& c2 (x.record_context (2));
+      assert (c2.first == 2 && c2.namespaces.size () == 2);
+      assert (c2.namespaces[1].first == "" &&
+              c2.namespaces[1].second == "urn:e&");
+    };
+
+    check (x);
+
+    {
+      istringstream is (doc);
+      record_index y;
+      y.build (is, "test", 3);
+      check (y);
+    }
+
+    // Save and load.
+    //
+    {
+      stringstream ss;
+      x.save (ss);
+
+      record_index y;
+      y.load (ss, "index");
+      check (y);
+
+      string s (ss.str ());
+      s.resize (s.size () - 1);
+
+      try
+      {
+        istringstream is (s);
+        y.load (is, "index");
+        assert (false);
+      }
+      catch (const xml::exception&)
+      {
+      }
+    }
+
+    // Parse individual records.
+    //
+    {
+      record_parser p (x, 2, doc.data (), "test");
+      p.next_expect (parser::start_element, "urn:e&", "r");
+      assert (p.attribute<size_t> ("i") == 2);
+      p.next_expect (parser::start_element, "urn:c", "x");
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element); // Parent.
+      p.next_expect (parser::eof);
+    }
+
+    {
+      istringstream is (doc);
+      record_parser p (x, 1, is, "test");
+      p.next_expect (parser::start_element, "urn:d", "r");
+      assert (p.attribute<size_t> ("i") == 1);
+      p.next_expect (parser::start_element, "urn:b", "x");
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    // Document that doesn't start at the beginning of the stream (the
+    // offsets are stream positions). Also parse a record from the same
+    // stream after building the index (which leaves it at eof).
+    //
+    {
+      istringstream is ("junk" + doc);
+      is.seekg (4);
+
+      record_index y;
+      y.build (is, "test", 3);
+      assert (y.size () == 3 && y[0].offset == x[0].offset + 4);
+      assert (y.document_size () == doc.size ());
+
+      record_parser p (y, 0, is, "test");
+      p.next_expect (parser::start_element, "urn:b", "r");
+      assert (p.attribute<size_t> ("i") == 0);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    try
+    {
+      x.build (doc.data (), doc.size () - 1, "test", 3);
+      assert (false);
+    }
+    catch (const xml::exception&)
+    {
+    }
+  }
+
+  // Test record index with documents in encodings other than UTF-8.
+  //
+  {
+    const string doc (
+      "<?xml version='1.0' encoding='ISO-8859-1'?>\n"
+      "<r\xE9 xmlns='urn:&#x4E00;' xmlns:b='urn:\xE9'>\n"
+      " <b:v a='\xE9'>\xE9</b:v>\n"
+      " <v/>\n"
+      "</r\xE9>");
+
+    record_index x;
+    x.build (doc.data (), doc.size (), "test");
+    assert (x.size () == 2 && x.encoding () == "ISO-8859-1");
+    assert (x.record_context (0).parent == "r\xC3\xA9");
+
+    {
+      record_parser p (x, 0, doc.data (), "test");
+      p.next_expect (parser::start_element, "urn:\xC3\xA9", "v");
+      assert (p.attribute ("a") == "\xC3\xA9");
+      p.next_expect (parser::characters);
+      assert (p.value () == "\xC3\xA9");
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    {
+      record_parser p (x, 1, doc.data (), "test");
+      p.next_expect (parser::start_element, "urn:\xE4\xB8\x80", "v");
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    // The same document in UTF-16LE without the XML declaration (that is,
+    // with the encoding detected from the byte order mark).
+    //
+    string u ("\xFF\xFE");
+    for (char c: string ("<r xmlns='urn:x'><v a='\xE9'/><v/></r>"))
+    {
+      u += c;
+      u += '\0';
+    }
+
+    x.build (u.data (), u.size (), "test");
+    assert (x.size () == 2 && x.encoding () == "UTF-16LE");
+
+    {
+      record_parser p (x, 0, u.data (), "test");
+      p.next_expect (parser::start_element, "urn:x", "v");
+      assert (p.attribute ("a") == "\xC3\xA9");
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::end_element);
+      p.next_expect (parser::eof);
+    }
+
+    // The encoding is saved with the index.
+    //
+    {
+      stringstream ss;
+      x.save (ss);
+
+      record_index y;
+      y.load (ss, "index");
+      assert (y.encoding () == "UTF-16LE");
+    }
+  }
+
+  // Test the path engine.
+  //
+  {
+    const char* doc (
+      "<root xmlns:x='urn:x'>"
+      "<record orange='1'><name>A<b>B</b></name><x:choice1>C</x:choice1>"
+      "</record>"
+      "<skip><deep><choice1 a='v'>D</choice1></deep></skip>"
+      "<record orange='2' type='t'><name>E</name></record>"
+      "</root>");
+
+    path_engine e;
+    e.add_namespace ("x", "urn:x");
+
+    vector<string> r;
+    auto cb = [&r] (const path_engine::match& m)
+    {
+      r.push_back (to_string (m.query) + ':' + m.name.name () + '=' +
+                   m.value);
+    };
+
+    e.add ("/root/record/name", cb);              // 0
+    e.add ("//choice1", cb);                      // 1
+    e.add ("/root/record/@orange", cb);           // 2
+    e.add ("//x:choice1", cb);                    // 3
+    e.add ("/root/record[@type='t']/name", cb);   // 4
+    e.add ("//*[@a]", cb);                        // 5
+    e.add ("/root//@*", cb);                      // 6
+    e.add ("//{urn:x}choice1", cb);               // 7
+
+    assert (e.size () == 8);
+
+    // Run with and without the engine's name table.
+    //
+    for (size_t i (0); i != 2; ++i)
+    {
+      r.clear ();
+
+      parser p (doc, strlen (doc), "path");
+
+      if (i == 0)
+        p.names (e.names ());
+
+      assert (e.evaluate (p) == parser::eof);
+
+      vector<string> x {
+        "2:orange=1", "6:orange=1",
+        "0:name=AB",
+        "3:choice1=C", "7:choice1=C",
+        "6:a=v",
+        "1:choice1=D", "5:choice1=D",
+        "2:orange=2", "6:orange=2", "6:type=t",
+        "0:name=E", "4:name=E"};
+
+      assert (r == x);
+    }
+
+    // Push mode.
+    //
+    {
+      path_engine e;
+      vector<string> r;
+      e.add ("//b", [&r] (const path_engine::match& m)
+             {
+               r.push_back (m.value);
+             });
+
+      parser p (parser::push_mode, "path-push");
+      p.feed ("<a><b>x", 7);
+      assert (e.evaluate (p) == parser::need_more_input && r.empty ());
+      p.feed ("y</b><c><b>z</b></c></a>", 24, true);
+      assert (e.evaluate (p) == parser::eof);
+      assert (r.size () == 2 && r[0] == "xy" && r[1] == "z");
+    }
+
+    // Invalid paths.
+    //
+    const char* ip[] = {
+      "", "root", "/", "/a/", "/a[b]", "/a[@b", "/a[@b='c]", "/@a/b",
+      "/y:a", "/{urn:x}x:a", "/@a[@b]"};
+
+    for (const char* p: ip)
+    {
+      try
+      {
+        e.add (p, cb);
+        assert (false);
+      }
+      catch (const invalid_path&)
+      {
+      }
+    }
+  }
+
+  // Test character data and attribute values with special characters at
+  // various positions (exercises the vectorized scanning in Expat).
+  //
+  {
+    const char* sp[][3] = {
+      // Content, attribute, value.
+      {"&amp;", "&amp;", "&"},
+      {"&lt;", "&lt;", "<"},
+      {"]", "]", "]"},
+      {"\xC3\xA9", "\xC3\xA9", "\xC3\xA9"},
+      {"$", "$", "$"},
+      {"\x7F", "\x7F", "\x7F"},
+      {"\t", "\t", "\t"},
+      {"\n", "\n", "\n"},
+      {"\r\n", "\r\n", "\n"},
+      {" ", " ", " "},
+      {"'", "'", "'"},
+      {"&quot;", "&quot;", "\""}};
+
+    for (size_t n (1); n != 70; ++n)
+    {
+      for (size_t i (0); i != n; ++i)
+      {
+        for (const auto& s: sp)
+        {
+          string t (n, 'x');
+          string v (t);
+
+          string c (t), a (t);
+          c.replace (i, 1, s[0]);
+          a.replace (i, 1, s[1]);
+          v.replace (i, 1, s[2]);
+
+          // Whitespaces in attribute values are normalized to spaces.
+          //
+          string av (v);
+          replace (av.begin (), av.end (), '\t', ' ');
+          replace (av.begin (), av.end (), '\n', ' ');
+
+          string d ("<r a=\"" + a + "\">" + c + "</r>");
+          parser p (d.data (), d.size (), "scan");
+
+          p.next_expect (parser::start_element, "r", content::simple);
+          assert (p.attribute ("a") == av);
+          p.next_expect (parser::characters);
+          assert (p.value () == v);
+          p.next_expect (parser::end_element);
+        }
+      }
+    }
+
+    // Invalid characters inside long runs.
+    //
+    for (size_t i (0); i != 40; ++i)
+    {
+      for (const char* s: {"\x01", "\x80", "]]>"})
+      {
+        string t (40, 'x');
+        t.insert (i, s);
+
+        for (bool attr: {false, true})
+        {
+          if (attr && s[0] == ']')
+            continue;
+
+          string d (attr
+                    ? "<r a='" + t + "'/>"
+                    : "<r>" + t + "</r>");
+          try
+          {
+            parser p (d.data (), d.size (), "scan");
+            p.next_expect (parser::start_element, "r", content::simple);
+            p.next ();
+            p.next ();
+            assert (false);
+          }
+          catch (const parsing&)
+          {
+          }
+        }
+      }
+    }
+  }
+
   // Test value extraction.
   //
   {
@@ -121,6 +1823,108 @@ main ()
     p.next_expect (parser::end_element);
   }
 
+  // Test numeric value parsing.
+  //
+  {
+    istringstream is ("<root s='-32768' us='65535' i=' +42' u='4294967295'"
+                      " ll='-9223372036854775808' ull='18446744073709551615'"
+                      " f='1.5' d='-2.5e-3' ld='.25'/>");
+    parser p (is, "test");
+    p.next_expect (parser::start_element, "root");
+
+    assert (p.attribute<short> ("s") == -32768);
+    assert (p.attribute<unsigned short> ("us") == 65535);
+    assert (p.attribute<int> ("i") == 42);
+    assert (p.attribute<unsigned int> ("u") == 4294967295U);
+    assert (p.attribute<long long> ("ll") == -9223372036854775807LL - 1);
+    assert (p.attribute<unsigned long long> ("ull") ==
+            18446744073709551615ULL);
+    assert (p.attribute<float> ("f") == 1.5F);
+    assert (p.attribute<double> ("d") == -2.5e-3);
+    assert (p.attribute<long double> ("ld") == 0.25L);
+
+    p.next_expect (parser::end_element);
+
+#ifdef LIBSTUDXML_STRING_VIEW
+    assert (value_traits<int>::parse (std::string_view ("123"), p) == 123);
+#endif
+
+    const char* bad[] = {
+      "", " ", "+", "-", "1 ", "1x", "--1", "+-1", "0x10", "1e", "inf",
+      "nan", "1.2.3", "- 1"};
+
+    for (size_t i (0); i != sizeof (bad) / sizeof (bad[0]); ++i)
+    {
+      try
+      {
+        value_traits<double>::parse (bad[i], p);
+        assert (false);
+      }
+      catch (const parsing&) {}
+
+      try
+      {
+        value_traits<int>::parse (bad[i], p);
+        assert (false);
+      }
+      catch (const parsing&) {}
+    }
+
+    const char* range[] = {"32768", "-32769", "1.5", "1e3"};
+
+    for (size_t i (0); i != sizeof (range) / sizeof (range[0]); ++i)
+    {
+      try
+      {
+        value_traits<short>::parse (range[i], p);
+        assert (false);
+      }
+      catch (const parsing&) {}
+    }
+
+    try
+    {
+      value_traits<unsigned int>::parse ("-1", p);
+      assert (false);
+    }
+    catch (const parsing&) {}
+
+    try
+    {
+      value_traits<unsigned int>::parse ("-0", p);
+      assert (false);
+    }
+    catch (const parsing&) {}
+
+    // Underflow yields zero or a denormal value while overflow is invalid.
+    //
+    assert (value_traits<double>::parse ("1e-400", p) == 0.0);
+    assert (value_traits<double>::parse ("-0.00001e-400", p) == 0.0);
+    assert (value_traits<double>::parse ("1e-310", p) > 0.0);
+    assert (value_traits<float>::parse ("1e-46", p) == 0.0F);
+    assert (value_traits<float>::parse ("1e-310", p) == 0.0F);
+    assert (value_traits<float>::parse ("1e-40", p) > 0.0F);
+
+    const char* overflow[] = {"1e400", "-1e400", "0.1e310", "1e99999999999"};
+
+    for (size_t i (0); i != sizeof (overflow) / sizeof (overflow[0]); ++i)
+    {
+      try
+      {
+        value_traits<double>::parse (overflow[i], p);
+        assert (false);
+      }
+      catch (const parsing&) {}
+    }
+
+    try
+    {
+      value_traits<float>::parse ("1e39", p);
+      assert (false);
+    }
+    catch (const parsing&) {}
+  }
+
   // Test attribute maps.
   //
   {
@@ -159,6 +1963,39 @@ main ()
     assert (p.attribute ("a", "") == "");
   }
 
+  {
+    istringstream is ("<root b='b' a='a'>"
+                      "<nested x='1' y='2'/><nested z='3'/>"
+                      "</root>");
+    parser p (is, "test");
+    p.next_expect (parser::start_element, "root");
+
+    {
+      const parser::attribute_map_type& m (p.attribute_map ());
+      assert (m.size () == 2);
+
+      parser::attribute_map_type::const_iterator i (m.begin ());
+      assert (i->first == qname ("b") && i->second.value == "b");
+      ++i;
+      assert (i->first == qname ("a") && i->second.value == "a");
+      assert (++i == m.end ());
+
+      assert (m.find (qname ("a")) != m.end ());
+      assert (m.count (qname ("c")) == 0);
+    }
+
+    p.next_expect (parser::start_element, "nested");
+    assert (p.attribute ("y") == "2" && p.attribute ("x") == "1");
+    p.next_expect (parser::end_element);
+
+    p.next_expect (parser::start_element, "nested");
+    assert (p.attribute ("z") == "3");
+    assert (p.attribute_map ().size () == 1);
+    p.next_expect (parser::end_element);
+
+    p.next_expect (parser::end_element);
+  }
+
   try
   {
     istringstream is ("<root a='a' b='b'/>");
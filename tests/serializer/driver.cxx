@@ -2,10 +2,15 @@
 // license   : MIT; see accompanying LICENSE file
 
 #include <string>
+#include <vector>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
+#include <libstudxml/binary.hxx>
+#include <libstudxml/allocator.hxx>
 #include <libstudxml/serializer.hxx>
+#include <libstudxml/output-sink.hxx>
 
 #undef NDEBUG
 #include <cassert>
@@ -60,6 +65,437 @@ main ()
     assert (os.str () == "<root version=\"123\">true</root>\n");
   }
 
+  // Test numeric value serialization (same as std::ostream).
+  //
+  {
+    ostringstream os;
+    serializer s (os, "test", 0);
+
+    s.start_element ("root");
+    s.attribute ("s", static_cast<short> (-32768));
+    s.attribute ("ull", 18446744073709551615ULL);
+    s.attribute ("ll", -9223372036854775807LL - 1);
+    s.attribute ("f", 1.5F);
+    s.attribute ("d", 1.0 / 3);
+    s.attribute ("e", 1e100);
+    s.attribute ("ld", 123456789.0L);
+    s.characters (-42);
+    s.end_element ();
+
+    assert (os.str () ==
+            "<root s=\"-32768\" ull=\"18446744073709551615\""
+            " ll=\"-9223372036854775808\" f=\"1.5\" d=\"0.333333\""
+            " e=\"1e+100\" ld=\"1.23457e+08\">-42</root>\n");
+  }
+
+  // Test escaping and UTF-8 validation of long text at various positions
+  // (exercises the vectorized scanning in Genx).
+  //
+  {
+    const char* sp[][3] = {
+      // Text, content, attribute.
+      {"<", "&lt;", "&lt;"},
+      {"&", "&amp;", "&amp;"},
+      {">", "&gt;", ">"},
+      {"\"", "\"", "&quot;"},
+      {"\r", "&#xD;", "&#xD;"},
+      {"\t", "\t", "&#x9;"},
+      {"\n", "\n", "&#xA;"},
+      {"\xC3\xA9", "\xC3\xA9", "\xC3\xA9"},
+      {"\xF0\x9F\x98\x80", "\xF0\x9F\x98\x80", "\xF0\x9F\x98\x80"}};
+
+    for (size_t n (1); n != 50; ++n)
+    {
+      for (size_t i (0); i != n; ++i)
+      {
+        for (const auto& p: sp)
+        {
+          string t (n, 'x'), c (t), a (t);
+          t.replace (i, 1, p[0]);
+          c.replace (i, 1, p[1]);
+          a.replace (i, 1, p[2]);
+
+          ostringstream os;
+          serializer s (os, "test", 0);
+
+          s.start_element ("r");
+          s.attribute ("a", t);
+          s.characters (t);
+          s.end_element ();
+
+          assert (os.str () == "<r a=\"" + a + "\">" + c + "</r>\n");
+        }
+      }
+    }
+
+    // Invalid UTF-8 and non-XML characters.
+    //
+    const char* ip[] = {
+      "\x01", "\x80", "\xC3", "\xC3(", "\xC0\xAF", "\xED\xA0\x80",
+      "\xF4\x90\x80\x80", "\xFF"};
+
+    for (size_t i (0); i != 40; ++i)
+    {
+      for (const char* p: ip)
+      {
+        string t (40, 'x');
+        t.insert (i, p);
+
+        for (bool attr: {false, true})
+        {
+          ostringstream os;
+          serializer s (os, "test", 0);
+          s.start_element ("r");
+
+          try
+          {
+            if (attr)
+              s.attribute ("a", t);
+            else
+              s.characters (t);
+
+            assert (false);
+          }
+          catch (const serialization&)
+          {
+          }
+        }
+      }
+    }
+  }
+
+  // Test custom allocator.
+  //
+  {
+    monotonic_allocator a (256);
+
+    for (size_t i (0); i != 2; ++i)
+    {
+      ostringstream os;
+      serializer s (os, "test", 0, &a);
+
+      s.start_element ("test", "root");
+      s.namespace_decl ("test", "t");
+      s.attribute ("a", "1");
+      s.element ("nested", "X");
+      s.end_element ();
+
+      assert (os.str () ==
+              "<t:root xmlns:t=\"test\" a=\"1\"><nested>X</nested></t:root>\n");
+    }
+
+    a.release ();
+  }
+
+  // Test output sinks, buffering, and flush policies.
+  //
+  {
+    const char* exp ("<root><rec>1</rec><rec>2</rec><rec>3</rec></root>\n");
+
+    {
+      string str;
+      string_output_sink os (str);
+      serializer s (os, "test", 0);
+
+      s.start_element ("root");
+      s.element ("rec", 1);
+      s.element ("rec", 2);
+      s.element ("rec", 3);
+      s.end_element ();
+
+      assert (str == exp);
+    }
+
+    {
+      vector<char> v;
+      vector_output_sink os (v);
+      serializer s (os, "test", 0);
+      s.buffer_size (0); // Unbuffered.
+
+      s.start_element ("root");
+      s.element ("rec", 1);
+      assert (string (v.begin (), v.end ()) == "<root><rec>1</rec>");
+      s.element ("rec", 2);
+      s.element ("rec", 3);
+      s.end_element ();
+
+      assert (string (v.begin (), v.end ()) == exp);
+    }
+
+    // Flush after each record (child of the root element).
+    //
+    {
+      string str;
+      vector<string> flushed;
+      callback_output_sink os (
+        [&str] (const void* d, size_t n)
+        {
+          str.append (static_cast<const char*> (d), n);
+        },
+        [&str, &flushed] () {flushed.push_back (str);});
+
+      serializer s (os, "test", 0);
+      s.flush_policy (serializer::flush_record);
+
+      s.start_element ("root");
+      s.element ("rec", 1);
+      s.element ("rec", 2);
+      assert (str == "<root><rec>1</rec><rec>2</rec>");
+      s.element ("rec", 3);
+      s.end_element ();
+
+      assert (flushed.size () == 4);
+      assert (flushed[0] == "<root><rec>1</rec>");
+      assert (flushed[3] == exp);
+    }
+
+    // Only write when explicitly flushed (or at the end of the document)
+    // growing the buffer as necessary.
+    //
+    {
+      string str;
+      size_t writes (0);
+      callback_output_sink os (
+        [&str, &writes] (const void* d, size_t n)
+        {
+          str.append (static_cast<const char*> (d), n);
+          writes++;
+        });
+
+      serializer s (os, "test", 0);
+      s.flush_policy (serializer::flush_explicit);
+      s.buffer_size (4);
+
+      s.start_element ("root");
+      s.element ("rec", 1);
+      assert (writes == 0 && s.buffer_size () >= 18);
+      s.flush ();
+      assert (writes == 1 && str == "<root><rec>1</rec>");
+      s.element ("rec", 2);
+      s.element ("rec", 3);
+      s.end_element ();
+
+      assert (writes == 2 && str == exp);
+    }
+
+    // Output larger than the buffer.
+    //
+    {
+      string str, v (100, 'x');
+      string_output_sink os (str);
+      serializer s (os, "test", 0);
+      s.buffer_size (16);
+
+      s.start_element ("root");
+      s.characters (v);
+      s.end_element ();
+
+      assert (str == "<root>" + v + "</root>\n");
+    }
+
+    // Propagation of the sink exceptions.
+    //
+    try
+    {
+      callback_output_sink os (
+        [] (const void*, size_t) {throw runtime_error ("write");});
+
+      serializer s (os, "test", 0);
+      s.start_element ("root");
+      s.end_element ();
+      assert (false);
+    }
+    catch (const runtime_error& e)
+    {
+      assert (string (e.what ()) == "write");
+    }
+
+    // The sink exception is only propagated once.
+    //
+    {
+      size_t n (0);
+      callback_output_sink os (
+        [&n] (const void*, size_t)
+        {
+          if (n++ == 0)
+            throw runtime_error ("write");
+        });
+
+      serializer s (os, "test", 0);
+      s.flush_policy (serializer::flush_explicit);
+      s.start_element ("root");
+      s.characters ("a");
+
+      try
+      {
+        s.flush ();
+        assert (false);
+      }
+      catch (const runtime_error&) {}
+
+      s.end_element ();
+      assert (n > 1);
+    }
+  }
+
+  // Test many distinct element, attribute, and namespace names (hashed
+  // lookup in Genx).
+  //
+  {
+    ostringstream os, exp;
+    serializer s (os, "test", 0);
+
+    s.start_element ("root");
+    exp << "<root";
+
+    for (size_t i (0); i != 50; ++i)
+    {
+      ostringstream n, p;
+      n << "urn:test:" << i;
+      p << "p" << i;
+      s.namespace_decl (n.str (), p.str ());
+      exp << " xmlns:p" << i << "=\"urn:test:" << i << "\"";
+    }
+
+    exp << ">";
+
+    for (size_t r (0); r != 2; ++r)
+    {
+      for (size_t i (0); i != 2000; ++i)
+      {
+        ostringstream n, e, a;
+        n << "urn:test:" << i % 50;
+        e << "e" << i;
+        a << "a" << i;
+
+        s.start_element (n.str (), e.str ());
+        s.attribute (a.str (), i);
+        s.attribute (n.str (), a.str (), i);
+        s.end_element ();
+
+        exp << "<p" << i % 50 << ":e" << i << " a" << i << "=\"" << i
+            << "\" p" << i % 50 << ":a" << i << "=\"" << i << "\"/>";
+      }
+    }
+
+    s.end_element ();
+    exp << "</root>\n";
+
+    assert (os.str () == exp.str ());
+  }
+
+  // Test pre-declared elements and attributes.
+  //
+  {
+    ostringstream os;
+    serializer s (os, "test", 0);
+
+    serializer::element_handle root (s.declare_element ("root"));
+    serializer::element_handle item (
+      s.declare_element (qname ("urn:test", "item")));
+    serializer::attribute_handle id (s.declare_attribute ("id"));
+    serializer::attribute_handle lang (
+      s.declare_attribute ("urn:test", "lang"));
+
+    s.start_element (root);
+    s.namespace_decl ("urn:test", "t");
+
+    for (size_t i (0); i != 2; ++i)
+    {
+      s.start_element (item);
+      s.attribute (id, i);
+
+      if (i == 0)
+        s.attribute (lang, "en");
+      else
+      {
+        s.start_attribute (lang);
+        s.characters ("fr");
+        s.end_attribute ();
+      }
+
+      s.end_element ();
+    }
+
+    s.element (item, 123);
+    s.end_element ("root");
+
+    assert (os.str () ==
+            "<root xmlns:t=\"urn:test\">"
+            "<t:item id=\"0\" t:lang=\"en\"/>"
+            "<t:item id=\"1\" t:lang=\"fr\"/>"
+            "<t:item>123</t:item>"
+            "</root>\n");
+  }
+
+  try
+  {
+    ostringstream os;
+    serializer s (os, "test");
+
+    serializer::attribute_handle a (s.declare_attribute ("a"));
+
+    s.start_element ("root");
+    s.attribute (a, 1);
+    s.attribute (a, 2);
+    assert (false);
+  }
+  catch (const xml::exception&)
+  {
+  }
+
+  try
+  {
+    ostringstream os;
+    serializer s (os, "test");
+    s.declare_element ("a b");
+    assert (false);
+  }
+  catch (const xml::exception&)
+  {
+  }
+
+  // Null handles and handles declared by another serializer.
+  //
+  {
+    ostringstream os1, os2;
+    serializer s1 (os1, "test");
+    serializer s2 (os2, "test");
+
+    serializer::element_handle e (s1.declare_element ("root"));
+    serializer::attribute_handle a (s1.declare_attribute ("a"));
+
+    try
+    {
+      s2.start_element (serializer::element_handle ());
+      assert (false);
+    }
+    catch (const serialization&) {}
+
+    try
+    {
+      s2.element (e, 1);
+      assert (false);
+    }
+    catch (const serialization&) {}
+
+    s2.start_element ("root");
+
+    try
+    {
+      s2.attribute (serializer::attribute_handle (), "1");
+      assert (false);
+    }
+    catch (const serialization&) {}
+
+    try
+    {
+      s2.start_attribute (a);
+      assert (false);
+    }
+    catch (const serialization&) {}
+  }
+
   // Test helpers for serializing elements with simple content.
   //
   {
@@ -95,4 +531,113 @@ main ()
             "<g1:nested xmlns:g1=\"test\">123</g1:nested>"
             "</root>\n");
   }
+
+  // Test serializing binary data as base64 and hex-encoded characters.
+  //
+  {
+    const string h ("Hello, World!");
+
+    string d;
+    for (size_t i (0); i != 10000; ++i)
+      d += static_cast<char> (i * 7 + i / 256);
+
+    ostringstream os;
+    serializer s (os, "binary", 0);
+
+    s.start_element ("root");
+
+    s.start_element ("a");
+    s.characters_base64 (h.data (), h.size ());
+    s.end_element ();
+
+    s.start_element ("b");
+    s.characters_base64 (h.begin (), h.end ());
+    s.end_element ();
+
+    s.start_element ("c");
+    s.characters_hex (h.data (), 5);
+    s.end_element ();
+
+    s.start_element ("d");
+    s.characters_base64 (h.data (), 0);
+    s.end_element ();
+
+    // Large data, including via the stream and iterators.
+    //
+    istringstream is (d);
+    s.start_element ("e");
+    s.characters_base64 (is);
+    s.end_element ();
+
+    s.start_element ("f");
+    s.characters_base64 (d.data (), d.size ());
+    s.end_element ();
+
+    s.start_element ("g");
+    s.characters_hex (d.begin (), d.end ());
+    s.end_element ();
+
+    s.end_element (); // root
+
+    const string r (os.str ());
+    const string p ("<root>"
+                    "<a>SGVsbG8sIFdvcmxkIQ==</a>"
+                    "<b>SGVsbG8sIFdvcmxkIQ==</b>"
+                    "<c>48656C6C6F</c>"
+                    "<d/>"
+                    "<e>");
+    assert (r.compare (0, p.size (), p) == 0);
+
+    size_t e (r.find ("</e>"));
+    size_t f (r.find ("<f>"));
+    size_t g (r.find ("<g>"));
+    assert (e != string::npos && f != string::npos && g != string::npos);
+
+    const string b64 (r, p.size (), e - p.size ());
+    assert (b64.size () == (d.size () + 2) / 3 * 4);
+    assert (r.compare (f + 3, b64.size (), b64) == 0);
+
+    base64_decoder bd;
+    vector<char> t (base64_decoder::decode_size (b64.size ()));
+    size_t n;
+    assert (bd.decode (b64.data (), b64.size (), t.data (), n) &&
+            bd.finish () &&
+            string (t.data (), n) == d);
+
+    hex_decoder hd;
+    t.resize (hex_decoder::decode_size (d.size () * 2));
+    assert (hd.decode (r.data () + g + 3, d.size () * 2, t.data (), n) &&
+            hd.finish () &&
+            string (t.data (), n) == d);
+
+    // Reaching eof is not an error.
+    //
+    assert (is.eof () && !is.fail ());
+  }
+
+  // Test binary data stream errors.
+  //
+  for (size_t i (0); i != 2; ++i)
+  {
+    istringstream bs ("data");
+    istream ns (0); // No stream buffer.
+    istream& is (i == 0 ? bs : ns);
+
+    if (i == 0)
+      is.setstate (ios_base::badbit);
+
+    try
+    {
+      ostringstream os;
+      serializer s (os, "test");
+
+      s.start_element ("root");
+      s.characters_base64 (is);
+      assert (false);
+    }
+    catch (const serialization& e)
+    {
+      assert (e.description () == "io failure");
+    }
+  }
 }